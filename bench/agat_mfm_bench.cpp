@@ -0,0 +1,104 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2025 Mikhail Revzin <p3.141592653589793238462643@gmail.com>
+// Part of the dsk_tools project: https://github.com/Ptr314/dsk_tools
+// Description: Agat MFM decoding kernels against the decoder they replaced: equivalence check and timing
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <vector>
+
+#include "agat_mfm.h"
+#include "definitions.h"
+#include "simd.h"
+
+using namespace dsk_tools;
+
+// decode_agat_mfm_data() before the kernels, one push_back per byte
+static void decode_old(BYTES & out, const BYTES & in)
+{
+    out.clear();
+    if (in.size() < 2) return;
+    for (size_t i = 0; i < in.size() / 2; i++) {
+        if (i * 2 + 1 >= in.size()) break;
+        const uint8_t idx1 = in[i*2] >> 1;
+        const uint8_t idx2 = in[i*2+1] >> 1;
+        out.push_back((agat_MFM_decode_tab[idx1] << 4) | agat_MFM_decode_tab[idx2]);
+    }
+}
+
+using Kernel = void (*)(const uint8_t *, uint8_t *, size_t);
+
+struct Variant {
+    const char * name;
+    Kernel kernel;                          // nullptr: decode_agat_mfm() at the level
+    SimdLevel level;
+};
+
+static void run(const Variant & v, const BYTES & in, BYTES & out)
+{
+    if (v.kernel != nullptr) {
+        v.kernel(in.data(), out.data(), out.size());
+        return;
+    }
+    set_simd_level(v.level);
+    decode_agat_mfm(in.data(), out.data(), out.size());
+}
+
+int main(int argc, char ** argv)
+{
+    const int rounds = (argc > 1) ? std::atoi(argv[1]) : 2000;
+    const size_t half = 12544;              // Bytes of a side of an HFE track: 6272 decoded
+
+    std::vector<Variant> variants = {
+        {"scalar reference", &decode_agat_mfm_scalar, SimdLevel::Scalar},
+        {"64K table", nullptr, SimdLevel::Scalar},
+    };
+    if (simd_detect() == SimdLevel::AVX2)
+        variants.push_back({"AVX2", nullptr, SimdLevel::AVX2});
+
+    // Every length up to a few vector widths and a whole track half, random bytes
+    std::mt19937 rng(1);
+    bool ok = true;
+    BYTES in, expected, out;
+    for (size_t size = 0; size <= half; size = (size < 200) ? size + 1 : half) {
+        in.resize(size);
+        for (uint8_t & b : in) b = static_cast<uint8_t>(rng());
+        decode_old(expected, in);
+        for (const Variant & v : variants) {
+            out.assign(size / 2, 0);
+            run(v, in, out);
+            if (out != expected) {
+                std::printf("MISMATCH: %s, %zu input bytes\n", v.name, size);
+                ok = false;
+            }
+        }
+        if (size == half) break;
+    }
+    set_simd_level(simd_detect());
+    if (!ok) return EXIT_FAILURE;
+    std::printf("All kernels match the old decoder\n");
+
+    // Best time of a track half
+    in.resize(half);
+    for (uint8_t & b : in) b = static_cast<uint8_t>(rng());
+    out.assign(half / 2, 0);
+    using Clock = std::chrono::steady_clock;
+    auto best_us = [&](const std::function<void()> & fn) {
+        double best = 1e30;
+        for (int r = 0; r < rounds; r++) {
+            const Clock::time_point start = Clock::now();
+            fn();
+            const double us = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+            if (us < best) best = us;
+        }
+        return best;
+    };
+    std::printf("%-20s %8.2f us\n", "old push_back loop", best_us([&]() {decode_old(expected, in);}));
+    for (const Variant & v : variants)
+        std::printf("%-20s %8.2f us\n", v.name, best_us([&]() {run(v, in, out);}));
+    set_simd_level(simd_detect());
+    return EXIT_SUCCESS;
+}
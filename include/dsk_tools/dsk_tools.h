@@ -7,11 +7,21 @@
 
 #include <string>
 #include <sstream>
+#include <vector>
 
 #include "definitions.h"
 #include "utils.h"
 #include "bit_enums.h"
 #include "host_helpers.h"
+#include "simd.h"
+#include "gcr62.h"
+#include "agat_mfm.h"
+#include "track_scan.h"
+#include "sector_layout.h"
+#include "read_timing.h"
+#include "thread_pool.h"
+#include "progress.h"
+#include "async_job.h"
 
 #include "disk_image.h"
 #include "image_agat140.h"
@@ -19,6 +29,7 @@
 #include "image_fil.h"
 
 #include "loader.h"
+#include "source.h"
 #include "loader_raw.h"
 #include "loader_aim.h"
 #include "loader_hxc_hfe.h"
@@ -27,9 +38,12 @@
 #include "loader_nic.h"
 #include "loader_hxc_mfm.h"
 #include "loader_imd.h"
+#include "loader_woz.h"
 
 #include "writer.h"
+#include "sink.h"
 #include "writer_raw.h"
+#include "writer_imd.h"
 #include "writer_mfm.h"
 #include "writer_hxc_hfe.h"
 #include "writer_hxc_mfm.h"
@@ -51,19 +65,37 @@
 
 namespace dsk_tools {
 
+    struct DetectCandidate {
+        std::string format_id;
+        std::string type_id;
+        std::string filesystem_id;
+        int         confidence;             // 0..100
+    };
+    using DetectCandidates = std::vector<DetectCandidate>;
+
+    // All filesystems the image may hold, the most probable first; only a few sectors are decoded
+    Result probe_fdd_type(const std::string &file_name, DetectCandidates & candidates);
+    // The most probable of them; format_only: by the file name alone, i.e. for an output file
     Result detect_fdd_type(const std::string &file_name, std::string &format_id, std::string &type_id, std::string &filesystem_id, bool format_only = false);
     std::unique_ptr<diskImage> prepare_image(const std::string &file_name, const std::string &format_id, const std::string &type_id, const DiskDefs & diskdefs);
+    // The same for images which are not files: file_name only gives the extension and a name for reports
+    Result probe_fdd_type(std::shared_ptr<Source> source, const std::string &file_name, DetectCandidates & candidates);
+    Result detect_fdd_type(std::shared_ptr<Source> source, const std::string &file_name, std::string &format_id, std::string &type_id, std::string &filesystem_id);
+    std::unique_ptr<diskImage> prepare_image(std::shared_ptr<Source> source, const std::string &file_name, const std::string &format_id, const std::string &type_id, const DiskDefs & diskdefs);
+    // Sector checksums straight from the file: no image is loaded and no filesystem is looked for
+    Result verify_image(const std::string &file_name, VerifyReport & report);
     std::unique_ptr<fileSystem> prepare_filesystem(diskImage * image, const std::string &filesystem_id, const DiskDefs & diskdefs);
     BYTES code44(const BYTES & buffer);
     BYTES decode44(const BYTES & buffer);
-    void encode_gcr62(const uint8_t data_in[], uint8_t * data_out);
-    bool decode_gcr62(const uint8_t data_in[], uint8_t * data_out);
+    void decode44(const uint8_t * in, uint8_t * out, int count);
     uint16_t encode_agat_MFM_byte(uint8_t data, uint8_t &last_byte);
     uint8_t decode_agat_MFM_byte(uint8_t data);
     void encode_agat_mfm_array(BYTES &out, uint8_t data, uint16_t count, uint8_t & last_byte);
     uint8_t encode_agat_mfm_data(BYTES &out, uint8_t * data, uint16_t count, uint8_t & last_byte);
     void decode_agat_mfm_data(BYTES &out, const BYTES & in);
     Result decode_agat_840_track(BYTES &out, const BYTES & in);
+    // out: 21 sectors, nullptr to check the fields only; scan, if given, receives every field found
+    Result decode_agat_840_track(uint8_t * out, const uint8_t * in, int track_len, TrackScan * scan = nullptr);
     Result decode_agat_840_image(BYTES &out, const BYTES & in);
     std::string agat_vtoc_info(const Agat_VTOC & VTOC);
     std::string agat_sos_info(const SPRITE_OS_DPB_DISK & DPB);
@@ -71,10 +103,13 @@ namespace dsk_tools {
     std::string agat_vr_info(const BYTES & data, bool comment_only = false);
 
     Result load_agat140_track(int track, BYTES & buffer, const BYTES & in, int track_len);
+    // buffer: whole image, nullptr to verify the checksums only; scan, if given, receives every field found
+    Result load_agat140_track(int track, uint8_t * buffer, const uint8_t * in, int track_len, TrackScan * scan = nullptr);
     Result decode_agat_140_image(BYTES &out, const BYTES & in, const int track_len);
 
     void register_all_viewers();
     std::unique_ptr<Loader> create_loader(const std::string& file_name, const std::string& format_id, const std::string& type_id);
+    std::unique_ptr<Loader> create_loader(std::shared_ptr<Source> source, const std::string& file_name, const std::string& format_id, const std::string& type_id);
     std::unique_ptr<Writer> create_writer(const std::string & format_id, const uint8_t volume_id, diskImage * image);
 
     std::string decode_error(const Result& result);
@@ -0,0 +1,179 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2025 Mikhail Revzin <p3.141592653589793238462643@gmail.com>
+// Part of the dsk_tools project: https://github.com/Ptr314/dsk_tools
+// Description: Agat 840 Kb MFM bitstream decoder and encoder (HFE track halves)
+
+#include <cstring>
+
+#include "agat_mfm.h"
+#include "definitions.h"
+#include "simd.h"
+
+#ifdef DSK_TOOLS_X86_SIMD
+    #include <immintrin.h>
+#endif
+
+namespace dsk_tools {
+
+    void decode_agat_mfm_scalar(const uint8_t * data_in, uint8_t * data_out, size_t count)
+    {
+        for (size_t i = 0; i < count; i++)
+            data_out[i] = (agat_MFM_decode_tab[data_in[i*2] >> 1] << 4) | agat_MFM_decode_tab[data_in[i*2+1] >> 1];
+    }
+
+    // Both input bytes at once: 64 Kb, built on first use
+    struct AgatMFMWordTable {
+        uint8_t tab[65536];
+        AgatMFMWordTable()
+        {
+            for (unsigned w = 0; w < 65536; w++)
+                tab[w] = (agat_MFM_decode_tab[(w & 0xFF) >> 1] << 4) | agat_MFM_decode_tab[w >> 9];
+        }
+    };
+
+    static void decode_agat_mfm_table(const uint8_t * data_in, uint8_t * data_out, size_t count)
+    {
+        static const AgatMFMWordTable t;
+        for (size_t i = 0; i < count; i++)
+            data_out[i] = t.tab[data_in[i*2] | (data_in[i*2+1] << 8)];
+    }
+
+#ifdef DSK_TOOLS_X86_SIMD
+    // Data bits are the odd bits of every byte, LSB first: bits 1, 3 of the low nibble
+    // and bits 5, 7 of the high one give the four bits of the decoded half-byte
+    DSK_TARGET_AVX2
+    static void decode_agat_mfm_avx2(const uint8_t * data_in, uint8_t * data_out, size_t count)
+    {
+        const __m256i lo_tab = _mm256_setr_epi8(
+            0, 0, 8, 8, 0, 0, 8, 8, 4, 4, 12, 12, 4, 4, 12, 12,
+            0, 0, 8, 8, 0, 0, 8, 8, 4, 4, 12, 12, 4, 4, 12, 12);
+        const __m256i hi_tab = _mm256_setr_epi8(
+            0, 0, 2, 2, 0, 0, 2, 2, 1, 1, 3, 3, 1, 1, 3, 3,
+            0, 0, 2, 2, 0, 0, 2, 2, 1, 1, 3, 3, 1, 1, 3, 3);
+        const __m256i nibble = _mm256_set1_epi8(0x0F);
+        const __m256i merge = _mm256_set1_epi16(0x0110);        // first byte * 16 + second byte
+
+        size_t i = 0;
+        for (; i + 32 <= count; i += 32) {
+            __m256i r[2];
+            for (int k = 0; k < 2; k++) {
+                const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data_in + i*2 + k*32));
+                const __m256i lo = _mm256_shuffle_epi8(lo_tab, _mm256_and_si256(b, nibble));
+                const __m256i hi = _mm256_shuffle_epi8(hi_tab, _mm256_and_si256(_mm256_srli_epi16(b, 4), nibble));
+                r[k] = _mm256_maddubs_epi16(_mm256_or_si256(lo, hi), merge);
+            }
+            // packus works within 128-bit lanes
+            const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(r[0], r[1]), _MM_SHUFFLE(3, 1, 2, 0));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(data_out + i), packed);
+        }
+        decode_agat_mfm_table(data_in + i*2, data_out + i, count - i);
+    }
+#endif
+
+    void decode_agat_mfm(const uint8_t * data_in, uint8_t * data_out, size_t count)
+    {
+#ifdef DSK_TOOLS_X86_SIMD
+        if (simd_level() == SimdLevel::AVX2) {
+            decode_agat_mfm_avx2(data_in, data_out, count);
+            return;
+        }
+#endif
+        decode_agat_mfm_table(data_in, data_out, count);
+    }
+
+    // agat_MFM_tab words in the order they are stored in: bit 0 of the previous byte and the byte itself
+    struct AgatMFMEncodeTable {
+        uint8_t tab[512][2];
+        AgatMFMEncodeTable()
+        {
+            for (unsigned i = 0; i < 512; i++) {
+                tab[i][0] = agat_MFM_tab[i] >> 8;
+                tab[i][1] = agat_MFM_tab[i] & 0xFF;
+            }
+        }
+    };
+
+    void encode_agat_mfm(const uint8_t * data_in, uint8_t * data_out, size_t count, uint8_t & last_byte)
+    {
+        static const AgatMFMEncodeTable t;
+        if (count == 0) return;
+        std::memcpy(data_out, t.tab[((last_byte & 1) << 8) | data_in[0]], 2);
+        // The previous byte is read again instead of being carried over, iterations are independent
+        for (size_t i = 1; i < count; i++)
+            std::memcpy(data_out + i*2, t.tab[((data_in[i-1] & 1) << 8) | data_in[i]], 2);
+        last_byte = data_in[count - 1];
+    }
+
+    uint8_t agat_840_checksum_scalar(const uint8_t * data, size_t count)
+    {
+        // crc stays below 0x1FF, so folding the carry never overflows the low byte
+        unsigned crc = 0;
+        for (size_t i = 0; i < count; i++)
+            crc = (crc & 0xFF) + (crc >> 8) + data[i];
+        return crc & 0xFF;
+    }
+
+    static uint64_t sum_bytes_scalar(const uint8_t * data, size_t count)
+    {
+        uint64_t sum = 0;
+        for (size_t i = 0; i < count; i++)
+            sum += data[i];
+        return sum;
+    }
+
+#ifdef DSK_TOOLS_X86_SIMD
+    // Both 64-bit lanes in full: _mm_cvtsi128_si32 keeps 32 bits only, _mm_cvtsi128_si64 is missing on 32-bit x86
+    DSK_TARGET_SSE2
+    static uint64_t lane_sum(__m128i v)
+    {
+        uint64_t lanes[2];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), v);
+        return lanes[0] + lanes[1];
+    }
+
+    // psadbw against zero sums 8 bytes into every 64-bit lane
+    DSK_TARGET_SSE2
+    static uint64_t sum_bytes_sse2(const uint8_t * data, size_t count)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i acc = zero;
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+            acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)), zero));
+        return lane_sum(acc) + sum_bytes_scalar(data + i, count - i);
+    }
+
+    DSK_TARGET_AVX2
+    static uint64_t sum_bytes_avx2(const uint8_t * data, size_t count)
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        __m256i acc = zero;
+        size_t i = 0;
+        for (; i + 32 <= count; i += 32)
+            acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)), zero));
+        return lane_sum(_mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1)))
+               + sum_bytes_scalar(data + i, count - i);
+    }
+#endif
+
+    uint8_t agat_840_checksum(const uint8_t * data, size_t count)
+    {
+        if (count == 0) return 0;
+
+        uint64_t sum;
+#ifdef DSK_TOOLS_X86_SIMD
+        switch (simd_level()) {
+            case SimdLevel::AVX2: sum = sum_bytes_avx2(data, count - 1); break;
+            case SimdLevel::SSE2: sum = sum_bytes_sse2(data, count - 1); break;
+            default: sum = sum_bytes_scalar(data, count - 1); break;
+        }
+#else
+        sum = sum_bytes_scalar(data, count - 1);
+#endif
+        // Every carry is added back at the next byte, so before the last one the value is the plain sum
+        // folded into 1..255 (0 only while all bytes are 0); the carry of the last byte is dropped
+        const unsigned folded = (sum == 0) ? 0 : static_cast<unsigned>((sum - 1) % 255) + 1;
+        return (folded + data[count - 1]) & 0xFF;
+    }
+
+}
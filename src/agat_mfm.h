@@ -0,0 +1,27 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2025 Mikhail Revzin <p3.141592653589793238462643@gmail.com>
+// Part of the dsk_tools project: https://github.com/Ptr314/dsk_tools
+// Description: Agat 840 Kb MFM bitstream decoder and encoder (HFE track halves)
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace dsk_tools {
+
+    // Decodes count bytes from 2*count bytes of the MFM bitstream, uses the best kernel available
+    void decode_agat_mfm(const uint8_t * data_in, uint8_t * data_out, size_t count);
+
+    // Reference implementation, other kernels must produce identical results
+    void decode_agat_mfm_scalar(const uint8_t * data_in, uint8_t * data_out, size_t count);
+
+    // Encodes count bytes into 2*count bytes of the bitstream;
+    // last_byte is the byte written before data_in[0], on return it is the last byte encoded
+    void encode_agat_mfm(const uint8_t * data_in, uint8_t * data_out, size_t count, uint8_t & last_byte);
+
+    // Sector checksum: a sum with the carry added back, uses the best kernel available
+    uint8_t agat_840_checksum(const uint8_t * data, size_t count);
+    // Reference implementation, byte by byte
+    uint8_t agat_840_checksum_scalar(const uint8_t * data, size_t count);
+
+}
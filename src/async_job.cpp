@@ -0,0 +1,117 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2025 Mikhail Revzin <p3.141592653589793238462643@gmail.com>
+// Part of the dsk_tools project: https://github.com/Ptr314/dsk_tools
+// Description: Long operations in a background thread, with progress and cancellation
+
+#include <chrono>
+#include <exception>
+
+#include "async_job.h"
+#include "dsk_tools/dsk_tools.h"
+
+namespace dsk_tools {
+
+    AsyncJob::AsyncJob(Task task, Progress::Callback callback):
+          m_progress(std::make_shared<Progress>(std::move(callback)))
+        , m_done(false)
+        , m_result(Result::ok())
+    {
+        // Started last, when all members are ready
+        m_thread = std::thread([this, task]() {
+            Result result = Result::ok();
+            try {
+                result = task(*m_progress);
+            } catch (const std::exception & e) {
+                result = Result::error(ErrorCode::IncorrectRequest, e.what());
+            }
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_result = result;
+                m_done = true;
+            }
+            m_finished.notify_all();
+        });
+    }
+
+    AsyncJob::~AsyncJob()
+    {
+        cancel();
+        if (m_thread.joinable()) m_thread.join();
+    }
+
+    bool AsyncJob::ready() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_done;
+    }
+
+    bool AsyncJob::wait_for(unsigned milliseconds) const
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        return m_finished.wait_for(lock, std::chrono::milliseconds(milliseconds), [this]{return m_done;});
+    }
+
+    Result AsyncJob::wait() const
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_finished.wait(lock, [this]{return m_done;});
+        return m_result;
+    }
+
+    std::unique_ptr<AsyncJob> run_async(AsyncJob::Task task, Progress::Callback callback)
+    {
+        return dsk_tools::make_unique<AsyncJob>(std::move(task), std::move(callback));
+    }
+
+    // The image reports to the job while it runs, and only then
+    static Result with_progress(diskImage * image, Progress & progress, const std::function<Result()> & fn)
+    {
+        image->set_progress(std::shared_ptr<Progress>(&progress, [](Progress *) {}));
+        Result result = fn();
+        image->set_progress(nullptr);
+        return result;
+    }
+
+    static Result write_image(diskImage * image, const std::string & format_id, uint8_t volume_id, const std::string & file_name, bool copy_tracks)
+    {
+        const auto writer = create_writer(format_id, volume_id, image);
+        if (!writer) return Result::error(ErrorCode::WriteUnsupported, "No writer for the format");
+        writer->set_copy_tracks(copy_tracks);
+
+        // The file may be the one the image is read from, see ReplaceFileSink
+        ReplaceFileSink file(file_name);
+        if (!file.is_open()) return Result::error(ErrorCode::CreateError, "Cannot create output file");
+        Result result = writer->write(file);
+        if (!result) return result;
+        return file.commit();
+    }
+
+    std::unique_ptr<AsyncJob> load_async(diskImage * image, Progress::Callback callback)
+    {
+        return run_async([image](Progress & progress) {
+            return with_progress(image, progress, [image]() {return image->load();});
+        }, std::move(callback));
+    }
+
+    std::unique_ptr<AsyncJob> write_async(diskImage * image, const std::string & format_id, uint8_t volume_id,
+                                          const std::string & file_name, Progress::Callback callback)
+    {
+        return run_async([=](Progress & progress) {
+            return with_progress(image, progress, [=]() {return write_image(image, format_id, volume_id, file_name, false);});
+        }, std::move(callback));
+    }
+
+    std::unique_ptr<AsyncJob> convert_async(diskImage * image, const std::string & format_id, uint8_t volume_id,
+                                            const std::string & file_name, Progress::Callback callback)
+    {
+        return run_async([=](Progress & progress) {
+            return with_progress(image, progress, [=]() {
+                Result result = image->load();
+                if (!result) return result;
+                // Nothing has changed the image since it was loaded
+                return write_image(image, format_id, volume_id, file_name, true);
+            });
+        }, std::move(callback));
+    }
+
+}
@@ -0,0 +1,61 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2025 Mikhail Revzin <p3.141592653589793238462643@gmail.com>
+// Part of the dsk_tools project: https://github.com/Ptr314/dsk_tools
+// Description: Long operations in a background thread, with progress and cancellation
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "definitions.h"
+#include "progress.h"
+
+namespace dsk_tools {
+
+    class diskImage;
+
+    // A future-like handle: the task starts at once in its own thread
+    class AsyncJob
+    {
+    public:
+        using Task = std::function<Result(Progress & progress)>;
+
+        // callback is called from the job thread or from decoding threads, never concurrently
+        AsyncJob(Task task, Progress::Callback callback = nullptr);
+        ~AsyncJob();                                            // Cancels the task and waits for it
+        AsyncJob(const AsyncJob &) = delete;
+        AsyncJob & operator=(const AsyncJob &) = delete;
+
+        void cancel() {m_progress->cancel();};                  // The task stops at the next track
+        bool ready() const;
+        bool wait_for(unsigned milliseconds) const;             // true if the task is done
+        Result wait() const;                                    // The result of the task, Cancelled if it was stopped
+        const Progress & progress() const {return *m_progress;};
+
+    private:
+        std::shared_ptr<Progress> m_progress;
+        mutable std::mutex m_mutex;
+        mutable std::condition_variable m_finished;
+        bool m_done;
+        Result m_result;
+        std::thread m_thread;
+    };
+
+    // Any task, i.e. a filesystem operation; it checks progress.cancelled() itself
+    std::unique_ptr<AsyncJob> run_async(AsyncJob::Task task, Progress::Callback callback = nullptr);
+
+    // The image must not be used by anyone else until the job is done.
+    // A cancelled load leaves the image not loaded and its buffer freed
+    std::unique_ptr<AsyncJob> load_async(diskImage * image, Progress::Callback callback = nullptr);
+    // Writes a loaded image; a partial output file is removed if the job fails or is cancelled
+    std::unique_ptr<AsyncJob> write_async(diskImage * image, const std::string & format_id, uint8_t volume_id,
+                                          const std::string & file_name, Progress::Callback callback = nullptr);
+    // Loads the image, then writes it; encoded tracks are copied where the containers allow it
+    std::unique_ptr<AsyncJob> convert_async(diskImage * image, const std::string & format_id, uint8_t volume_id,
+                                            const std::string & file_name, Progress::Callback callback = nullptr);
+
+}
@@ -0,0 +1,104 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2025 Mikhail Revzin <p3.141592653589793238462643@gmail.com>
+// Part of the dsk_tools project: https://github.com/Ptr314/dsk_tools
+// Description: Apple II / Agat 140 Kb read channel: nibbles from a raw bitstream (WOZ tracks)
+
+#include <cstring>
+
+#include "bitstream.h"
+
+#ifdef _MSC_VER
+    #include <intrin.h>
+#endif
+
+namespace dsk_tools {
+
+    static inline unsigned leading_zeros(uint64_t w)
+    {
+    #if defined(_MSC_VER) && defined(_WIN64)
+        unsigned long i;
+        _BitScanReverse64(&i, w);
+        return 63 - static_cast<unsigned>(i);
+    #elif defined(_MSC_VER)
+        unsigned long i;
+        if (_BitScanReverse(&i, static_cast<uint32_t>(w >> 32))) return 31 - static_cast<unsigned>(i);
+        _BitScanReverse(&i, static_cast<uint32_t>(w));
+        return 63 - static_cast<unsigned>(i);
+    #else
+        return static_cast<unsigned>(__builtin_clzll(w));
+    #endif
+    }
+
+    static inline uint64_t load_be64(const uint8_t * p)
+    {
+        uint64_t w = 0;
+        for (int i = 0; i < 8; i++)
+            w = (w << 8) | p[i];
+        return w;
+    }
+
+    void copy_bits(uint8_t * dst, size_t dst_pos, const uint8_t * src, size_t count)
+    {
+        if (count == 0) return;
+        const size_t bytes = (count + 7) / 8;
+        const unsigned tail = count & 7;
+        const unsigned shift = dst_pos & 7;
+        uint8_t * d = dst + dst_pos / 8;
+        for (size_t i = 0; i < bytes; i++) {
+            uint8_t b = src[i];
+            if (i == bytes - 1 && tail != 0) b &= static_cast<uint8_t>(0xFF << (8 - tail));
+            d[i] |= b >> shift;
+            if (shift != 0) d[i + 1] |= static_cast<uint8_t>(b << (8 - shift));
+        }
+    }
+
+    size_t read_nibbles(const uint8_t * data, size_t from, size_t to, BYTES & out)
+    {
+        size_t p = from;
+        while (p + 8 <= to) {
+            // At least 57 bits of the window are valid, the rest are zeros shifted in
+            const unsigned shift = p & 7;
+            uint64_t w = load_be64(data + p / 8) << shift;
+            const size_t valid = (to - p < 64 - shift) ? to - p : 64 - shift;
+            if (valid < 64 - shift)
+                w &= ~uint64_t(0) << (64 - valid);
+
+            size_t used = 0;
+            while (true) {
+                if (w == 0) {
+                    used = valid;
+                    break;
+                }
+                const unsigned lz = leading_zeros(w);
+                if (used + lz + 8 > valid) {
+                    used += lz;                                 // Stop at the 1 bit, the nibble is read with the next window
+                    break;
+                }
+                out.push_back(static_cast<uint8_t>(w >> (56 - lz)));
+                w = (lz + 8 < 64) ? w << (lz + 8) : 0;
+                used += lz + 8;
+            }
+            if (used == 0) break;
+            p += used;
+        }
+        return p;
+    }
+
+    size_t read_nibbles_scalar(const uint8_t * data, size_t from, size_t to, BYTES & out)
+    {
+        unsigned latch = 0;
+        size_t start = from;                                    // The first bit of the nibble being latched
+        for (size_t p = from; p < to; p++) {
+            const unsigned bit = (data[p / 8] >> (7 - (p & 7))) & 1;
+            if (latch == 0) start = p;
+            latch = (latch << 1) | bit;
+            if (latch & 0x80) {
+                out.push_back(static_cast<uint8_t>(latch));
+                latch = 0;
+                start = p + 1;
+            }
+        }
+        return (latch == 0) ? to : start;
+    }
+
+}
@@ -0,0 +1,26 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2025 Mikhail Revzin <p3.141592653589793238462643@gmail.com>
+// Part of the dsk_tools project: https://github.com/Ptr314/dsk_tools
+// Description: Apple II / Agat 140 Kb read channel: nibbles from a raw bitstream (WOZ tracks)
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "definitions.h"
+
+namespace dsk_tools {
+
+    // Bits are numbered MSB first from the start of a buffer.
+    // Copies count bits of src to dst starting at bit dst_pos; dst must be zeroed there
+    void copy_bits(uint8_t * dst, size_t dst_pos, const uint8_t * src, size_t count);
+
+    // Appends the nibbles the disk controller latches from bits [from, to) of data: every nibble
+    // starts at a 1 bit, zeros between nibbles are skipped. Returns the position to continue from.
+    // data must be readable for 8 bytes past bit `to`, 64 bits are taken at once
+    size_t read_nibbles(const uint8_t * data, size_t from, size_t to, BYTES & out);
+
+    // Reference implementation, bit by bit; read_nibbles must produce identical results
+    size_t read_nibbles_scalar(const uint8_t * data, size_t from, size_t to, BYTES & out);
+
+}
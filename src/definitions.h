@@ -124,7 +124,10 @@ namespace dsk_tools {
         PreparePicError,
 
         // Emulator config errors
-        ConfigError
+        ConfigError,
+
+        // Async jobs
+        Cancelled
     };
 
     struct Result {
@@ -316,6 +319,60 @@ namespace dsk_tools {
         uint16_t	track_len;              // Length of the track data in byte.
     };
 
+    // https://applesaucefdc.com/woz/reference2/
+    #define WOZ_BLOCK_SIZE      512
+    #define WOZ_TMAP_SIZE       160             // Quarter tracks of a 5.25" disk
+    #define WOZ1_TRACK_SIZE     6656
+    #define WOZ1_BITS_SIZE      6646
+
+    struct WOZ_HEADER
+    {
+        uint8_t  signature[4];              // "WOZ1" or "WOZ2"
+        uint8_t  high_bit;                  // 0xFF
+        uint8_t  lfcrlf[3];                 // 0x0A 0x0D 0x0A
+        uint32_t crc32;                     // Of the rest of the file, 0 if not calculated
+    };
+
+    struct WOZ_CHUNK_HEADER
+    {
+        uint8_t  id[4];                     // "INFO", "TMAP", "TRKS", "META", ...
+        uint32_t size;                      // Without this header
+    };
+
+    struct WOZ_INFO
+    {
+        uint8_t  version;                   // 1 for WOZ1, 2 or 3 for WOZ2
+        uint8_t  disk_type;                 // 1 = 5.25", 2 = 3.5"
+        uint8_t  write_protected;
+        uint8_t  synchronized;              // Cross track sync was used during imaging
+        uint8_t  cleaned;                   // MC3470 fake bits have been removed
+        uint8_t  creator[32];               // UTF-8, padded with spaces
+        // Version 2
+        uint8_t  disk_sides;
+        uint8_t  boot_sector_format;        // 0 = unknown, 1 = 16 sectors, 2 = 13 sectors, 3 = both
+        uint8_t  optimal_bit_timing;        // In 125 ns increments, 32 = 4 us for 5.25"
+        uint16_t compatible_hardware;
+        uint16_t required_ram;              // Kb
+        uint16_t largest_track;             // Blocks
+    };
+
+    struct WOZ1_TRK                         // Follows the bitstream of WOZ1_BITS_SIZE bytes
+    {
+        uint16_t bytes_used;
+        uint16_t bit_count;
+        uint16_t splice_point;
+        uint8_t  splice_nibble;
+        uint8_t  splice_bit_count;
+        uint16_t reserved;
+    };
+
+    struct WOZ2_TRK
+    {
+        uint16_t starting_block;            // From the start of the file, in blocks of 512 bytes
+        uint16_t block_count;
+        uint32_t bit_count;
+    };
+
     #pragma pack(pop)
 
     // http://forum.agatcomp.ru//viewtopic.php?id=193
@@ -6,47 +6,17 @@
 #include <iostream>
 #include <fstream>
 #include <algorithm>
+#include <cstring>
+#include <map>
 
 #include "dsk_tools/dsk_tools.h"
 #include "host_helpers.h"
+#include "mapped_file.h"
+#include "pattern_scan.h"
+#include "source.h"
 
 namespace dsk_tools {
 
-    static const unsigned char FlipBit1[4] = { 0, 2,  1,  3  };
-    static const unsigned char FlipBit2[4] = { 0, 8,  4,  12 };
-    static const unsigned char FlipBit3[4] = { 0, 32, 16, 48 };
-
-    static const uint8_t m_write_translate_table[64] =
-        {
-            0x96,0x97,0x9A,0x9B,0x9D,0x9E,0x9F,0xA6,
-            0xA7,0xAB,0xAC,0xAD,0xAE,0xAF,0xB2,0xB3,
-            0xB4,0xB5,0xB6,0xB7,0xB9,0xBA,0xBB,0xBC,
-            0xBD,0xBE,0xBF,0xCB,0xCD,0xCE,0xCF,0xD3,
-            0xD6,0xD7,0xD9,0xDA,0xDB,0xDC,0xDD,0xDE,
-            0xDF,0xE5,0xE6,0xE7,0xE9,0xEA,0xEB,0xEC,
-            0xED,0xEE,0xEF,0xF2,0xF3,0xF4,0xF5,0xF6,
-            0xF7,0xF9,0xFA,0xFB,0xFC,0xFD,0xFE,0xFF
-    };
-
-    static const uint8_t m_read_translate_table[] = {
-        0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-        0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-        0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-        0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-        0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-        0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-        0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-        0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-        0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-        0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x01,0x00,0x00,0x02,0x03,0x00,0x04,0x05,0x06,
-        0x00,0x00,0x00,0x00,0x00,0x00,0x07,0x08,0x00,0x00,0x00,0x09,0x0a,0x0b,0x0c,0x0d,
-        0x00,0x00,0x0e,0x0f,0x10,0x11,0x12,0x13,0x00,0x14,0x15,0x16,0x17,0x18,0x19,0x1a,
-        0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x1b,0x00,0x1c,0x1d,0x1e,
-        0x00,0x00,0x00,0x1f,0x00,0x00,0x20,0x21,0x00,0x22,0x23,0x24,0x25,0x26,0x27,0x28,
-        0x00,0x00,0x00,0x00,0x00,0x29,0x2a,0x2b,0x00,0x2c,0x2d,0x2e,0x2f,0x30,0x31,0x32,
-        0x00,0x00,0x33,0x34,0x35,0x36,0x37,0x38,0x00,0x39,0x3a,0x3b,0x3c,0x3d,0x3e,0x3f
-    };
-
     std::unique_ptr<Loader> create_loader(const std::string& file_name, const std::string& format_id, const std::string& type_id)
     {
         if (format_id == "FILE_RAW_MSB") return dsk_tools::make_unique<LoaderRAW>(file_name, format_id, type_id);
@@ -57,12 +27,19 @@ namespace dsk_tools {
         if (format_id == "FILE_HXC_HFE") return dsk_tools::make_unique<LoaderHXC_HFE>(file_name, format_id, type_id);
         if (format_id == "FILE_FIL")     return dsk_tools::make_unique<LoaderFIL>(file_name, format_id, type_id);
         if (format_id == "FILE_IMD")     return dsk_tools::make_unique<LoaderIMD>(file_name, format_id, type_id);
+        if (format_id == "FILE_WOZ")     return dsk_tools::make_unique<LoaderWOZ>(file_name, format_id, type_id);
         return nullptr;
     }
 
-    std::unique_ptr<diskImage> prepare_image(const std::string &file_name, const std::string &format_id, const std::string &type_id, const DiskDefs & diskdefs)
+    std::unique_ptr<Loader> create_loader(std::shared_ptr<Source> source, const std::string& file_name, const std::string& format_id, const std::string& type_id)
     {
         std::unique_ptr<Loader> loader = create_loader(file_name, format_id, type_id);
+        if (loader) loader->set_source(std::move(source));
+        return loader;
+    }
+
+    static std::unique_ptr<diskImage> make_image(std::unique_ptr<Loader> loader, const std::string &type_id, const DiskDefs & diskdefs)
+    {
         if (!loader) return nullptr;
 
         if (type_id == "TYPE_AGAT_140")   return dsk_tools::make_unique<imageAgat140>(std::move(loader));
@@ -118,6 +95,16 @@ namespace dsk_tools {
         return nullptr;
     }
 
+    std::unique_ptr<diskImage> prepare_image(const std::string &file_name, const std::string &format_id, const std::string &type_id, const DiskDefs & diskdefs)
+    {
+        return make_image(create_loader(file_name, format_id, type_id), type_id, diskdefs);
+    }
+
+    std::unique_ptr<diskImage> prepare_image(std::shared_ptr<Source> source, const std::string &file_name, const std::string &format_id, const std::string &type_id, const DiskDefs & diskdefs)
+    {
+        return make_image(create_loader(std::move(source), file_name, format_id, type_id), type_id, diskdefs);
+    }
+
     std::unique_ptr<fileSystem> prepare_filesystem(diskImage * image, const std::string &filesystem_id, const DiskDefs & diskdefs)
     {
         if (filesystem_id == "FILESYSTEM_DOS33") {
@@ -148,63 +135,18 @@ namespace dsk_tools {
 
     BYTES decode44(const BYTES & buffer)
     {
-        BYTES result;
-        for (int i=0; i<buffer.size()/2; i++) {
-            uint8_t b1 = buffer[i*2]   & 0x55;
-            uint8_t b2 = buffer[i*2+1] & 0x55;
-            result.push_back((b1 << 1) | b2);
-        }
-
+        BYTES result(buffer.size()/2);
+        decode44(buffer.data(), result.data(), result.size());
         return result;
     }
 
-    void encode_gcr62(const uint8_t data_in[], uint8_t * data_out)
-    {
-
-        // First 86 bytes are combined lower 2 bits of input data
-        for (int i = 0; i < 86; i++) {
-            data_out[i] = FlipBit1[data_in[i]&3] | FlipBit2[data_in[i+86]&3] | FlipBit3[data_in[(i+172) & 0xFF]&3];
-                // ^^ 2 extra bytes are wrapped to the beginning
-        }
-
-        // Next 256 bytes are upper 6 bits
-        for (int i = 0; i < 256; i++) {
-            data_out[i+86] = data_in[i] >> 2;
-        }
-
-        // Then, encode 6 bits to 8 bits using a table and calculate a crc
-        uint8_t crc = 0;
-        for (int i = 0; i < 342; i++) {
-            uint8_t v = data_out[i];
-            data_out[i] = m_write_translate_table[v ^ crc];
-            crc = v;
-        }
-
-        // And finally add a crc byte
-        data_out[342] = m_write_translate_table[crc];
-    }
-
-    bool decode_gcr62(const uint8_t data_in[], uint8_t * data_out)
+    void decode44(const uint8_t * in, uint8_t * out, int count)
     {
-        uint8_t crc = 0;
-
-        for (int i=0; i<86; i++) {
-            uint8_t x = (crc^m_read_translate_table[data_in[i]]) & 0x3f;
-            if (i+172 < 256)
-                data_out[i+172] = FlipBit1[(x>>4) & 3];
-            data_out[i+86] =  FlipBit1[(x>>2) & 3];
-            data_out[i] =     FlipBit1[ x     & 3];
-            crc = x;
-        }
-        for (int i=0; i<256; i++) {
-            uint8_t x = (crc^m_read_translate_table[data_in[i+86]]) & 0x3f;
-            data_out[i] |=  x << 2 ;
-            crc = x;
+        for (int i=0; i<count; i++) {
+            uint8_t b1 = in[i*2]   & 0x55;
+            uint8_t b2 = in[i*2+1] & 0x55;
+            out[i] = (b1 << 1) | b2;
         }
-
-        uint8_t r_crc = m_read_translate_table[data_in[342]];
-
-        return crc == r_crc;
     }
 
     uint16_t encode_agat_MFM_byte(uint8_t data, uint8_t & last_byte)
@@ -225,73 +167,199 @@ namespace dsk_tools {
 
     void encode_agat_mfm_array(BYTES &out, uint8_t data, uint16_t count, uint8_t & last_byte)
     {
-        uint16_t mfm_word;
-        for (int i=0; i<count; i++) {
-            mfm_word = encode_agat_MFM_byte(data, last_byte);
-            out.push_back(mfm_word & 0xFF);
-            out.push_back((mfm_word >> 8) & 0xFF);
-        }
+        const size_t base = out.size();
+        out.resize(base + count*2);
+        for (int i=0; i<count; i++)
+            encode_agat_mfm(&data, out.data() + base + i*2, 1, last_byte);
     }
 
     uint8_t encode_agat_mfm_data(BYTES &out, uint8_t * data, uint16_t count, uint8_t & last_byte)
     {
-        uint16_t mfm_word;
-        uint16_t crc = 0;
-        for (int i=0; i<count; i++) {
-            mfm_word = encode_agat_MFM_byte(data[i], last_byte);
-            out.push_back(mfm_word & 0xFF);
-            out.push_back((mfm_word >> 8) & 0xFF);
-            if (crc > 0xFF) crc = (crc + 1) & 0xFF;
-            crc += data[i];
-        }
-        return crc & 0xFF;
+        const size_t base = out.size();
+        out.resize(base + count*2);
+        encode_agat_mfm(data, out.data() + base, count, last_byte);
+        return agat_840_checksum(data, count);
     }
 
     void decode_agat_mfm_data(BYTES & out, const BYTES & in) {
-        out.clear();
+        out.resize(in.size() / 2);
+        decode_agat_mfm(in.data(), out.data(), out.size());
+    }
 
-        // Ensure input size is even and sufficient for decoding
-        if (in.size() < 2) {
-            return;
+    // Sectors of an image by their index in the sector buffer, for the detection:
+    // raw images are read in place, other containers decode only the tracks holding the requested sectors
+    class SectorProbe
+    {
+    public:
+        SectorProbe(const std::shared_ptr<Source> & source, const std::string & file_name, const std::string & format_id, const std::string & type_id):
+              m_source(source)
+            , m_file_name(file_name)
+            , m_raw(format_id == "FILE_RAW_MSB")
+            , m_track_size(0)
+        {
+            if (!m_raw) m_loader = create_loader(source, file_name, format_id, type_id);
         }
 
-        for (size_t i = 0; i < in.size() / 2; i++)
+        Result open()
         {
-            // Bounds check: ensure we can read two bytes
-            if (i * 2 + 1 >= in.size()) {
-                break;
+            if (m_raw) return m_source ? m_file.open(m_source) : m_file.open(m_file_name);
+            if (!m_loader) return Result::error(ErrorCode::DetectError, "Unknown file format");
+
+            size_t buffer_size;
+            Result res = m_loader->open_lazy(buffer_size, m_track_size);
+            if (!res) return res;
+            if (m_track_size == 0) return Result::error(ErrorCode::DetectError, "Invalid track size");
+            m_buffer.reset(new uint8_t[buffer_size]);                   // Not initialized: untouched tracks cost nothing
+            m_tracks.assign(buffer_size / m_track_size, TRACK_NOT_LOADED);
+            return Result::ok();
+        }
+
+        // nullptr if the sector is out of the image or can't be decoded
+        const uint8_t * sector(size_t index)
+        {
+            const size_t offset = index * 256;
+            if (m_raw) {
+                BYTES & data = m_sectors[index];
+                if (data.empty()) {
+                    data.resize(256);
+                    if (!m_file.read_at(offset, data.data(), data.size())) {
+                        m_sectors.erase(index);
+                        return nullptr;
+                    }
+                }
+                return data.data();
             }
+            const size_t track = offset / m_track_size;
+            if (track >= m_tracks.size()) return nullptr;
+            if (m_tracks[track] == TRACK_NOT_LOADED)
+                m_tracks[track] = m_loader->load_track(static_cast<int>(track), m_buffer.get()) ? TRACK_LOADED : TRACK_FAILED;
+            return (m_tracks[track] == TRACK_LOADED) ? m_buffer.get() + offset : nullptr;
+        }
 
-            uint8_t b1 = in[i*2];
-            uint8_t b2 = in[i*2+1];
+    private:
+        enum TrackState : uint8_t {TRACK_NOT_LOADED, TRACK_LOADED, TRACK_FAILED};
+
+        std::shared_ptr<Source> m_source;
+        std::string m_file_name;
+        bool m_raw;
+        FileReader m_file;
+        std::map<size_t, BYTES> m_sectors;
+        std::unique_ptr<Loader> m_loader;
+        size_t m_track_size;
+        std::unique_ptr<uint8_t[]> m_buffer;
+        std::vector<uint8_t> m_tracks;
+    };
 
-            // Bounds check: ensure indices into decode table are valid (table size is 256)
-            uint8_t idx1 = b1 >> 1;
-            uint8_t idx2 = b2 >> 1;
+    // Confidence of the evidence found, 0..100
+    static const int CONFIDENCE_SPRITE_OS = 95;             // Boot sector signature
+    static const int CONFIDENCE_CPM_SIGNATURE = 90;         // "MICROSOFT" in the boot sector
+    static const int CONFIDENCE_CPM_EXTENSION = 85;
+    static const int CONFIDENCE_VTOC = 80;                  // fsDOS33::open() accepts the VTOC
+    static const int CONFIDENCE_CPM_DIRECTORY = 60;         // The first directory sector looks like one
+    static const int CONFIDENCE_BOOT_SECTOR = 40;           // Boot signature only
+    static const int CONFIDENCE_BY_SIZE = 50;               // Format and filesystem follow from the size or extension
+    static const int CONFIDENCE_FALLBACK = 10;
+
+    // The same fields fsDOS33::open() checks: a disk it opens is never taken for another filesystem
+    // by the weaker evidence ranked below
+    static bool valid_vtoc(const uint8_t * data, unsigned sectors)
+    {
+        const Agat_VTOC * VTOC = reinterpret_cast<const Agat_VTOC *>(data);
+        return VTOC->sectors_on_track == sectors
+               && VTOC->bytes_per_sector == 256;
+    }
 
-            uint8_t b = (agat_MFM_decode_tab[idx1] << 4) | agat_MFM_decode_tab[idx2];
-            out.push_back(b);
+    // Every entry is either free or has a user number and a printable name
+    static bool valid_cpm_directory(const uint8_t * data)
+    {
+        const CPM_DIR_ENTRY * entries = reinterpret_cast<const CPM_DIR_ENTRY *>(data);
+        for (size_t i = 0; i < 256 / sizeof(CPM_DIR_ENTRY); i++) {
+            const CPM_DIR_ENTRY & e = entries[i];
+            if (e.ST == 0xE5) continue;
+            if (e.ST > 0x1F) return false;
+            for (const uint8_t c : e.F)
+                if ((c & 0x7F) < 0x20 || (c & 0x7F) > 0x7E) return false;
+            for (const uint8_t c : e.E)
+                if ((c & 0x7F) < 0x20 || (c & 0x7F) > 0x7E) return false;
         }
+        return true;
+    }
+
+    static void add_candidate(DetectCandidates & candidates, const std::string & format_id, const std::string & type_id, const std::string & filesystem_id, int confidence)
+    {
+        for (auto & c : candidates)
+            if (c.filesystem_id == filesystem_id) {
+                c.confidence = std::max(c.confidence, confidence);
+                return;
+            }
+        candidates.push_back({format_id, type_id, filesystem_id, confidence});
     }
 
+    // Agat filesystems by the boot sector, the VTOC and the first CP/M directory sector
+    static Result probe_agat_filesystems(const std::shared_ptr<Source> & source, const std::string & file_name, const std::string & format_id, const std::string & type_id, DetectCandidates & candidates)
+    {
+        const std::string ext = get_file_ext(file_name);
+        const bool agat_140 = (type_id == "TYPE_AGAT_140");
+        const bool raw = (format_id == "FILE_RAW_MSB");
+        const unsigned sectors = agat_140 ? 16 : 21;
+
+        SectorProbe probe(source, file_name, format_id, type_id);
+        Result res = probe.open();
+        if (!res) return Result::error(ErrorCode::DetectError, "Failed to open the image: " + res.message);
+
+        const uint8_t * boot = probe.sector(0);
+        if (boot == nullptr) return Result::error(ErrorCode::DetectError, "Failed to read the boot sector");
+
+        if (boot[0] == 0x01 && boot[2] == 0x58)
+            add_candidate(candidates, format_id, type_id, "FILESYSTEM_SPRITE_OS", CONFIDENCE_SPRITE_OS);
+
+        if (agat_140) {
+            const std::string cpm_id = (raw && ext == ".po") ? "FILESYSTEM_CPM_PRODOS" : "FILESYSTEM_CPM_DOS";
+            if (std::memcmp(boot + 0x74, "MICROSOFT", 9) == 0)
+                add_candidate(candidates, format_id, type_id, cpm_id, CONFIDENCE_CPM_SIGNATURE);
+            if (raw && ext == ".cpm")
+                add_candidate(candidates, format_id, type_id, "FILESYSTEM_CPM_RAW", CONFIDENCE_CPM_EXTENSION);
+            // The directory starts at track 3, its first sector is 0 in any sector order
+            const uint8_t * dir = probe.sector(3 * sectors);
+            if (dir != nullptr && valid_cpm_directory(dir))
+                add_candidate(candidates, format_id, type_id, cpm_id, CONFIDENCE_CPM_DIRECTORY);
+        }
 
-    Result detect_fdd_type(const std::string &file_name, std::string &format_id, std::string &type_id, std::string &filesystem_id, bool format_only)
+        const uint8_t * vtoc = probe.sector(17 * sectors);
+        if (vtoc != nullptr && valid_vtoc(vtoc, sectors))
+            add_candidate(candidates, format_id, type_id, "FILESYSTEM_DOS33", CONFIDENCE_VTOC);
+        if (boot[0] == 0x01)
+            add_candidate(candidates, format_id, type_id, "FILESYSTEM_DOS33", CONFIDENCE_BOOT_SECTOR);
+        // Raw images were always taken for DOS 3.3 unless something else is found
+        if (raw)
+            add_candidate(candidates, format_id, type_id, "FILESYSTEM_DOS33", CONFIDENCE_FALLBACK);
+
+        if (candidates.empty())
+            return Result::error(ErrorCode::DetectError, "Invalid filesystem signature");
+
+        std::stable_sort(candidates.begin(), candidates.end(),
+                         [](const DetectCandidate & a, const DetectCandidate & b) {return a.confidence > b.confidence;});
+        return Result::ok();
+    }
+
+    // Format and disk type by the extension, size and header; filesystem_id is set
+    // where it follows from them, Agat images are left for probe_agat_filesystems()
+    static Result detect_container(const std::shared_ptr<Source> & source, const std::string &file_name, std::string &format_id, std::string &type_id, std::string &filesystem_id, bool format_only)
     {
         std::string ext = get_file_ext(file_name);
 
-        std::unique_ptr<UTF8_ifstream> file = nullptr;
-        unsigned fsize = 0;
+        FileReader file;
+        uint64_t fsize = 0;
 
-        if (!format_only) {
-            file = make_unique<UTF8_ifstream>(file_name, std::ios::binary);
+        type_id = "";
+        filesystem_id = "";
 
-            if (!file->good()) {
+        if (!format_only) {
+            Result res = source ? file.open(source) : file.open(file_name);
+            if (!res) {
                 return Result::error(ErrorCode::LoadError, "Cannot open file");
             }
-
-            file->seekg (0, std::ios::end);
-            fsize = file->tellg();
-            file->seekg (0, std::ios::beg);
+            fsize = file.size();
         }
 
         // format_if
@@ -311,11 +379,7 @@ namespace dsk_tools {
         if (ext == ".dsk" || ext == ".do" || ext == ".po" || ext == ".cpm" || ext == ".gmd") {
             format_id = "FILE_RAW_MSB";
 
-            if (format_only) {
-                type_id = "";
-                filesystem_id = "";
-                return Result::ok();
-            }
+            if (format_only) return Result::ok();
 
             // type_id
             if (fsize == 143360 || fsize == 143360+128) {
@@ -326,72 +390,25 @@ namespace dsk_tools {
             } else
             if (fsize == 512*9*40*2) {
                 type_id = "TYPE_CPM:IRISHA-360-INT";
+                filesystem_id = "FILESYSTEM_CPM_RAW";
             } else
             if (fsize == 128*26*77) {
                 type_id = "TYPE_CPM:GMD-7012";
-            } else
-                return Result::error(ErrorCode::DetectError, "Invalid file size for DSK format");
-
-            // filesystem_id
-            if (type_id == "TYPE_AGAT_140" || type_id == "TYPE_AGAT_840") {
-                BYTES buffer(256);
-                file->read (reinterpret_cast<char*>(buffer.data()), buffer.size());
-                std::string ms = "MICROSOFT";
-                std::string _ms(buffer.begin() + 0x74, buffer.begin() + 0x74 + ms.size());
-
-                uint32_t vtoc_pos;
-                if (type_id == "TYPE_AGAT_140") vtoc_pos=17*16*256;
-                else
-                if (type_id == "TYPE_AGAT_840") vtoc_pos=17*21*256;
-
-                Agat_VTOC VTOC;
-                file->seekg (vtoc_pos, std::ios::beg);
-                file->read (reinterpret_cast<char*>(&VTOC), sizeof(Agat_VTOC));
-
-                if (buffer[0] == 0x01 && buffer[2] == 0x58) {
-                    filesystem_id = "FILESYSTEM_SPRITE_OS";
-                } else
-                if (type_id == "TYPE_AGAT_140" && _ms == ms) {
-                    if (ext == ".po")
-                        filesystem_id = "FILESYSTEM_CPM_PRODOS";
-                    else
-                        filesystem_id = "FILESYSTEM_CPM_DOS";
-                } else
-                if (type_id == "TYPE_AGAT_140" && ext == ".cpm") {
-                    filesystem_id = "FILESYSTEM_CPM_RAW";
-                } else
-                    filesystem_id = "FILESYSTEM_DOS33";
-            } else
-            if (type_id == "TYPE_CPM:IRISHA-360-INT" || type_id == "TYPE_CPM:IRISHA-360-SEQ") {
                 filesystem_id = "FILESYSTEM_CPM_RAW";
             } else
-            if (type_id == "TYPE_CPM:GMD-7012") {
-                filesystem_id = "FILESYSTEM_CPM_RAW";
-            }
+                return Result::error(ErrorCode::DetectError, "Invalid file size for DSK format");
         } else
         if (ext == ".aim") {
             format_id = "FILE_AIM";
-
             type_id = "TYPE_AGAT_840";
-
-            if (format_only) {
-                filesystem_id = "";
-                return Result::ok();
-            }
-
-            dsk_tools::LoaderAIM loader(file_name, format_id, type_id);
-            BYTES buffer;
-            Result res = loader.load(buffer);
-            if (res && buffer[0] == 0x01) {
-                if (buffer[2] == 0x58) {
-                    filesystem_id = "FILESYSTEM_SPRITE_OS";
-                } else {
-                    filesystem_id = "FILESYSTEM_DOS33";
-                }
-            } else
-                return Result::error(ErrorCode::DetectError, "Failed to load AIM file");
         } else
         if (ext == ".nic" || ext == ".nib" || ext == ".mfm") {
+            if (ext == ".nic") format_id = "FILE_MFM_NIC";
+            if (ext == ".nib") format_id = "FILE_MFM_NIB";
+            if (ext == ".mfm") format_id = "FILE_HXC_MFM";
+
+            if (format_only) return Result::ok();
+
             if (ext == ".nib") {
                 if (fsize == 232960)
                     type_id = "TYPE_AGAT_140";
@@ -402,93 +419,33 @@ namespace dsk_tools {
                     return Result::error(ErrorCode::DetectError, "Invalid file size for NIB format");
             } else
                 type_id = "TYPE_AGAT_140";
-
-            BYTES buffer;
-            Result res;
-            if (ext == ".nic") {
-                format_id = "FILE_MFM_NIC";
-                if (format_only) {
-                    filesystem_id = "";
-                    return Result::ok();
-                }
-                LoaderNIC loader(file_name, format_id, type_id);
-                res = loader.load(buffer);
-            } else
-            if (ext == ".nib") {
-                format_id = "FILE_MFM_NIB";
-                if (format_only) {
-                    filesystem_id = "";
-                    return Result::ok();
-                }
-                LoaderNIB loader(file_name, format_id, type_id);
-                res = loader.load(buffer);
-            } else
-            if (ext == ".mfm") {
-                format_id = "FILE_HXC_MFM";
-                if (format_only) {
-                    filesystem_id = "";
-                    return Result::ok();
-                }
-                LoaderHXC_MFM loader(file_name, format_id, type_id);
-                res = loader.load(buffer);
-            } else
-                return Result::error(ErrorCode::DetectError, "Unknown MFM format");
-
-            if (!res) return Result::error(ErrorCode::DetectError, "Failed to load MFM file");
-
-            if (format_only) {
-                filesystem_id = "";
-                return Result::ok();
-            }
-
-            if (buffer[0] == 0x01) {
-                std::string ms = "MICROSOFT";
-                std::string _ms(buffer.begin() + 0x74, buffer.begin() + 0x74 + ms.size());
-
-                if (buffer[2] == 0x58) {
-                    filesystem_id = "FILESYSTEM_SPRITE_OS";
-                } else
-                if (type_id == "TYPE_AGAT_140" && _ms == ms) {
-                    filesystem_id = "FILESYSTEM_CPM_DOS";
-                } else {
-                    filesystem_id = "FILESYSTEM_DOS33";
-                }
-            } else
-                return Result::error(ErrorCode::DetectError, "Invalid filesystem signature");
         } else
         if (ext == ".hfe") {
             format_id = "FILE_HXC_HFE";
 
-            if (format_only) {
-                type_id = "";
-                filesystem_id = "";
-                return Result::ok();
-            }
-
-            UTF8_ifstream file(file_name, std::ios::binary);
+            if (format_only) return Result::ok();
 
-            if (!file.good()) {
+            HXC_HFE_HEADER hdr;
+            if (!file.read_at(0, reinterpret_cast<uint8_t*>(&hdr), sizeof(hdr))) {
                 return Result::error(ErrorCode::LoadError, "Cannot open HFE file");
             }
 
-            BYTES hdr_buffer(sizeof(HXC_HFE_HEADER));
-            file.read (reinterpret_cast<char*>(hdr_buffer.data()), hdr_buffer.size());
-            HXC_HFE_HEADER * hdr = reinterpret_cast<HXC_HFE_HEADER*>(hdr_buffer.data());
-
-            if (hdr->number_of_side == 2 && hdr->number_of_track == 80) {
+            if (hdr.number_of_side == 2 && hdr.number_of_track == 80)
                 type_id = "TYPE_AGAT_840";
-                BYTES buffer(sizeof(HXC_HFE_HEADER));
-                LoaderHXC_HFE loader(file_name, format_id, type_id);
-                Result res = loader.load(buffer);
-                if (res && buffer[0] == 0x01) {
-                    if (buffer[2] == 0x58) {
-                        filesystem_id = "FILESYSTEM_SPRITE_OS";
-                    } else {
-                        filesystem_id = "FILESYSTEM_DOS33";
-                    }
-                } else
-                    return Result::error(ErrorCode::DetectError, "Invalid HFE file format");
+        } else
+        if (ext == ".woz") {
+            format_id = "FILE_WOZ";
+
+            if (format_only) return Result::ok();
+
+            WOZ_HEADER hdr;
+            if (!file.read_at(0, reinterpret_cast<uint8_t*>(&hdr), sizeof(hdr))) {
+                return Result::error(ErrorCode::LoadError, "Cannot open WOZ file");
             }
+
+            if (std::memcmp(hdr.signature, "WOZ1", 4) != 0 && std::memcmp(hdr.signature, "WOZ2", 4) != 0)
+                return Result::error(ErrorCode::DetectError, "Invalid WOZ signature");
+            type_id = "TYPE_AGAT_140";
         } else
         if (ext == ".fil") {
             format_id = "FILE_FIL";
@@ -498,11 +455,7 @@ namespace dsk_tools {
         if (ext == ".imd") {
             format_id = "FILE_IMD";
 
-            if (format_only) {
-                type_id = "";
-                filesystem_id = "";
-                return Result::ok();
-            }
+            if (format_only) return Result::ok();
 
             // TODO: make detection using contents
             type_id = "TYPE_CPM:IRISHA-360-INT";
@@ -513,6 +466,60 @@ namespace dsk_tools {
         return Result::ok();
     }
 
+    Result probe_fdd_type(std::shared_ptr<Source> source, const std::string &file_name, DetectCandidates & candidates)
+    {
+        candidates.clear();
+
+        std::string format_id, type_id, filesystem_id;
+        Result res = detect_container(source, file_name, format_id, type_id, filesystem_id, false);
+        if (!res) return res;
+
+        if (type_id == "TYPE_AGAT_140" || type_id == "TYPE_AGAT_840")
+            return probe_agat_filesystems(source, file_name, format_id, type_id, candidates);
+
+        // Nothing to look for inside, i.e. HFE images of other geometries have no type at all
+        candidates.push_back({format_id, type_id, filesystem_id, filesystem_id.empty() ? 0 : CONFIDENCE_BY_SIZE});
+        return Result::ok();
+    }
+
+    Result probe_fdd_type(const std::string &file_name, DetectCandidates & candidates)
+    {
+        return probe_fdd_type(nullptr, file_name, candidates);
+    }
+
+    Result detect_fdd_type(std::shared_ptr<Source> source, const std::string &file_name, std::string &format_id, std::string &type_id, std::string &filesystem_id)
+    {
+        DetectCandidates candidates;
+        Result res = probe_fdd_type(std::move(source), file_name, candidates);
+        if (!res) return res;
+
+        const DetectCandidate & best = candidates.front();
+        format_id = best.format_id;
+        type_id = best.type_id;
+        filesystem_id = best.filesystem_id;
+        return Result::ok();
+    }
+
+    Result detect_fdd_type(const std::string &file_name, std::string &format_id, std::string &type_id, std::string &filesystem_id, bool format_only)
+    {
+        if (format_only)
+            return detect_container(nullptr, file_name, format_id, type_id, filesystem_id, true);
+        return detect_fdd_type(nullptr, file_name, format_id, type_id, filesystem_id);
+    }
+
+    Result verify_image(const std::string &file_name, VerifyReport & report)
+    {
+        std::string format_id, type_id, filesystem_id;
+        Result res = detect_container(nullptr, file_name, format_id, type_id, filesystem_id, false);
+        if (!res) return res;
+        if (type_id != "TYPE_AGAT_140" && type_id != "TYPE_AGAT_840")
+            return Result::error(ErrorCode::NotImplementedYet, "Format has no checksums");
+
+        std::unique_ptr<Loader> loader = create_loader(file_name, format_id, type_id);
+        if (!loader) return Result::error(ErrorCode::NotImplementedYet, "Format has no checksums");
+        return loader->verify(report);
+    }
+
     std::string agat_vtoc_info(const Agat_VTOC & VTOC)
     {
         std::string result = "";
@@ -680,73 +687,77 @@ namespace dsk_tools {
     Result decode_agat_840_track(BYTES &out, const BYTES & in)
     {
         out.resize(21*256);
-        int track_len = in.size();
+        return decode_agat_840_track(out.data(), in.data(), in.size());
+    }
+
+    Result decode_agat_840_track(uint8_t * out, const uint8_t * in, int track_len, TrackScan * scan)
+    {
         int in_p = 0;
+        int field_end = 0;
         bool errors = false;
+        if (scan != nullptr) scan->reset();
         while (in_p < track_len) {
             // Looking for Index Mark
-            bool index_found = false;
-            while (in_p < track_len) {
-                if (!iterate_until(in, in_p, 0x95)) break;
-                if (in_p < track_len) {
-                    uint8_t b1 = in.at(in_p++);
-                    if (b1 == 0x6A) {index_found = true; break;};
-                }
-            }
+            bool index_found = skip_past(in, track_len, in_p, agat_840_address_mark, sizeof(agat_840_address_mark));
             if (index_found) {
-                uint8_t r_v = in.at(in_p++);
-                uint8_t r_t = in.at(in_p++);
-                uint8_t r_s = in.at(in_p++);
+                SectorScan field = SectorScan();
+                field.index_pos = in_p - sizeof(agat_840_address_mark);
+                field.gap_before = field.index_pos - field_end;
+                field.data_pos = -1;
+
+                // VTS + index end mark
+                if (in_p + 4 > track_len) {
+                    errors = true;
+                    if (scan != nullptr) scan->sectors.push_back(field);
+                    break;
+                }
+                field.index_complete = true;
+                field.volume = in[in_p++];
+                field.track = in[in_p++];
+                field.sector = in[in_p++];
                 // Index end mark
-                uint8_t ie = in.at(in_p++);
-                if (ie != 0x5A) errors = true;
+                field.index_epilogue_ok = in[in_p++] == 0x5A;
+                if (!field.index_epilogue_ok) errors = true;
+                field_end = in_p;
 
                 // Data mark
-                bool data_found = false;
-                while (in_p < track_len) {
-                    if (!iterate_until(in, in_p, 0x6A)) break;
-                    if (in_p < track_len) {
-                        uint8_t b1 = in.at(in_p++);
-                        if (b1 == 0x95) {data_found = true; break;};
-                    }
-                }
+                bool data_found = skip_past(in, track_len, in_p, agat_840_data_mark, sizeof(agat_840_data_mark));
                 if (data_found) {
-                    // Data
-                    bool error = false;
-                    uint16_t crc = 0;
-                    int data_p = in_p;
+                    field.data_pos = in_p - sizeof(agat_840_data_mark);
+                    field.gap_index_data = field.data_pos - field_end;
+                    field.preview_size = static_cast<uint8_t>(std::min<int>(sizeof(field.preview), track_len - in_p));
+                    std::memcpy(field.preview, in + in_p, field.preview_size);
 
-                    for (int i=0; i<256; i++) {
-                        if (in_p >= track_len) {error = true; break;};
-                        uint8_t  d = in.at(in_p++);
-                        if (crc > 0xFF) crc = (crc + 1) & 0xFF;
-                        crc += d;
+                    // Data + crc + data end mark
+                    if (in_p + 256 + 2 > track_len) {
+                        errors = true;
+                        if (scan != nullptr) scan->sectors.push_back(field);
+                        break;
                     }
-                    crc &= 0xFF;
-                    if (!error) {
-                        uint8_t r_crc = in.at(in_p++);
-                        if (r_crc != crc) errors = true;
-
-                        if (r_s < 21) {
-                            int offset = r_s * 256;
-                            std::copy(
-                                in.begin() + data_p,
-                                in.begin() + data_p + 256,
-                                out.begin() + offset
-                            );
-                        }
+                    field.data_complete = true;
+                    int data_p = in_p;
+                    field.data_crc_expected = agat_840_checksum(in + in_p, 256);
+                    in_p += 256;
+                    field.data_crc = in[in_p++];
+                    field.data_crc_ok = field.data_crc == field.data_crc_expected;
+                    if (!field.data_crc_ok) errors = true;
 
-                        // Data end mark
-                        uint8_t de = in.at(in_p++);
-                        if (de != 0x5A) errors = true;
+                    if (out != nullptr && field.sector < 21)
+                        std::memcpy(out + field.sector * 256, in + data_p, 256);
 
-                    } else {
-                        errors = true;
-                    }
+                    // Data end mark
+                    field.data_epilogue_ok = in[in_p++] == 0x5A;
+                    if (!field.data_epilogue_ok) errors = true;
+                    field_end = in_p;
                 }
+                if (scan != nullptr) scan->sectors.push_back(field);
             }
         }
 
+        if (scan != nullptr) {
+            scan->scanned = true;
+            scan->errors = errors;
+        }
         if (!errors) {
             return Result::ok();
         } else {
@@ -760,86 +771,98 @@ namespace dsk_tools {
         int encoded_track_size = in.size() / 160;
         int raw_track_size = 21*256;
         for (int i=0; i<160; i++) {
-            BYTES track_in(in.begin() + i*encoded_track_size, in.begin() + (i+1)*encoded_track_size);
-            BYTES track_out;
-            Result res = decode_agat_840_track(track_out, track_in);
+            Result res = decode_agat_840_track(out.data() + i*raw_track_size, in.data() + i*encoded_track_size, encoded_track_size);
             if (!res) return Result::error(ErrorCode::LoadDataCorrupt, "Failed to decode Agat 840 track");
-            if (track_out.size() == raw_track_size) {
-                std::copy(
-                    track_out.begin(),
-                    track_out.end(),
-                    out.begin() + i*raw_track_size
-                );
-            } else  return Result::error(ErrorCode::LoadDataCorrupt, "Decoded track size mismatch");
         };
         return Result::ok();
     }
 
     Result load_agat140_track(int track, BYTES & buffer, const BYTES & in, int track_len)
+    {
+        return load_agat140_track(track, buffer.data(), in.data(), track_len);
+    }
+
+    Result load_agat140_track(int track, uint8_t * buffer, const uint8_t * in, int track_len, TrackScan * scan)
     {
         int in_p = 0;
+        int field_end = 0;
         bool errors = false;
+        uint8_t scratch[256];                                   // Sectors outside of the image are only checked
+        if (scan != nullptr) scan->reset();
         while (in_p < track_len) {
             // Looking for Index Mark
-            bool index_found = false;
-            while (in_p < track_len) {
-                if (!iterate_until(in, in_p, 0xD5)) break;
-                if (in_p < track_len) {
-                    uint8_t b1 = in.at(in_p++);
-                    uint8_t b2 = in.at(in_p++);
-                    if (b1 == 0xAA && b2 == 0x96) {index_found = true; break;};
-                }
+            if (!skip_past(in, track_len, in_p, agat_140_address_prologue, sizeof(agat_140_address_prologue))) break;
+
+            SectorScan field = SectorScan();
+            field.index_pos = in_p - sizeof(agat_140_address_prologue);
+            field.gap_before = field.index_pos - field_end;
+            field.data_pos = -1;
+
+            // Address field + index end mark
+            if (in_p + 8 + 3 > track_len) {
+                errors = true;
+                if (scan != nullptr) scan->sectors.push_back(field);
+                break;
             }
-            if (index_found) {
-                BYTES ind_coded(in.begin() + in_p, in.begin() + in_p + 8);
-                in_p += 8;
-                BYTES ind = dsk_tools::decode44(ind_coded);
-                uint8_t r_v = ind.at(0);
-                uint8_t r_t = ind.at(1);
-                uint8_t r_s = ind.at(2);
-                uint8_t r_crc = ind.at(3);
-                uint8_t expected_crc = static_cast<uint8_t>(r_v ^ r_t ^ r_s);
-                if (r_crc != expected_crc || r_t != track) {
+            field.index_complete = true;
+            uint8_t ind[4];
+            decode44(in + in_p, ind, 4);
+            in_p += 8;
+            field.volume = ind[0];
+            field.track = ind[1];
+            field.sector = ind[2];
+            field.index_crc = ind[3];
+            field.index_crc_expected = static_cast<uint8_t>(ind[0] ^ ind[1] ^ ind[2]);
+            if (!field.index_crc_ok() || field.track != track) {
+                errors = true;
+            }
+            // Index end mark
+            field.index_epilogue_ok = std::memcmp(in + in_p, agat_140_epilogue, sizeof(agat_140_epilogue)) == 0;
+            if (!field.index_epilogue_ok) {
+                errors = true;
+            }
+            in_p += 3;
+            field_end = in_p;
+
+            // Data mark
+            bool data_found = skip_past(in, track_len, in_p, agat_140_data_prologue, sizeof(agat_140_data_prologue));
+            if (data_found) {
+                field.data_pos = in_p - sizeof(agat_140_data_prologue);
+                field.gap_index_data = field.data_pos - field_end;
+
+                // Data + data end mark
+                if (in_p + GCR62_ENCODED_SIZE + 3 > track_len) {
                     errors = true;
+                    if (scan != nullptr) scan->sectors.push_back(field);
+                    break;
                 }
-                // Index end mark
-                BYTES ie(in.begin()+in_p, in.begin()+in_p + 3); in_p += 3;
-                if (ie.at(0) != 0xDE || ie.at(1) != 0xAA || ie.at(2) != 0xEB) {
+                field.data_complete = true;
+                if (buffer != nullptr) {
+                    uint8_t * data = (field.sector < 16) ? buffer + (track*16 + agat_140_raw2logic[field.sector])*256 : scratch;
+                    field.data_crc_ok = decode_gcr62(in + in_p, data);
+                    field.preview_size = sizeof(field.preview);
+                    std::memcpy(field.preview, data, sizeof(field.preview));
+                } else
+                    field.data_crc_ok = check_gcr62(in + in_p);
+                in_p += GCR62_ENCODED_SIZE;
+                if (!field.data_crc_ok) {
                     errors = true;
                 }
-
-                // Data mark
-                bool data_found = false;
-                while (in_p < track_len) {
-                    if (!iterate_until(in, in_p, 0xD5)) break;
-                    if (in_p < track_len) {
-                        uint8_t b1 = in.at(in_p++);
-                        uint8_t b2 = in.at(in_p++);
-                        if (b1 == 0xAA && b2 == 0xAD) {data_found = true; break;};
-                    }
-                };
-                if (data_found) {
-                    // Data
-                    BYTES encoded_sector(in.begin()+ in_p, in.begin()+ in_p + 343);
-                    in_p += 343;
-                    BYTES data(256);
-                    bool crc_ok = decode_gcr62(encoded_sector.data(), data.data());
-                    if (!crc_ok) {
-                        errors = true;
-                    }
-                    // Data end mark
-                    BYTES de(in.begin()+in_p, in.begin()+in_p + 3); in_p += 3;
-                    if (de.at(0) != 0xDE || de.at(1) != 0xAA || de.at(2) != 0xEB) {
-                        errors = true;
-                    }
-                    if (r_s < 16) {
-                        int t_s = agat_140_raw2logic[r_s];
-                        std::copy(data.begin(), data.end(), buffer.begin() + (track*16 + t_s)*256);
-                    }
+                // Data end mark
+                field.data_epilogue_ok = std::memcmp(in + in_p, agat_140_epilogue, sizeof(agat_140_epilogue)) == 0;
+                if (!field.data_epilogue_ok) {
+                    errors = true;
                 }
+                in_p += 3;
+                field_end = in_p;
             }
+            if (scan != nullptr) scan->sectors.push_back(field);
         }
 
+        if (scan != nullptr) {
+            scan->scanned = true;
+            scan->errors = errors;
+        }
         if (!errors) {
             return Result::ok();
         } else {
@@ -852,8 +875,7 @@ namespace dsk_tools {
     {
         out.resize(35*16*256);
         for (int i=0; i<35; i++) {
-            BYTES track_in(in.begin() + i*track_len, in.begin() + (i+1)*track_len);
-            Result res = load_agat140_track(i, out, track_in, track_len);
+            Result res = load_agat140_track(i, out.data(), in.data() + i*track_len, track_len);
             if (!res) return Result::error(ErrorCode::LoadDataCorrupt, "Failed to decode Agat 140 track");
         };
         return Result::ok();
@@ -894,6 +916,7 @@ namespace dsk_tools {
            return make_unique<WriterHxCMFM>(format_id, image, volume_id);
         if (format_id == "FILE_HXC_HFE") return make_unique<dsk_tools::WriterHxCHFE>(format_id, image, volume_id);
         if (format_id == "FILE_RAW_MSB") return dsk_tools::make_unique<dsk_tools::WriterRAW>(format_id, image);
+        if (format_id == "FILE_IMD")     return dsk_tools::make_unique<dsk_tools::WriterIMD>(format_id, image);
 
         return nullptr;
     }
@@ -1004,6 +1027,9 @@ namespace dsk_tools {
             case ErrorCode::FileMetadataError:
                 error = "File metadata error";
                 break;
+            case ErrorCode::Cancelled:
+                error = "Operation cancelled";
+                break;
             default:
                 error = "Unknown error";
                 break;
@@ -539,6 +539,7 @@ fsCPM::fsCPM(diskImage * image, const std::string &filesystem_id, const DiskDefs
                 if (!ext_match) continue;
 
                 de->ST = 0xE5;
+                image->mark_dirty(0, DPB.OFF, translate_sector(i));
                 found = true;
             }
         }
@@ -639,6 +640,7 @@ fsCPM::fsCPM(diskImage * image, const std::string &filesystem_id, const DiskDefs
                 for (int k = 0; k < 3; k++)
                     de->E[k] = (de->E[k] & 0x80) | (new_E[k] & 0x7F);
 
+                image->mark_dirty(0, DPB.OFF, translate_sector(i));
                 found = true;
             }
         }
@@ -732,6 +734,7 @@ fsCPM::fsCPM(diskImage * image, const std::string &filesystem_id, const DiskDefs
                     if (change_system)    de->E[1] = (de->E[1] & 0x7F) | (new_system    ? 0x80 : 0x00);
                     if (change_archive)   de->E[2] = (de->E[2] & 0x7F) | (new_archive   ? 0x80 : 0x00);
 
+                    image->mark_dirty(0, DPB.OFF, translate_sector(i));
                     found = true;
                 }
             }
@@ -872,8 +875,10 @@ fsCPM::fsCPM(diskImage * image, const std::string &filesystem_id, const DiskDefs
 
         // ---- Commit: release the old file's directory entries (blocks were already
         // excluded from block_used, so allocation will reuse them).
-        for (int idx : target_entries)
+        for (int idx : target_entries) {
             catalog[idx]->ST = 0xE5;
+            image->mark_dirty(0, DPB.OFF, translate_sector(idx / entries_in_sector));
+        }
 
         // ---- Allocate blocks (lowest-first)
         std::vector<uint16_t> alloc_blocks;
@@ -899,7 +904,7 @@ fsCPM::fsCPM(diskImage * image, const std::string &filesystem_id, const DiskDefs
                     track = (sector_index / sectors) >> 1;
                 }
                 const int sector = translate_sector(sector_index % sectors);
-                uint8_t * disk_data = image->get_sector_data(head, track, sector);
+                uint8_t * disk_data = image->get_sector_for_write(head, track, sector);
                 if (!disk_data) return Result::error(ErrorCode::WriteError);
 
                 const size_t offset = static_cast<size_t>(blk_idx) * BLS + s * sector_size;
@@ -929,6 +934,7 @@ fsCPM::fsCPM(diskImage * image, const std::string &filesystem_id, const DiskDefs
 
             auto * de = catalog[next_free_entry];
             std::memset(de, 0, sizeof(CPM_DIR_ENTRY));
+            image->mark_dirty(0, DPB.OFF, translate_sector(next_free_entry / entries_in_sector));
 
             de->ST = user_no;
             std::memcpy(de->F, name_F, 8);
@@ -192,17 +192,19 @@ namespace dsk_tools {
         return result;
     }
 
-    Result fsDOS33::track_map(const int track, uint32_t*& mapped)
+    // With for_write the sector holding the map is marked as changed
+    Result fsDOS33::track_map(const int track, uint32_t*& mapped, const bool for_write)
     {
         Agat_VTOC_Ex * VTOCEx;
         mapped = nullptr;
         const int tracks_count = image->get_tracks()*image->get_heads();
         if (track < 0x32) {
             mapped = &(VTOC->free_sectors[track]);
+            if (for_write) image->mark_dirty(0, 0x11, 0);
             return Result::ok();
         }
         if (track < 0x72 && tracks_count > 0x32) {
-            uint8_t* vtoc_ex_data = image->get_sector_data(0, 0x32, 0);
+            uint8_t* vtoc_ex_data = for_write ? image->get_sector_for_write(0, 0x32, 0) : image->get_sector_data(0, 0x32, 0);
             if (!vtoc_ex_data)
                 return Result::error(ErrorCode::IncorrectRequest, "Cannot read VTOC extension sector (0x32, 0)");
 
@@ -211,7 +213,7 @@ namespace dsk_tools {
             return Result::ok();
         }
         if (track < 0xB2 && tracks_count > 0x72) {
-            uint8_t* vtoc_ex_data = image->get_sector_data(0, 0x72, 0);
+            uint8_t* vtoc_ex_data = for_write ? image->get_sector_for_write(0, 0x72, 0) : image->get_sector_data(0, 0x72, 0);
             if (!vtoc_ex_data)
                 return Result::error(ErrorCode::IncorrectRequest, "Cannot read VTOC extension sector (0x72, 0)");
 
@@ -252,7 +254,7 @@ namespace dsk_tools {
     {
         // std::cout << "sector_free: " << track << ":" << sector << std::endl;
         uint32_t * mapped = nullptr;
-        const Result res = track_map(track, mapped);
+        const Result res = track_map(track, mapped, true);
         if (res && mapped) {
             *mapped |= (image->get_sectors()==16)?VTOCMask140[sector]:VTOCMask840[sector];
             return Result::ok();
@@ -266,7 +268,7 @@ namespace dsk_tools {
 
         if (!sector_is_free(0, track, sector)) return Result::error(ErrorCode::IncorrectRequest);
         uint32_t * mapped = nullptr;
-        const Result res = track_map(track, mapped);
+        const Result res = track_map(track, mapped, true);
         if (res && mapped) {
             *mapped &= ~((image->get_sectors()==16)?VTOCMask140[sector]:VTOCMask840[sector]);
             return Result::ok();
@@ -330,6 +332,7 @@ namespace dsk_tools {
                     dir_entry = &(catalog->files[i]);
                     dir_pos = i;
                     extra_sector = false;
+                    if (!just_check) image->mark_dirty(0, catalog_ts.track, catalog_ts.sector);
                     // std::cout << "==> found position: " << i << std::endl;
                     return true;
                 }
@@ -348,8 +351,9 @@ namespace dsk_tools {
                 sector_occupy(0, new_ts.track, new_ts.sector);
                 catalog->next_track = new_ts.track;
                 catalog->next_sector = new_ts.sector;
+                image->mark_dirty(0, last_ts.track, last_ts.sector);
 
-                uint8_t* new_catalog_data = image->get_sector_data(0, new_ts.track, new_ts.sector);
+                uint8_t* new_catalog_data = image->get_sector_for_write(0, new_ts.track, new_ts.sector);
                 if (!new_catalog_data) {
                     return false;  // Cannot read new catalog sector
                 }
@@ -423,7 +427,7 @@ namespace dsk_tools {
 
         sector_occupy(0, ts.track, ts.sector);
 
-        auto * new_catalog = reinterpret_cast<Apple_DOS_Catalog *>(image->get_sector_data(0, ts.track, ts.sector));
+        auto * new_catalog = reinterpret_cast<Apple_DOS_Catalog *>(image->get_sector_for_write(0, ts.track, ts.sector));
         if (!new_catalog) return Result::error(ErrorCode::DirErrorAllocateSector);
 
         std::memset(new_catalog, 0, sizeof(Apple_DOS_Catalog));
@@ -632,7 +636,7 @@ namespace dsk_tools {
             // std::cout << ">" << (int)ts.track << ":" << (int)ts.sector << std::endl;
 
             sector_occupy(0, ts.track, ts.sector);
-            auto * ts_list = reinterpret_cast<Apple_DOS_TS_List *>(image->get_sector_data(0, ts.track, ts.sector));
+            auto * ts_list = reinterpret_cast<Apple_DOS_TS_List *>(image->get_sector_for_write(0, ts.track, ts.sector));
             if (!ts_list) return Result::error(ErrorCode::WriteError);
 
             std::memset(ts_list, 0, sizeof(Apple_DOS_TS_List));
@@ -670,7 +674,7 @@ namespace dsk_tools {
                     ts_list->ts[j][0] = file_ts.track;
                     ts_list->ts[j][1] = file_ts.sector;
 
-                    uint8_t * disk_data = image->get_sector_data(0, file_ts.track, file_ts.sector);
+                    uint8_t * disk_data = image->get_sector_for_write(0, file_ts.track, file_ts.sector);
                     if (!disk_data) return Result::error(ErrorCode::WriteError);
 
                     std::memcpy(disk_data, data.data() + data_offset + ts_pair * image->get_sector_size(), image->get_sector_size());
@@ -694,7 +698,7 @@ namespace dsk_tools {
     {
         if (!uf.is_dir) {
             // ----- File
-            const auto * catalog = reinterpret_cast<Apple_DOS_Catalog *>(image->get_sector_data(0, uf.position[0], uf.position[1]));
+            const auto * catalog = reinterpret_cast<Apple_DOS_Catalog *>(image->get_sector_for_write(0, uf.position[0], uf.position[1]));
             if (!catalog) return Result::error(ErrorCode::FileDeleteError);
             auto * dir_entry = const_cast<Apple_DOS_File *>(&(catalog->files[uf.position[2]]));
 
@@ -782,6 +786,7 @@ namespace dsk_tools {
 
                 dir_entry->name[29] = dir_entry->tbl_track;
                 dir_entry->tbl_track = 0xFF;
+                image->mark_dirty(0, uf.position[0], uf.position[1]);
                 is_changed = true;
             } else
                 return Result::error(ErrorCode::DirNotEmpty);
@@ -911,7 +916,7 @@ namespace dsk_tools {
 
     Result fsDOS33::rename_file(const UniversalFile & fd, const std::string & new_name)
     {
-        auto * catalog = reinterpret_cast<Apple_DOS_Catalog *>(image->get_sector_data(0, fd.position[0], fd.position[1]));
+        auto * catalog = reinterpret_cast<Apple_DOS_Catalog *>(image->get_sector_for_write(0, fd.position[0], fd.position[1]));
         if (!catalog) return Result::error(ErrorCode::FileRenameError);
 
         auto * dir_entry = &(catalog->files[fd.position[2]]);
@@ -966,7 +971,7 @@ namespace dsk_tools {
         }
 
         if (is_protected) new_type |= 0x80;
-        auto * catalog = reinterpret_cast<Apple_DOS_Catalog *>(image->get_sector_data(0, fd.position[0], fd.position[1]));
+        auto * catalog = reinterpret_cast<Apple_DOS_Catalog *>(image->get_sector_for_write(0, fd.position[0], fd.position[1]));
         if (!catalog) return Result::error(ErrorCode::FileMetadataError);
 
         auto * dir_entry = &(catalog->files[fd.position[2]]);
@@ -976,7 +981,7 @@ namespace dsk_tools {
         const int list_track = dir_entry->tbl_track;
         const int list_sector = dir_entry->tbl_sector;
 
-        auto * ts_list = reinterpret_cast<Apple_DOS_TS_List *>(image->get_sector_data(0, list_track, list_sector));
+        auto * ts_list = reinterpret_cast<Apple_DOS_TS_List *>(image->get_sector_for_write(0, list_track, list_sector));
         if (!ts_list) return Result::error(ErrorCode::FileMetadataError);
 
         void * copy_to = &(ts_list->_not_used_03);
@@ -990,7 +995,7 @@ namespace dsk_tools {
     {
         if (!uf.is_dir) {
             // ----- File
-            const auto * catalog = reinterpret_cast<Apple_DOS_Catalog *>(image->get_sector_data(0, uf.position[0], uf.position[1]));
+            const auto * catalog = reinterpret_cast<Apple_DOS_Catalog *>(image->get_sector_for_write(0, uf.position[0], uf.position[1]));
             if (!catalog) return Result::error(ErrorCode::FileDeleteError);
             auto * dir_entry = const_cast<Apple_DOS_File *>(&(catalog->files[uf.position[2]]));
 
@@ -1051,6 +1056,7 @@ namespace dsk_tools {
             if (restored_track < (image->get_tracks()*image->get_heads()) && catalog_ts.sector < image->get_sectors()) {
                 dir_entry->tbl_track = catalog_ts.track = restored_track;
                 dir_entry->name[29] = 0xA0;
+                image->mark_dirty(0, uf.position[0], uf.position[1]);
                 do {
                     catalog = reinterpret_cast<dsk_tools::Apple_DOS_Catalog *>(image->get_sector_data(0, catalog_ts.track, catalog_ts.sector));
                     if (!catalog) return Result::error(ErrorCode::FileRestoreError);
@@ -135,7 +135,7 @@ namespace dsk_tools {
         Result sector_free(int head, int track, int sector) override;
         Result sector_occupy(int head, int track, int sector) override;
         int free_sectors() override;
-        virtual Result track_map(int track, uint32_t*& mapped);
+        virtual Result track_map(int track, uint32_t*& mapped, bool for_write = false);
 
     private:
         Result get_file_contents(const Apple_DOS_File * dir_entry, BYTES & data) const;
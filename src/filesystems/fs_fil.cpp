@@ -66,7 +66,7 @@ namespace dsk_tools {
 
     Result fsFIL::rename_file(const UniversalFile &fd, const std::string &new_name)
     {
-        auto * header = reinterpret_cast<FIL_header *>(image->get_sector_data(0,0,0));
+        auto * header = reinterpret_cast<FIL_header *>(image->get_sector_for_write(0,0,0));
 
         const BYTES name_str = utf_to_agat(new_name);
         const auto len = name_str.size();
@@ -141,7 +141,7 @@ namespace dsk_tools {
 
     Result fsFIL::file_set_metadata(const UniversalFile & fd, const std::map<std::string, std::string> & metadata)
     {
-        auto * header = reinterpret_cast<FIL_header *>(image->get_sector_data(0,0,0));
+        auto * header = reinterpret_cast<FIL_header *>(image->get_sector_for_write(0,0,0));
 
         uint8_t new_type = 0;
         bool is_protected = false;
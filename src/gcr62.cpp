@@ -0,0 +1,451 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2025 Mikhail Revzin <p3.141592653589793238462643@gmail.com>
+// Part of the dsk_tools project: https://github.com/Ptr314/dsk_tools
+// Description: GCR 6-and-2 sector codec (Apple II / Agat 140 Kb)
+
+#include <cstring>
+
+#include "gcr62.h"
+#include "simd.h"
+
+#ifdef DSK_TOOLS_X86_SIMD
+    #include <immintrin.h>
+#endif
+
+namespace dsk_tools {
+
+    static const unsigned char FlipBit1[4] = { 0, 2,  1,  3  };
+    static const unsigned char FlipBit2[4] = { 0, 8,  4,  12 };
+    static const unsigned char FlipBit3[4] = { 0, 32, 16, 48 };
+
+    static const uint8_t m_write_translate_table[64] =
+        {
+            0x96,0x97,0x9A,0x9B,0x9D,0x9E,0x9F,0xA6,
+            0xA7,0xAB,0xAC,0xAD,0xAE,0xAF,0xB2,0xB3,
+            0xB4,0xB5,0xB6,0xB7,0xB9,0xBA,0xBB,0xBC,
+            0xBD,0xBE,0xBF,0xCB,0xCD,0xCE,0xCF,0xD3,
+            0xD6,0xD7,0xD9,0xDA,0xDB,0xDC,0xDD,0xDE,
+            0xDF,0xE5,0xE6,0xE7,0xE9,0xEA,0xEB,0xEC,
+            0xED,0xEE,0xEF,0xF2,0xF3,0xF4,0xF5,0xF6,
+            0xF7,0xF9,0xFA,0xFB,0xFC,0xFD,0xFE,0xFF
+    };
+
+    static const uint8_t m_read_translate_table[] = {
+        0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+        0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+        0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+        0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+        0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+        0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+        0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+        0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+        0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+        0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x01,0x00,0x00,0x02,0x03,0x00,0x04,0x05,0x06,
+        0x00,0x00,0x00,0x00,0x00,0x00,0x07,0x08,0x00,0x00,0x00,0x09,0x0a,0x0b,0x0c,0x0d,
+        0x00,0x00,0x0e,0x0f,0x10,0x11,0x12,0x13,0x00,0x14,0x15,0x16,0x17,0x18,0x19,0x1a,
+        0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x1b,0x00,0x1c,0x1d,0x1e,
+        0x00,0x00,0x00,0x1f,0x00,0x00,0x20,0x21,0x00,0x22,0x23,0x24,0x25,0x26,0x27,0x28,
+        0x00,0x00,0x00,0x00,0x00,0x29,0x2a,0x2b,0x00,0x2c,0x2d,0x2e,0x2f,0x30,0x31,0x32,
+        0x00,0x00,0x33,0x34,0x35,0x36,0x37,0x38,0x00,0x39,0x3a,0x3b,0x3c,0x3d,0x3e,0x3f
+    };
+
+    // Six-bit values are kept with a leading zero, so value i and its predecessor
+    // are v[i+1] and v[i] and the encoder can xor neighbours without a special case
+    #define GCR62_VALUES        342
+    #define GCR62_PADDED        (1 + GCR62_VALUES + 32)
+    #define GCR62_BLOCKS        352         // GCR62_VALUES rounded up to whole 16 and 32-byte blocks
+
+    void encode_gcr62_scalar(const uint8_t data_in[], uint8_t * data_out)
+    {
+
+        // First 86 bytes are combined lower 2 bits of input data
+        for (int i = 0; i < 86; i++) {
+            data_out[i] = FlipBit1[data_in[i]&3] | FlipBit2[data_in[i+86]&3] | FlipBit3[data_in[(i+172) & 0xFF]&3];
+                // ^^ 2 extra bytes are wrapped to the beginning
+        }
+
+        // Next 256 bytes are upper 6 bits
+        for (int i = 0; i < 256; i++) {
+            data_out[i+86] = data_in[i] >> 2;
+        }
+
+        // Then, encode 6 bits to 8 bits using a table and calculate a crc
+        uint8_t crc = 0;
+        for (int i = 0; i < 342; i++) {
+            uint8_t v = data_out[i];
+            data_out[i] = m_write_translate_table[v ^ crc];
+            crc = v;
+        }
+
+        // And finally add a crc byte
+        data_out[342] = m_write_translate_table[crc];
+    }
+
+    bool decode_gcr62_scalar(const uint8_t data_in[], uint8_t * data_out)
+    {
+        uint8_t crc = 0;
+
+        for (int i=0; i<86; i++) {
+            uint8_t x = (crc^m_read_translate_table[data_in[i]]) & 0x3f;
+            if (i+172 < 256)
+                data_out[i+172] = FlipBit1[(x>>4) & 3];
+            data_out[i+86] =  FlipBit1[(x>>2) & 3];
+            data_out[i] =     FlipBit1[ x     & 3];
+            crc = x;
+        }
+        for (int i=0; i<256; i++) {
+            uint8_t x = (crc^m_read_translate_table[data_in[i+86]]) & 0x3f;
+            data_out[i] |=  x << 2 ;
+            crc = x;
+        }
+
+        uint8_t r_crc = m_read_translate_table[data_in[342]];
+
+        return crc == r_crc;
+    }
+
+    // Checksum kernels. Every value is stored xored with the previous one: the encoder xors neighbours
+    // (translate_gcr62_*), the decoder undoes it with a prefix xor, the checksum is the last value.
+
+    // A good sector's values and its checksum xor to zero; four chains keep the lookups independent
+    static bool check_gcr62_scalar(const uint8_t data_in[])
+    {
+        uint8_t c0 = 0, c1 = 0, c2 = 0, c3 = 0;
+        int i = 0;
+        for (; i + 4 <= GCR62_ENCODED_SIZE; i += 4) {
+            c0 ^= m_read_translate_table[data_in[i]];
+            c1 ^= m_read_translate_table[data_in[i + 1]];
+            c2 ^= m_read_translate_table[data_in[i + 2]];
+            c3 ^= m_read_translate_table[data_in[i + 3]];
+        }
+        for (; i < GCR62_ENCODED_SIZE; i++)
+            c0 ^= m_read_translate_table[data_in[i]];
+        return (c0 ^ c1 ^ c2 ^ c3) == 0;
+    }
+
+#ifdef DSK_TOOLS_X86_SIMD
+
+    // Prefix xor of x[0..GCR62_BLOCKS) in place: log2(16) shifted xors per block,
+    // then the last byte of the block is carried into the next one
+    DSK_TARGET_SSE2 static inline void prefix_xor_gcr62_sse2(uint8_t x[])
+    {
+        __m128i carry = _mm_setzero_si128();
+        for (int i = 0; i < GCR62_BLOCKS; i += 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i));
+            v = _mm_xor_si128(v, _mm_slli_si128(v, 1));
+            v = _mm_xor_si128(v, _mm_slli_si128(v, 2));
+            v = _mm_xor_si128(v, _mm_slli_si128(v, 4));
+            v = _mm_xor_si128(v, _mm_slli_si128(v, 8));
+            v = _mm_xor_si128(v, carry);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(x + i), v);
+            // Byte 15 into every byte
+            const __m128i hi = _mm_unpackhi_epi8(v, v);
+            carry = _mm_shuffle_epi32(_mm_unpackhi_epi16(hi, hi), _MM_SHUFFLE(3, 3, 3, 3));
+        }
+    }
+
+    // Nibbles 0x96..0xFF to six-bit values as seven 16-entry shuffles selected by the high nibble,
+    // anything below 0x90 gives 0 as the table does. x[GCR62_VALUES..GCR62_BLOCKS) are zeroed
+    DSK_TARGET_AVX2 static void read_translate_gcr62_avx2(const uint8_t data_in[], uint8_t x[])
+    {
+        __m256i tab[7];
+        for (int k = 0; k < 7; k++)
+            tab[k] = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(m_read_translate_table + 0x90 + k*16)));
+        const __m256i nibble = _mm256_set1_epi8(0x0F);
+
+        for (int i = 0; i < GCR62_VALUES; i += 32) {
+            const int p = (i + 32 <= GCR62_VALUES) ? i : GCR62_VALUES - 32;    // Last block overlaps the previous one
+            const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data_in + p));
+            const __m256i lo = _mm256_and_si256(b, nibble);
+            const __m256i hi = _mm256_and_si256(_mm256_srli_epi16(b, 4), nibble);
+            __m256i r = _mm256_setzero_si256();
+            for (int k = 0; k < 7; k++)
+                r = _mm256_or_si256(r, _mm256_and_si256(_mm256_shuffle_epi8(tab[k], lo), _mm256_cmpeq_epi8(hi, _mm256_set1_epi8(9 + k))));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(x + p), r);
+        }
+        std::memset(x + GCR62_VALUES, 0, GCR62_BLOCKS - GCR62_VALUES);
+    }
+
+    // Decoder stage 1: translate and undo the xor chain; returns the checksum state
+    DSK_TARGET_SSE2 static bool unchain_gcr62_sse2(const uint8_t data_in[], uint8_t x[])
+    {
+        for (int i = 0; i < GCR62_VALUES; i++)
+            x[i] = m_read_translate_table[data_in[i]];
+        std::memset(x + GCR62_VALUES, 0, GCR62_BLOCKS - GCR62_VALUES);
+        prefix_xor_gcr62_sse2(x);
+        return x[GCR62_VALUES - 1] == m_read_translate_table[data_in[GCR62_VALUES]];
+    }
+
+    DSK_TARGET_AVX2 static bool unchain_gcr62_avx2(const uint8_t data_in[], uint8_t x[])
+    {
+        read_translate_gcr62_avx2(data_in, x);
+        prefix_xor_gcr62_sse2(x);
+        return x[GCR62_VALUES - 1] == m_read_translate_table[data_in[GCR62_VALUES]];
+    }
+
+    DSK_TARGET_AVX2 static bool check_gcr62_avx2(const uint8_t data_in[])
+    {
+        uint8_t x[GCR62_BLOCKS];
+        read_translate_gcr62_avx2(data_in, x);
+        __m256i acc = _mm256_setzero_si256();
+        for (int i = 0; i < GCR62_BLOCKS - 32; i += 32)
+            acc = _mm256_xor_si256(acc, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x + i)));
+        __m128i r = _mm_xor_si128(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+        r = _mm_xor_si128(r, _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + GCR62_BLOCKS - 32)));
+        r = _mm_xor_si128(r, _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + GCR62_BLOCKS - 16)));
+        r = _mm_xor_si128(r, _mm_srli_si128(r, 8));
+        r = _mm_xor_si128(r, _mm_srli_si128(r, 4));
+        r = _mm_xor_si128(r, _mm_srli_si128(r, 2));
+        r = _mm_xor_si128(r, _mm_srli_si128(r, 1));
+        return (_mm_cvtsi128_si32(r) & 0xFF) == m_read_translate_table[data_in[GCR62_VALUES]];
+    }
+
+#endif
+
+#ifdef DSK_TOOLS_X86_SIMD
+
+    // Swaps bit 0 and bit 1 of every byte; the input must be masked to 2 bits
+    DSK_TARGET_SSE2 static inline __m128i flip2_sse2(__m128i x, __m128i one)
+    {
+        const __m128i b0 = _mm_and_si128(x, one);
+        const __m128i b1 = _mm_and_si128(_mm_srli_epi16(x, 1), one);
+        return _mm_or_si128(_mm_add_epi8(b0, b0), b1);
+    }
+
+    DSK_TARGET_AVX2 static inline __m256i flip2_avx2(__m256i x, __m256i one)
+    {
+        const __m256i b0 = _mm256_and_si256(x, one);
+        const __m256i b1 = _mm256_and_si256(_mm256_srli_epi16(x, 1), one);
+        return _mm256_or_si256(_mm256_add_epi8(b0, b0), b1);
+    }
+
+    // Encoder stage 1: splits 256 bytes into 342 six-bit values at v[1..342]
+    DSK_TARGET_SSE2 static void split_gcr62_sse2(const uint8_t data_in[], uint8_t v[])
+    {
+        uint8_t ext[256 + 16];                              // Wraps the last 2 low-bit groups to the beginning
+        std::memcpy(ext, data_in, 256);
+        std::memcpy(ext + 256, data_in, 16);
+
+        const __m128i one = _mm_set1_epi8(1);
+        const __m128i two_bits = _mm_set1_epi8(3);
+        for (int i = 0; i < 86; i += 16) {
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ext + i));
+            const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ext + i + 86));
+            const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ext + i + 172));
+            const __m128i fa = flip2_sse2(_mm_and_si128(a, two_bits), one);
+            const __m128i fb = flip2_sse2(_mm_and_si128(b, two_bits), one);
+            const __m128i fc = flip2_sse2(_mm_and_si128(c, two_bits), one);
+            const __m128i r = _mm_or_si128(fa, _mm_or_si128(_mm_slli_epi16(fb, 2), _mm_slli_epi16(fc, 4)));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(v + 1 + i), r);
+        }
+        // Overwrites the tail of the last group above
+        const __m128i six_bits = _mm_set1_epi8(0x3F);
+        for (int i = 0; i < 256; i += 16) {
+            const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ext + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(v + 1 + 86 + i), _mm_and_si128(_mm_srli_epi16(d, 2), six_bits));
+        }
+    }
+
+    DSK_TARGET_AVX2 static void split_gcr62_avx2(const uint8_t data_in[], uint8_t v[])
+    {
+        uint8_t ext[256 + 16];
+        std::memcpy(ext, data_in, 256);
+        std::memcpy(ext + 256, data_in, 16);
+
+        const __m256i one = _mm256_set1_epi8(1);
+        const __m256i two_bits = _mm256_set1_epi8(3);
+        for (int i = 0; i < 86; i += 32) {
+            const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ext + i));
+            const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ext + i + 86));
+            const __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ext + i + 172));
+            const __m256i fa = flip2_avx2(_mm256_and_si256(a, two_bits), one);
+            const __m256i fb = flip2_avx2(_mm256_and_si256(b, two_bits), one);
+            const __m256i fc = flip2_avx2(_mm256_and_si256(c, two_bits), one);
+            const __m256i r = _mm256_or_si256(fa, _mm256_or_si256(_mm256_slli_epi16(fb, 2), _mm256_slli_epi16(fc, 4)));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(v + 1 + i), r);
+        }
+        const __m256i six_bits = _mm256_set1_epi8(0x3F);
+        for (int i = 0; i < 256; i += 32) {
+            const __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ext + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(v + 1 + 86 + i), _mm256_and_si256(_mm256_srli_epi16(d, 2), six_bits));
+        }
+    }
+
+    // Encoder stage 2: xor with the previous value and translate 6 -> 8 bits.
+    // SSE2 has no byte shuffle, so only the xor part is vectorized
+    DSK_TARGET_SSE2 static void translate_gcr62_sse2(const uint8_t v[], uint8_t * data_out)
+    {
+        uint8_t x[GCR62_VALUES + 16];
+        for (int i = 0; i < GCR62_VALUES; i += 16) {
+            const __m128i cur  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(v + 1 + i));
+            const __m128i prev = _mm_loadu_si128(reinterpret_cast<const __m128i*>(v + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(x + i), _mm_xor_si128(cur, prev));
+        }
+        for (int i = 0; i < GCR62_VALUES; i++)
+            data_out[i] = m_write_translate_table[x[i]];
+        data_out[GCR62_VALUES] = m_write_translate_table[v[GCR62_VALUES]];
+    }
+
+    // 64-entry table lookup as four 16-entry shuffles selected by bits 4-5
+    DSK_TARGET_AVX2 static void translate_gcr62_avx2(const uint8_t v[], uint8_t * data_out)
+    {
+        const __m256i t0 = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(m_write_translate_table)));
+        const __m256i t1 = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(m_write_translate_table + 16)));
+        const __m256i t2 = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(m_write_translate_table + 32)));
+        const __m256i t3 = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(m_write_translate_table + 48)));
+        const __m256i nibble = _mm256_set1_epi8(0x0F);
+
+        for (int i = 0; i < GCR62_VALUES; i += 32) {
+            const int p = (i + 32 <= GCR62_VALUES) ? i : GCR62_VALUES - 32;    // Last block overlaps the previous one
+            const __m256i cur  = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(v + 1 + p));
+            const __m256i prev = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(v + p));
+            const __m256i x = _mm256_xor_si256(cur, prev);
+            const __m256i lo = _mm256_and_si256(x, nibble);
+            const __m256i hi = _mm256_and_si256(_mm256_srli_epi16(x, 4), nibble);
+            __m256i r =            _mm256_and_si256(_mm256_shuffle_epi8(t0, lo), _mm256_cmpeq_epi8(hi, _mm256_setzero_si256()));
+            r = _mm256_or_si256(r, _mm256_and_si256(_mm256_shuffle_epi8(t1, lo), _mm256_cmpeq_epi8(hi, _mm256_set1_epi8(1))));
+            r = _mm256_or_si256(r, _mm256_and_si256(_mm256_shuffle_epi8(t2, lo), _mm256_cmpeq_epi8(hi, _mm256_set1_epi8(2))));
+            r = _mm256_or_si256(r, _mm256_and_si256(_mm256_shuffle_epi8(t3, lo), _mm256_cmpeq_epi8(hi, _mm256_set1_epi8(3))));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(data_out + p), r);
+        }
+        data_out[GCR62_VALUES] = m_write_translate_table[v[GCR62_VALUES]];
+    }
+
+    // Decoder stage 2: output byte base+i takes its upper 6 bits from value 86+base+i
+    // and its lower 2 bits (flipped) from value i, shifted by 2*segment
+    DSK_TARGET_SSE2 static void merge_gcr62_sse2(const uint8_t x[], uint8_t * data_out)
+    {
+        const __m128i one = _mm_set1_epi8(1);
+        const __m128i two_bits = _mm_set1_epi8(3);
+        for (int s = 0; s < 3; s++) {
+            const int base = s * 86;
+            const int count = (s < 2) ? 86 : 84;
+            const __m128i shift = _mm_cvtsi32_si128(s * 2);
+            for (int i = 0; i < count; i += 16) {
+                const int p = (i + 16 <= count) ? i : count - 16;
+                const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + p));
+                const __m128i u = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + 86 + base + p));
+                const __m128i f = flip2_sse2(_mm_and_si128(_mm_srl_epi16(a, shift), two_bits), one);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(data_out + base + p), _mm_or_si128(f, _mm_slli_epi16(u, 2)));
+            }
+        }
+    }
+
+    DSK_TARGET_AVX2 static void merge_gcr62_avx2(const uint8_t x[], uint8_t * data_out)
+    {
+        const __m256i one = _mm256_set1_epi8(1);
+        const __m256i two_bits = _mm256_set1_epi8(3);
+        for (int s = 0; s < 3; s++) {
+            const int base = s * 86;
+            const int count = (s < 2) ? 86 : 84;
+            const __m128i shift = _mm_cvtsi32_si128(s * 2);
+            for (int i = 0; i < count; i += 32) {
+                const int p = (i + 32 <= count) ? i : count - 32;
+                const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x + p));
+                const __m256i u = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x + 86 + base + p));
+                const __m256i f = flip2_avx2(_mm256_and_si256(_mm256_srl_epi16(a, shift), two_bits), one);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(data_out + base + p), _mm256_or_si256(f, _mm256_slli_epi16(u, 2)));
+            }
+        }
+    }
+
+    static void encode_gcr62_sse2(const uint8_t data_in[], uint8_t * data_out)
+    {
+        uint8_t v[GCR62_PADDED];
+        v[0] = 0;
+        split_gcr62_sse2(data_in, v);
+        translate_gcr62_sse2(v, data_out);
+    }
+
+    static void encode_gcr62_avx2(const uint8_t data_in[], uint8_t * data_out)
+    {
+        uint8_t v[GCR62_PADDED];
+        v[0] = 0;
+        split_gcr62_avx2(data_in, v);
+        translate_gcr62_avx2(v, data_out);
+    }
+
+    static bool decode_gcr62_sse2(const uint8_t data_in[], uint8_t * data_out)
+    {
+        uint8_t x[GCR62_BLOCKS];
+        const bool crc_ok = unchain_gcr62_sse2(data_in, x);
+        merge_gcr62_sse2(x, data_out);
+        return crc_ok;
+    }
+
+    static bool decode_gcr62_avx2(const uint8_t data_in[], uint8_t * data_out)
+    {
+        uint8_t x[GCR62_BLOCKS];
+        const bool crc_ok = unchain_gcr62_avx2(data_in, x);
+        merge_gcr62_avx2(x, data_out);
+        return crc_ok;
+    }
+
+#endif
+
+    typedef void (*EncodeGCR62Func)(const uint8_t data_in[], uint8_t * data_out);
+    typedef bool (*DecodeGCR62Func)(const uint8_t data_in[], uint8_t * data_out);
+
+    static EncodeGCR62Func select_encoder()
+    {
+#ifdef DSK_TOOLS_X86_SIMD
+        switch (simd_level()) {
+            case SimdLevel::AVX2: return &encode_gcr62_avx2;
+            case SimdLevel::SSE2: return &encode_gcr62_sse2;
+            default: break;
+        }
+#endif
+        return &encode_gcr62_scalar;
+    }
+
+    static DecodeGCR62Func select_decoder()
+    {
+#ifdef DSK_TOOLS_X86_SIMD
+        switch (simd_level()) {
+            case SimdLevel::AVX2: return &decode_gcr62_avx2;
+            case SimdLevel::SSE2: return &decode_gcr62_sse2;
+            default: break;
+        }
+#endif
+        return &decode_gcr62_scalar;
+    }
+
+    void encode_gcr62(const uint8_t data_in[], uint8_t * data_out)
+    {
+        select_encoder()(data_in, data_out);
+    }
+
+    bool decode_gcr62(const uint8_t data_in[], uint8_t * data_out)
+    {
+        return select_decoder()(data_in, data_out);
+    }
+
+    bool check_gcr62(const uint8_t data_in[])
+    {
+#ifdef DSK_TOOLS_X86_SIMD
+        // Without byte shuffles the lookups cost the same, the scalar chains are as fast as SSE2
+        if (simd_level() == SimdLevel::AVX2) return check_gcr62_avx2(data_in);
+#endif
+        return check_gcr62_scalar(data_in);
+    }
+
+    void encode_gcr62_track(const uint8_t * const data_in[], uint8_t * const data_out[], int count)
+    {
+        const EncodeGCR62Func encode = select_encoder();
+        for (int i = 0; i < count; i++)
+            encode(data_in[i], data_out[i]);
+    }
+
+    int decode_gcr62_track(const uint8_t * const data_in[], uint8_t * const data_out[], bool crc_ok[], int count)
+    {
+        const DecodeGCR62Func decode = select_decoder();
+        int errors = 0;
+        for (int i = 0; i < count; i++) {
+            const bool ok = decode(data_in[i], data_out[i]);
+            if (crc_ok != nullptr) crc_ok[i] = ok;
+            if (!ok) errors++;
+        }
+        return errors;
+    }
+
+}
@@ -0,0 +1,29 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2025 Mikhail Revzin <p3.141592653589793238462643@gmail.com>
+// Part of the dsk_tools project: https://github.com/Ptr314/dsk_tools
+// Description: GCR 6-and-2 sector codec (Apple II / Agat 140 Kb)
+#pragma once
+
+#include <cstdint>
+
+namespace dsk_tools {
+
+    #define GCR62_SECTOR_SIZE   256
+    #define GCR62_ENCODED_SIZE  343     // 86 + 256 six-bit values + crc
+
+    // Single sector, uses the best kernel available
+    void encode_gcr62(const uint8_t data_in[], uint8_t * data_out);
+    bool decode_gcr62(const uint8_t data_in[], uint8_t * data_out);
+    // Checksum only, nothing is decoded
+    bool check_gcr62(const uint8_t data_in[]);
+
+    // A batch of sectors, i.e. a whole track; the kernel is selected once per call.
+    // decode_gcr62_track returns the number of sectors with a bad checksum, crc_ok may be nullptr
+    void encode_gcr62_track(const uint8_t * const data_in[], uint8_t * const data_out[], int count);
+    int decode_gcr62_track(const uint8_t * const data_in[], uint8_t * const data_out[], bool crc_ok[], int count);
+
+    // Reference implementations, other kernels must produce identical results
+    void encode_gcr62_scalar(const uint8_t data_in[], uint8_t * data_out);
+    bool decode_gcr62_scalar(const uint8_t data_in[], uint8_t * data_out);
+
+}
@@ -199,6 +199,12 @@ namespace dsk_tools {
         return _wremove(wpath.c_str());
     }
 
+    int utf8_rename(const std::string& from, const std::string& to) {
+        const std::wstring wfrom = utf8_to_wide(from);
+        const std::wstring wto = utf8_to_wide(to);
+        return MoveFileExW(wfrom.c_str(), wto.c_str(), MOVEFILE_REPLACE_EXISTING) ? 0 : -1;
+    }
+
     // Helper function for directory creation with UTF-8 path
     int utf8_mkdir(const std::string& path) {
         std::wstring wpath = utf8_to_wide(path);
@@ -231,6 +237,10 @@ namespace dsk_tools {
         return std::remove(path.c_str());
     }
 
+    int utf8_rename(const std::string& from, const std::string& to) {
+        return std::rename(from.c_str(), to.c_str());
+    }
+
     int utf8_mkdir(const std::string& path) {
         return mkdir(path.c_str(), 0755);
     }
@@ -258,6 +268,10 @@ namespace dsk_tools {
         return std::remove(path.c_str());
     }
 
+    int utf8_rename(const std::string& from, const std::string& to) {
+        return std::rename(from.c_str(), to.c_str());
+    }
+
     int utf8_mkdir(const std::string& path) {
         return mkdir(path.c_str(), 0755);
     }
@@ -358,6 +372,17 @@ bool file_exists(const std::string& path)
     return f.is_open();
 }
 
+bool is_directory(const std::string& path)
+{
+#ifdef _WIN32
+    const DWORD attrs = GetFileAttributesW(utf8_to_wide(path).c_str());
+    return attrs != INVALID_FILE_ATTRIBUTES && (attrs & FILE_ATTRIBUTE_DIRECTORY) != 0;
+#else
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+#endif
+}
+
 long long utf8_file_size(const std::string& path)
 {
     UTF8_ifstream f(path, std::ios::binary);
@@ -68,6 +68,7 @@ namespace dsk_tools {
 
     // Helper functions for file operations with UTF-8 path
     int utf8_remove(const std::string& path);
+    int utf8_rename(const std::string& from, const std::string& to);   // Replaces to if it exists
     int utf8_mkdir(const std::string& path);
     int utf8_trash(const std::string& path);
 
@@ -77,6 +78,7 @@ namespace dsk_tools {
     using UTF8_ofstream = std::ofstream;
 
     int utf8_remove(const std::string& path);
+    int utf8_rename(const std::string& from, const std::string& to);   // Replaces to if it exists
     int utf8_mkdir(const std::string& path);
     int utf8_trash(const std::string& path);
 
@@ -87,6 +89,7 @@ namespace dsk_tools {
     using UTF8_ofstream = std::ofstream;
 
     int utf8_remove(const std::string& path);
+    int utf8_rename(const std::string& from, const std::string& to);   // Replaces to if it exists
     int utf8_mkdir(const std::string& path);
     int utf8_trash(const std::string& path);
 
@@ -94,6 +97,7 @@ namespace dsk_tools {
 
 std::string utf8_read_file(const std::string& path);
 bool file_exists(const std::string& path);
+bool is_directory(const std::string& path);
 long long utf8_file_size(const std::string& path);
 std::string parent_dir_name(const std::string& path);
 
@@ -1,121 +1,324 @@
-// SPDX-License-Identifier: GPL-3.0-or-later
-// Copyright (C) 2025 Mikhail Revzin <p3.141592653589793238462643@gmail.com>
-// Part of the dsk_tools project: https://github.com/Ptr314/dsk_tools
-// Description: Abstract class for all disk images
-
-#include <iostream>
-
-#include "disk_image.h"
-#include "utils.h"
-
-namespace dsk_tools {
-
-    diskImage::diskImage(std::unique_ptr<Loader> loader):
-          m_loader(std::move(loader))
-        , m_is_loaded(false)
-    {}
-
-    diskImage::diskImage(std::unique_ptr<Loader> loader, const DiskFormatParams &format):
-          m_loader(std::move(loader))
-        , m_format(format)
-        , m_is_loaded(false)
-    {}
-
-    diskImage::~diskImage() = default;
-
-    Result diskImage::load()
-    {
-        if (!m_format.sector_translation.empty() && m_format.sector_translation.size() != m_format.sectors)
-            return Result::error(ErrorCode::LoadError, "Sector translation table has incorrect size");
-
-        m_type_id = m_loader->get_type_id();
-        Result result = m_loader->load(m_buffer, m_format);
-        if (result) {
-            unsigned buffer_size = m_buffer.size();
-            if (m_format.expected_size == 0 || (buffer_size >= m_format.expected_size && buffer_size <= m_format.expected_size + 4)) {
-                m_is_loaded = true;
-                return Result::ok();
-            } else {
-                return Result::error(ErrorCode::LoadSizeMismatch, "Buffer size mismatch");
-            }
-        }
-        return result;
-    }
-
-    unsigned diskImage::transform_index(const unsigned x, const unsigned mod){
-        return (2 * x) % mod + (x / mod) * mod;
-    }
-
-    unsigned diskImage::physical_sector(const unsigned logical) const {
-        if (!m_format.sector_translation.empty())
-            return m_format.sector_translation[logical];
-        return logical;
-    }
-
-    void diskImage::set_sector_translation(const std::vector<unsigned> &table) {
-        m_format.sector_translation = table;
-    }
-
-    uint8_t * diskImage::get_sector_data(const unsigned head, const unsigned track, const unsigned sector)
-    {
-        unsigned track_index = track * m_format.heads + head;
-        if (m_format.heads == 2 && !m_format.sides_interleaved) track_index = transform_index(track_index, m_format.heads * m_format.tracks - 1);
-        const unsigned sector_index = track_index * m_format.sectors + physical_sector(sector);
-        const unsigned offset = sector_index * m_format.sector_size;
-
-        // Bounds check: ensure offset + sector_size doesn't exceed buffer
-        if (offset + m_format.sector_size > m_buffer.size()) {
-            return nullptr;
-        }
-        return &m_buffer[offset];
-    }
-
-    bool diskImage::has_bad_sectors() const
-    {
-        return !m_loader->bad_sectors().empty();
-    }
-
-    bool diskImage::is_bad_sector(const unsigned head, const unsigned track, const unsigned sector) const
-    {
-        if (m_loader->bad_sectors().empty()) return false;
-
-        unsigned new_head = head;
-        unsigned new_track = track;
-        unsigned new_sector = sector;
-
-        logical_to_physical(new_head, new_track, new_sector);
-        return m_loader->bad_sectors().count(bad_sector_key(new_head, new_track, new_sector)) > 0;
-
-        // if (m_format.heads == 1 || m_format.sides_interleaved)
-        //     return m_loader->bad_sectors().count(bad_sector_key(head, track, sector+m_format.sector_base)) > 0;
-        //
-        // // Two sides with sequential tracks
-        // unsigned track_index = track * m_format.heads + head;
-        // track_index = transform_index(track_index, m_format.heads * m_format.tracks - 1);
-        // const unsigned new_head = track_index & 1;
-        // const unsigned new_track = track_index >> 1;
-        // return m_loader->bad_sectors().count(
-        //     bad_sector_key(
-        //             new_head,
-        //             new_track,
-        //             physical_sector(sector+m_format.sector_base)
-        //     )
-        // ) > 0;
-    }
-    void diskImage::logical_to_physical(unsigned & head, unsigned & track, unsigned & sector) const {
-        if (m_format.heads == 2 && !m_format.sides_interleaved) {
-            unsigned track_index = track * m_format.heads + head;
-            track_index = transform_index(track_index, m_format.heads * m_format.tracks - 1);
-            head = track_index & 1;
-            track = track_index >> 1;
-        }
-        sector = physical_sector(sector+m_format.sector_base);
-    }
-
-
-    Result diskImage::check()
-    {
-        return Result::ok();
-    }
-
-}
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2025 Mikhail Revzin <p3.141592653589793238462643@gmail.com>
+// Part of the dsk_tools project: https://github.com/Ptr314/dsk_tools
+// Description: Abstract class for all disk images
+
+#include <algorithm>
+#include <iostream>
+
+#include "disk_image.h"
+#include "thread_pool.h"
+#include "utils.h"
+
+namespace dsk_tools {
+
+    diskImage::diskImage(std::unique_ptr<Loader> loader):
+          m_mapping_offset(0)
+        , m_mapping_size(0)
+        , m_loader(std::move(loader))
+        , m_is_loaded(false)
+        , m_lazy(false)
+        , m_track_size(0)
+        , m_lazy_result(Result::ok())
+        , m_read_trace(nullptr)
+    {}
+
+    diskImage::diskImage(std::unique_ptr<Loader> loader, const DiskFormatParams &format):
+          m_mapping_offset(0)
+        , m_mapping_size(0)
+        , m_loader(std::move(loader))
+        , m_format(format)
+        , m_is_loaded(false)
+        , m_lazy(false)
+        , m_track_size(0)
+        , m_lazy_result(Result::ok())
+        , m_read_trace(nullptr)
+    {}
+
+    diskImage::~diskImage() = default;
+
+    Result diskImage::load()
+    {
+        if (!m_format.sector_translation.empty() && m_format.sector_translation.size() != m_format.sectors)
+            return Result::error(ErrorCode::LoadError, "Sector translation table has incorrect size");
+
+        m_type_id = m_loader->get_type_id();
+        m_mapping.reset();
+        m_track_loaded.clear();
+        m_track_dirty.clear();
+        m_lazy_result = Result::ok();
+        m_is_loaded = false;
+
+        if (MappedFile::supported()) {
+            // Raw images are used right from the page cache, pages are copied only when written to
+            std::unique_ptr<MappedFile> mapping = make_unique<MappedFile>();
+            size_t offset, size;
+            if (m_loader->map(*mapping, offset, size, m_format)) {
+                Result result = check_loaded_size(size);
+                if (result) {
+                    BYTES().swap(m_buffer);
+                    m_mapping = std::move(mapping);
+                    m_mapping_offset = offset;
+                    m_mapping_size = size;
+                }
+                return result;
+            }
+        }
+
+        if (m_lazy) {
+            // Only the track list is read here, tracks are decoded by get_sector_data() and materialize_all()
+            size_t buffer_size, track_size;
+            if (m_loader->open_lazy(buffer_size, track_size, m_format) && track_size > 0) {
+                Result result = check_loaded_size(buffer_size);
+                if (result) {
+                    m_buffer.assign(buffer_size, 0);
+                    m_track_size = track_size;
+                    m_track_loaded.assign((buffer_size + track_size - 1) / track_size, 0);
+                }
+                return result;
+            }
+        }
+
+        Result result = m_loader->load(m_buffer, m_format);
+        if (result) return check_loaded_size(m_buffer.size());
+        if (result.code == ErrorCode::Cancelled) BYTES().swap(m_buffer);
+        return result;
+    }
+
+    void diskImage::set_progress(std::shared_ptr<Progress> progress)
+    {
+        m_progress = progress;
+        m_loader->set_progress(std::move(progress));
+    }
+
+    Result diskImage::load(std::shared_ptr<Source> source)
+    {
+        m_loader->set_source(std::move(source));
+        return load();
+    }
+
+    void diskImage::load_tracks(size_t offset, size_t size)
+    {
+        const size_t last = std::min((offset + size - 1) / m_track_size, m_track_loaded.size() - 1);
+        for (size_t track = offset / m_track_size; track <= last; track++) {
+            if (m_track_loaded[track]) continue;
+            Result result = m_loader->load_track(track, m_buffer.data());
+            if (!result && m_lazy_result) m_lazy_result = result;
+            m_track_loaded[track] = 1;
+        }
+    }
+
+    Result diskImage::materialize_all()
+    {
+        if (m_track_loaded.empty()) return m_lazy_result;
+
+        std::vector<int> pending;
+        for (size_t track = 0; track < m_track_loaded.size(); track++)
+            if (!m_track_loaded[track]) pending.push_back(track);
+
+        std::vector<Result> results(pending.size(), Result::ok());
+        progress_start(m_progress.get(), ProgressStage::Load, pending.size());
+        std::shared_ptr<ThreadPool> pool = decode_pool();
+        ThreadPool::parallel_for(pool.get(), pending.size(), [&](int i, int) {
+            if (is_cancelled(m_progress.get())) return;
+            results[i] = m_loader->load_track(pending[i], m_buffer.data());
+            m_track_loaded[pending[i]] = 1;
+            progress_step(m_progress.get());
+        });
+        for (const Result & result : results)
+            if (!result && m_lazy_result) m_lazy_result = result;
+        // The tracks done so far stay, the next call decodes the rest
+        if (is_cancelled(m_progress.get()))
+            return Result::error(ErrorCode::Cancelled, "Decoding cancelled");
+
+        m_track_loaded.clear();
+        return m_lazy_result;
+    }
+
+    Result diskImage::check_loaded_size(size_t buffer_size)
+    {
+        if (m_format.expected_size == 0 || (buffer_size >= m_format.expected_size && buffer_size <= m_format.expected_size + 4)) {
+            m_is_loaded = true;
+            return Result::ok();
+        } else {
+            return Result::error(ErrorCode::LoadSizeMismatch, "Buffer size mismatch");
+        }
+    }
+
+    uint8_t * diskImage::sectors_data()
+    {
+        if (m_mapping) return m_mapping->mutable_data() + m_mapping_offset;
+        return m_buffer.data();
+    }
+
+    size_t diskImage::sectors_size() const
+    {
+        if (m_mapping) return m_mapping_size;
+        return m_buffer.size();
+    }
+
+    BYTES * diskImage::get_buffer()
+    {
+        materialize_all();
+        if (m_mapping) {
+            const uint8_t * data = sectors_data();
+            m_buffer.assign(data, data + m_mapping_size);
+            m_mapping.reset();
+        }
+        return &m_buffer;
+    }
+
+    Result diskImage::get_data(const uint8_t * & data, size_t & size)
+    {
+        // Bad sectors are written as they are; a track which can't be read or decoded fails the load as without lazy
+        Result result = materialize_all();
+        if (!result) return result;
+        data = sectors_data();
+        size = sectors_size();
+        return Result::ok();
+    }
+
+    unsigned diskImage::transform_index(const unsigned x, const unsigned mod){
+        return (2 * x) % mod + (x / mod) * mod;
+    }
+
+    unsigned diskImage::physical_sector(const unsigned logical) const {
+        if (!m_format.sector_translation.empty())
+            return m_format.sector_translation[logical];
+        return logical;
+    }
+
+    void diskImage::set_sector_translation(const std::vector<unsigned> &table) {
+        m_format.sector_translation = table;
+    }
+
+    // Index of the track in the sectors data, the same for all its sectors
+    unsigned diskImage::buffer_track(const unsigned head, const unsigned track) const
+    {
+        unsigned track_index = track * m_format.heads + head;
+        if (m_format.heads == 2 && !m_format.sides_interleaved) track_index = transform_index(track_index, m_format.heads * m_format.tracks - 1);
+        return track_index;
+    }
+
+    uint8_t * diskImage::get_sector_data(const unsigned head, const unsigned track, const unsigned sector)
+    {
+        const unsigned track_index = diskImage::buffer_track(head, track);   // Subclasses have remapped the coordinates already
+        const unsigned sector_index = track_index * m_format.sectors + physical_sector(sector);
+        const unsigned offset = sector_index * m_format.sector_size;
+
+        // Bounds check: ensure offset + sector_size doesn't exceed buffer
+        if (offset + m_format.sector_size > sectors_size()) {
+            return nullptr;
+        }
+        if (m_read_trace != nullptr) {
+            // Filesystems may count sectors past the end of a track
+            const unsigned index = track_index + sector / m_format.sectors;
+            const SectorRead read = {index % m_format.heads, index / m_format.heads, sector % m_format.sectors};
+            // A sector used again at once is still in the system's buffer
+            const bool repeated = !m_read_trace->empty() && m_read_trace->back().head == read.head
+                                  && m_read_trace->back().track == read.track && m_read_trace->back().sector == read.sector;
+            if (!repeated) m_read_trace->push_back(read);
+        }
+        if (!m_track_loaded.empty()) load_tracks(offset, m_format.sector_size);
+        return sectors_data() + offset;
+    }
+
+    uint8_t * diskImage::get_sector_for_write(const unsigned head, const unsigned track, const unsigned sector)
+    {
+        uint8_t * data = get_sector_data(head, track, sector);
+        if (data != nullptr) mark_dirty(head, track, sector);
+        return data;
+    }
+
+    void diskImage::mark_dirty(const unsigned head, const unsigned track, const unsigned sector)
+    {
+        // A sector past the end of the track is in the next one, as in get_sector_data()
+        const unsigned track_index = buffer_track(head, track) + sector / m_format.sectors;
+        if (track_index >= m_track_dirty.size()) m_track_dirty.resize(track_index + 1, 0);
+        m_track_dirty[track_index] = 1;
+    }
+
+    bool diskImage::is_dirty() const
+    {
+        return std::find(m_track_dirty.begin(), m_track_dirty.end(), 1) != m_track_dirty.end();
+    }
+
+    bool diskImage::is_track_dirty(const unsigned head, const unsigned track) const
+    {
+        const unsigned track_index = buffer_track(head, track);
+        return track_index < m_track_dirty.size() && m_track_dirty[track_index] != 0;
+    }
+
+    bool diskImage::is_range_dirty(const size_t offset, const size_t size) const
+    {
+        const size_t track_size = static_cast<size_t>(m_format.sectors) * m_format.sector_size;
+        if (size == 0 || track_size == 0) return is_dirty();
+        const size_t last = std::min((offset + size - 1) / track_size + 1, m_track_dirty.size());
+        for (size_t track = offset / track_size; track < last; track++)
+            if (m_track_dirty[track]) return true;
+        return false;
+    }
+
+    void diskImage::clear_dirty()
+    {
+        m_track_dirty.clear();
+    }
+
+    bool diskImage::has_bad_sectors()
+    {
+        materialize_all();
+        return !m_loader->bad_sectors().empty();
+    }
+
+    bool diskImage::is_bad_sector(const unsigned head, const unsigned track, const unsigned sector)
+    {
+        materialize_all();
+        if (m_loader->bad_sectors().empty()) return false;
+
+        unsigned new_head = head;
+        unsigned new_track = track;
+        unsigned new_sector = sector;
+
+        logical_to_physical(new_head, new_track, new_sector);
+        return m_loader->bad_sectors().count(bad_sector_key(new_head, new_track, new_sector)) > 0;
+
+        // if (m_format.heads == 1 || m_format.sides_interleaved)
+        //     return m_loader->bad_sectors().count(bad_sector_key(head, track, sector+m_format.sector_base)) > 0;
+        //
+        // // Two sides with sequential tracks
+        // unsigned track_index = track * m_format.heads + head;
+        // track_index = transform_index(track_index, m_format.heads * m_format.tracks - 1);
+        // const unsigned new_head = track_index & 1;
+        // const unsigned new_track = track_index >> 1;
+        // return m_loader->bad_sectors().count(
+        //     bad_sector_key(
+        //             new_head,
+        //             new_track,
+        //             physical_sector(sector+m_format.sector_base)
+        //     )
+        // ) > 0;
+    }
+    // Loaders record bad sectors by their place in the track, numbered from sector_base
+    bool diskImage::is_bad_raw_sector(const unsigned head, const unsigned track, const unsigned index)
+    {
+        materialize_all();
+        return m_loader->bad_sectors().count(bad_sector_key(head, track, index + m_format.sector_base)) > 0;
+    }
+
+    void diskImage::logical_to_physical(unsigned & head, unsigned & track, unsigned & sector) const {
+        if (m_format.heads == 2 && !m_format.sides_interleaved) {
+            unsigned track_index = track * m_format.heads + head;
+            track_index = transform_index(track_index, m_format.heads * m_format.tracks - 1);
+            head = track_index & 1;
+            track = track_index >> 1;
+        }
+        sector = physical_sector(sector+m_format.sector_base);
+    }
+
+
+    Result diskImage::check()
+    {
+        return Result::ok();
+    }
+
+}
@@ -10,6 +10,8 @@
 
 #include "definitions.h"
 #include "loader.h"
+#include "mapped_file.h"
+#include "read_timing.h"
 
 namespace dsk_tools {
 
@@ -17,9 +19,19 @@ namespace dsk_tools {
         protected:
             std::string m_type_id;
             BYTES m_buffer;
+            std::unique_ptr<MappedFile> m_mapping;                              // Copy-on-write sectors of a raw image, replaces m_buffer
+            size_t m_mapping_offset;
+            size_t m_mapping_size;
             std::unique_ptr<Loader> m_loader;
             DiskFormatParams m_format;
             bool m_is_loaded;
+            bool m_lazy;
+            std::vector<uint8_t> m_track_loaded;                                // Lazy mode: per track of m_buffer, empty otherwise
+            std::vector<uint8_t> m_track_dirty;                                 // Per track of m_buffer, written to since load()
+            size_t m_track_size;
+            Result m_lazy_result;                                               // The first error of on-demand decoding
+            std::shared_ptr<Progress> m_progress;
+            std::vector<SectorRead> * m_read_trace;
 
         public:
             explicit diskImage(std::unique_ptr<Loader> loader);
@@ -30,7 +42,18 @@ namespace dsk_tools {
             virtual unsigned physical_sector(unsigned logical) const;
             virtual Result check();                                            // Check physical image parameters
             virtual Result load();
+            Result load(std::shared_ptr<Source> source);                       // Reads the source instead of the loader's file
             virtual uint8_t *get_sector_data(unsigned head, unsigned track, unsigned sector);      // Uses sector translation
+            // The same for a sector about to be changed; filesystems use it, or mark_dirty(), for every write
+            uint8_t * get_sector_for_write(unsigned head, unsigned track, unsigned sector);
+            void mark_dirty(unsigned head, unsigned track, unsigned sector);
+            bool is_dirty() const;
+            bool is_track_dirty(unsigned head, unsigned track) const;          // Same coordinates as get_sector_data()
+            bool is_range_dirty(size_t offset, size_t size) const;             // Any track of the sectors data in the range
+            void clear_dirty();                                                 // The changes are saved
+            // Every get_sector_data() call is added to the trace, with the coordinates of the sectors buffer,
+            // i.e. to time loading a file with simulate_reads(); nullptr stops it
+            void trace_reads(std::vector<SectorRead> * trace) {m_read_trace = trace;};
 
             std::string file_name() {return m_loader->get_file_name();};
             bool get_loaded() const {return m_is_loaded;};
@@ -46,9 +69,29 @@ namespace dsk_tools {
             unsigned get_floppyinterfacemode() const {return m_format.floppyinterfacemode;};
             std::vector<unsigned> get_sector_translation() const {return m_format.sector_translation;};
             std::string get_type_id() {return m_type_id;};
-            BYTES * get_buffer() {return &m_buffer;};
-            bool has_bad_sectors() const;
-            bool is_bad_sector(unsigned head, unsigned track, unsigned sector) const;
+            std::string get_format_id() {return m_loader->get_format_id();};
+            Result read_raw_track(int track, BYTES & out) {return m_loader->read_raw_track(track, out);};   // See Loader
+            BYTES * get_buffer();                                              // Copies mapped data into m_buffer first; errors: materialize_all()
+            Result get_data(const uint8_t * & data, size_t & size);            // All the sectors, mapped or not, without copying
+            // Bad sectors are known once their tracks are decoded, these decode all the tracks not accessed yet
+            bool has_bad_sectors();
+            bool is_bad_sector(unsigned head, unsigned track, unsigned sector);
+            bool is_bad_raw_sector(unsigned head, unsigned track, unsigned index);   // By its place in the track, untranslated
             void logical_to_physical(unsigned & head, unsigned & track, unsigned & sector) const;
+            bool is_mapped() const {return m_mapping != nullptr;};
+            void set_lazy(bool lazy) {m_lazy = lazy;};                          // Decode tracks on first access, takes effect on load()
+            bool is_lazy() const {return !m_track_loaded.empty();};
+            Result materialize_all();                                           // Decodes all tracks not accessed yet
+            Result lazy_result() const {return m_lazy_result;};                 // Of the tracks decoded so far
+            // Loading and materialize_all() report every track and stop when it is cancelled; the loader shares it
+            void set_progress(std::shared_ptr<Progress> progress);
+            Progress * get_progress() const {return m_progress.get();};
+
+        protected:
+            virtual unsigned buffer_track(unsigned head, unsigned track) const;   // Must agree with get_sector_data()
+            uint8_t * sectors_data();
+            size_t sectors_size() const;
+            Result check_loaded_size(size_t buffer_size);
+            void load_tracks(size_t offset, size_t size);
     };
 }
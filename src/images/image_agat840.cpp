@@ -22,5 +22,10 @@ namespace dsk_tools {
         return diskImage::get_sector_data(track & 1, track >> 1, sector);
     }
 
+    unsigned imageAgat840::buffer_track(unsigned head, unsigned track) const
+    {
+        return diskImage::buffer_track(track & 1, track >> 1);
+    }
+
 
 }
@@ -15,6 +15,9 @@ namespace dsk_tools {
     public:
         imageAgat840(std::unique_ptr<Loader> loader);
         uint8_t *get_sector_data(unsigned head, unsigned track, unsigned sector) override;
+
+    protected:
+        unsigned buffer_track(unsigned head, unsigned track) const override;
     };
 
 }
@@ -13,5 +13,6 @@ namespace dsk_tools {
     public:
         explicit imageFIL(std::unique_ptr<Loader> loader);
         Result load() override;
+        using diskImage::load;
     };
 }
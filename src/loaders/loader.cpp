@@ -4,6 +4,8 @@
 // Description: Top level abstract class for all loaders
 
 #include "loader.h"
+#include "mapped_file.h"
+#include "source.h"
 
 namespace dsk_tools {
     Loader::Loader(const std::string & file_name, const std::string & format_id, const std::string & type_id):
@@ -13,4 +15,48 @@ namespace dsk_tools {
         , loaded(false)
     {}
 
+    Result Loader::open_input(MappedFile & file, bool copy_on_write)
+    {
+        if (m_source) return file.open(*m_source, copy_on_write);
+        return file.open(file_name, copy_on_write);
+    }
+
+    Result Loader::open_input(FileReader & file)
+    {
+        if (m_source) return file.open(m_source);
+        return file.open(file_name);
+    }
+
+    void Loader::merge_bad_sectors(const BadSectorTable & table)
+    {
+        if (table.empty()) return;
+        std::lock_guard<std::mutex> lock(m_bad_mutex);
+        m_bad_sectors.insert(table.begin(), table.end());
+    }
+
+    Result Loader::map(MappedFile & mapping, size_t & offset, size_t & size, const DiskFormatParams &format)
+    {
+        return Result::error(ErrorCode::NotImplementedYet, "Format can't be mapped");
+    }
+
+    Result Loader::open_lazy(size_t & buffer_size, size_t & track_size, const DiskFormatParams &format)
+    {
+        return Result::error(ErrorCode::NotImplementedYet, "Format can't be loaded on demand");
+    }
+
+    Result Loader::load_track(int track, uint8_t * buffer)
+    {
+        return Result::error(ErrorCode::NotImplementedYet, "Format can't be loaded on demand");
+    }
+
+    Result Loader::verify(VerifyReport & report)
+    {
+        return Result::error(ErrorCode::NotImplementedYet, "Format has no checksums");
+    }
+
+    Result Loader::read_raw_track(int track, BYTES & out)
+    {
+        return Result::error(ErrorCode::NotImplementedYet, "Format has no encoded tracks");
+    }
+
 }
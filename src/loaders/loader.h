@@ -6,12 +6,20 @@
 
 
 #include <cstdint>
+#include <memory>
+#include <mutex>
 #include <string>
 
 #include "definitions.h"
+#include "progress.h"
 
 namespace dsk_tools {
 
+    class MappedFile;
+    class FileReader;
+    class Source;
+    struct VerifyReport;
+
     class Loader
     {
         protected:
@@ -20,6 +28,15 @@ namespace dsk_tools {
             std::string             type_id;
             bool                    loaded;
             BadSectorTable          m_bad_sectors;
+            std::mutex              m_bad_mutex;            // load_track() adds to m_bad_sectors from several threads
+            std::shared_ptr<Source> m_source;               // Read instead of file_name if set
+            std::shared_ptr<Progress> m_progress;           // Track loops report to it and stop when it is cancelled
+
+            // The source if there is one, the file otherwise
+            Result open_input(MappedFile & file, bool copy_on_write = false);
+            Result open_input(FileReader & file);
+            // The bad sectors of a track decoded by load_track()
+            void merge_bad_sectors(const BadSectorTable & table);
 
         public:
             Loader(const std::string & file_name, const std::string & format_id, const std::string & type_id);
@@ -27,10 +44,28 @@ namespace dsk_tools {
 
             std::string get_file_name() {return file_name;};
             std::string get_type_id() {return type_id;};
+            std::string get_format_id() {return format_id;};
+            // All of them after load(); with open_lazy() only those of the tracks loaded so far
             const BadSectorTable & bad_sectors() const { return m_bad_sectors; };
+            // file_name is then only a name for reports and the format detection
+            void set_source(std::shared_ptr<Source> source) {m_source = std::move(source);};
+            void set_progress(std::shared_ptr<Progress> progress) {m_progress = std::move(progress);};
 
             virtual Result load(BYTES & buffer, const DiskFormatParams &format = DiskFormatParams()) = 0;
             virtual std::string file_info() = 0;
+            // Maps the file instead of loading it, if sector data is stored there as is;
+            // on success [offset, offset+size) of the mapping is the sector buffer
+            virtual Result map(MappedFile & mapping, size_t & offset, size_t & size, const DiskFormatParams &format = DiskFormatParams());
+            // On-demand decoding: the sector buffer of buffer_size bytes consists of tracks of track_size bytes,
+            // load_track() decodes one of them in place. Different tracks may be loaded from different threads
+            virtual Result open_lazy(size_t & buffer_size, size_t & track_size, const DiskFormatParams &format = DiskFormatParams());
+            virtual Result load_track(int track, uint8_t * buffer);
+            // Checks the sector checksums straight from the file, nothing is decoded into a buffer.
+            // Formats which store no checksums return NotImplementedYet
+            virtual Result verify(VerifyReport & report);
+            // The encoded bytes of one side of a track as they are stored in the container, for copying them
+            // to another container without decoding. Tracks are numbered track*heads + head
+            virtual Result read_raw_track(int track, BYTES & out);
     };
 
 }
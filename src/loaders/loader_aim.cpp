@@ -3,74 +3,84 @@
 // Part of the dsk_tools project: https://github.com/Ptr314/dsk_tools
 // Description: A loader class for AIM (Agat 840 Kb psysical images)
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 
 #include "host_helpers.h"
 
+#include "agat_mfm.h"
 #include "loader_aim.h"
+#include "mapped_file.h"
+#include "pattern_scan.h"
 #include "utils.h"
 
 namespace dsk_tools {
-LoaderAIM::LoaderAIM(const std::string &file_name, const std::string &format_id, const std::string &type_id):
-        Loader(file_name, format_id, type_id)
-    {}
 
-    bool LoaderAIM::iterate_until(const std::vector<uint16_t> & in, int & p, const uint8_t v)
+    static const int AIM_TRACKS = 160;
+    static const int AIM_SECTORS = 21;
+
+    // Moves in_p (in words) to the data field of the next sector
+    static Result find_data_field(const uint8_t * in, int in_size, int & in_p)
     {
-        uint16_t b;
-        uint8_t d;
-        do {
-            if (p >= in.size()) return false;
-            b = in.at(p++);
-            d = b & 0xFF;
-        } while (d != v);
-        return true;
+        // Index; bytes of the marks are searched one by one
+        if (!skip_past_words(in, in_size, in_p, &agat_840_address_mark[0], 1)) return Result::error(ErrorCode::LoadDataCorrupt, "Invalid index mark");
+        if (!skip_past_words(in, in_size, in_p, &agat_840_address_mark[1], 1)) return Result::error(ErrorCode::LoadDataCorrupt, "Invalid index mark");
+        // VTS
+        // uint8_t r_v = word(in_p++) & 0xFF;
+        // uint8_t r_t = word(in_p++) & 0xFF;
+        // uint8_t r_s = word(in_p++) & 0xFF;
+        in_p += 3;
+        // Data mark
+        if (!skip_past_words(in, in_size, in_p, &agat_840_data_mark[0], 1)) return Result::error(ErrorCode::LoadDataCorrupt, "Invalid data mark");
+        if (!skip_past_words(in, in_size, in_p, &agat_840_data_mark[1], 1)) return Result::error(ErrorCode::LoadDataCorrupt, "Invalid data mark");
+        if (in_p + 256 > in_size) return Result::error(ErrorCode::LoadDataCorrupt, "Unexpected end of data");
+        return Result::ok();
     }
 
-    Result LoaderAIM::load(BYTES & buffer, const DiskFormatParams &format)
+    // The checksum is the low byte of the word after the data; data is the field already copied out
+    static bool data_crc_ok(const uint8_t * in, int in_size, int data_pos, const uint8_t * data)
     {
-        UTF8_ifstream file(file_name, std::ios::binary);
+        return data_pos + 256 < in_size && in[2 * (data_pos + 256)] == agat_840_checksum(data, 256);
+    }
 
-        if (!file.good()) {
-            return Result::error(ErrorCode::LoadError, "Cannot open file");
-        }
+LoaderAIM::LoaderAIM(const std::string &file_name, const std::string &format_id, const std::string &type_id):
+        Loader(file_name, format_id, type_id)
+        , m_scan_pos(0)
+    {}
 
-        file.seekg (0, std::ios::end);
-        auto fsize = file.tellg();
-        file.seekg (0, std::ios::beg);
+    Result LoaderAIM::load(BYTES & buffer, const DiskFormatParams &format)
+    {
+        MappedFile file;
+        Result res = open_input(file);
+        if (!res) return res;
 
-        int image_size = 160*21*256;
+        int image_size = AIM_TRACKS*AIM_SECTORS*256;
         buffer.resize(image_size);
 
-        std::vector<uint16_t> in(fsize/2);
-
-        file.read (reinterpret_cast<char*>(in.data()), fsize);
+        // 16-bit little-endian words: the low byte is data, the high one is a controller command
+        const uint8_t * in = file.data();
+        const int in_size = file.size() / 2;
 
         int in_p = 0;
         int out_p = 0;
-
-        for (int track=0; track<160; track++) {
-            for (int sector=0; sector<21; sector++) {
-                // Index
-                if (!iterate_until(in, in_p, 0x95)) return Result::error(ErrorCode::LoadDataCorrupt, "Invalid index mark");
-                if (!iterate_until(in, in_p, 0x6A)) return Result::error(ErrorCode::LoadDataCorrupt, "Invalid index mark");
-                // VTS
-                // uint8_t r_v = in.at(in_p++) & 0xFF;
-                // uint8_t r_t = in.at(in_p++) & 0xFF;
-                // uint8_t r_s = in.at(in_p++) & 0xFF;
-                in_p += 3;
-                // Data mark
-                if (!iterate_until(in, in_p, 0x6A)) return Result::error(ErrorCode::LoadDataCorrupt, "Invalid data mark");
-                if (!iterate_until(in, in_p, 0x95)) return Result::error(ErrorCode::LoadDataCorrupt, "Invalid data mark");
+        m_bad_sectors.clear();
+
+        progress_start(m_progress.get(), ProgressStage::Load, AIM_TRACKS);
+        for (int track=0; track<AIM_TRACKS; track++) {
+            if (is_cancelled(m_progress.get())) return Result::error(ErrorCode::Cancelled, "Loading cancelled");
+            for (int sector=0; sector<AIM_SECTORS; sector++) {
+                res = find_data_field(in, in_size, in_p);
+                if (!res) return res;
                 // Data
-                for (int i=0; i<256; i++) {
-                    if (in_p >= in.size()) return Result::error(ErrorCode::LoadDataCorrupt, "Unexpected end of data");
-                    uint16_t b = in.at(in_p++);
-                    uint8_t  d = b & 0xFF;
-                    buffer[out_p++] = d;
-                }
+                for (int i=0; i<256; i++)
+                    buffer[out_p + i] = in[2 * (in_p + i)];
+                if (!data_crc_ok(in, in_size, in_p, &buffer[out_p]))
+                    m_bad_sectors.insert(bad_sector_key(track & 1, track >> 1, sector));
+                in_p += 256;
+                out_p += 256;
             }
+            progress_step(m_progress.get());
         }
 
         loaded = true;
@@ -78,20 +88,73 @@ LoaderAIM::LoaderAIM(const std::string &file_name, const std::string &format_id,
         return Result::ok();
     }
 
+    Result LoaderAIM::open_lazy(size_t & buffer_size, size_t & track_size, const DiskFormatParams &format)
+    {
+        if (m_file.data() == nullptr) {
+            Result res = open_input(m_file);
+            if (!res) return res;
+            m_data_pos.clear();
+            m_scan_pos = 0;
+        }
+        m_bad_sectors.clear();
+
+        track_size = AIM_SECTORS*256;
+        buffer_size = AIM_TRACKS*track_size;
+        return Result::ok();
+    }
+
+    Result LoaderAIM::scan_sectors(size_t count)
+    {
+        const uint8_t * in = m_file.data();
+        const int in_size = m_file.size() / 2;
+        while (m_data_pos.size() < count) {
+            Result res = find_data_field(in, in_size, m_scan_pos);
+            if (!res) return res;
+            m_data_pos.push_back(m_scan_pos);
+            m_scan_pos += 256;
+        }
+        return Result::ok();
+    }
+
+    Result LoaderAIM::load_track(int track, uint8_t * buffer)
+    {
+        if (m_file.data() == nullptr || track < 0 || track >= AIM_TRACKS)
+            return Result::error(ErrorCode::IncorrectRequest, "Track is not available");
+
+        int data_pos[AIM_SECTORS];
+        {
+            // Only the search is serialized, the data is copied outside of the lock
+            std::lock_guard<std::mutex> lock(m_scan_mutex);
+            Result res = scan_sectors(static_cast<size_t>(track + 1) * AIM_SECTORS);
+            if (!res) return res;
+            std::copy(m_data_pos.begin() + track*AIM_SECTORS, m_data_pos.begin() + (track + 1)*AIM_SECTORS, data_pos);
+        }
+
+        const uint8_t * in = m_file.data();
+        const int in_size = m_file.size() / 2;
+        uint8_t * out = buffer + track*AIM_SECTORS*256;
+        BadSectorTable bad;
+        for (int sector=0; sector<AIM_SECTORS; sector++, out += 256) {
+            for (int i=0; i<256; i++)
+                out[i] = in[2 * (data_pos[sector] + i)];
+            if (!data_crc_ok(in, in_size, data_pos[sector], out))
+                bad.insert(bad_sector_key(track & 1, track >> 1, sector));
+        }
+        merge_bad_sectors(bad);
+        return Result::ok();
+    }
+
     std::string LoaderAIM::file_info()
     {
         std::string result = "";
 
-        UTF8_ifstream file(file_name, std::ios::binary);
-
-        if (!file.good()) {
+        MappedFile file;
+        if (!open_input(file)) {
             result += "{$ERROR_OPENING}:\n";
             return result;
         }
 
-        file.seekg (0, std::ios::end);
-        auto fsize = file.tellg();
-        file.seekg (0, std::ios::beg);
+        const size_t fsize = file.size();
 
         size_t pos = file_name.find_last_of("/\\");
         std::string file_short = (pos == std::string::npos) ? file_name : file_name.substr(pos + 1);
@@ -99,9 +162,12 @@ LoaderAIM::LoaderAIM(const std::string &file_name, const std::string &format_id,
         result += "{$SIZE}: " + std::to_string(fsize) + " {$BYTES}\n";
 
 
-        std::vector<uint16_t> in(fsize/2);
-
-        file.read (reinterpret_cast<char*>(in.data()), fsize);
+        // 16-bit little-endian words, read from the mapping as load() does; 0 past the end of the file
+        const uint8_t * in_bytes = file.data();
+        const int in_size = fsize / 2;
+        auto word = [&](int p) -> uint16_t {
+            return (p < in_size) ? static_cast<uint16_t>(in_bytes[2 * p] | (in_bytes[2 * p + 1] << 8)) : 0;
+        };
 
         int in_p = 0;
         int track_len = 6464;
@@ -110,26 +176,20 @@ LoaderAIM::LoaderAIM(const std::string &file_name, const std::string &format_id,
         bool errors = false;
         for (int track=0; track<160; track++) {
             int in_base = track * track_len;
+            const int track_end = std::min(in_base+track_len, in_size);
             in_p = in_base;
             result += "{$TRACK}: " + std::to_string(track) + "\n";
-            while (in_p < in_base+track_len) {
+            while (in_p < track_end) {
                 // Looking for Index Mark
-                bool index_found = false;
-                while (in_p < in_base+track_len) {
-                    if (!iterate_until(in, in_p, 0x95)) break;
-                    if (in_p < in_base+track_len) {
-                        uint8_t b = in.at(in_p++) & 0xFF;
-                        if (b == 0x6A) {index_found = true; break;};
-                    }
-                }
+                bool index_found = skip_past_words(in_bytes, track_end, in_p, agat_840_address_mark, sizeof(agat_840_address_mark));
                 if (index_found) {
                     // VTS
                     result += "    $" + dsk_tools::int_to_hex(static_cast<uint32_t>(in_p*2 - 2)) + " {$INDEX_MARK} ($95 $6A)\n";
                     result += "    $" + dsk_tools::int_to_hex(static_cast<uint32_t>(in_p*2)) + " {$SECTOR_INDEX}:";
-                    uint8_t r_v = in.at(in_p++) & 0xFF;
-                    uint8_t r_t = in.at(in_p++) & 0xFF;
-                    uint8_t r_s = in.at(in_p++) & 0xFF;
-                    uint8_t r_e = in.at(in_p++) & 0xFF;
+                    uint8_t r_v = word(in_p++) & 0xFF;
+                    uint8_t r_t = word(in_p++) & 0xFF;
+                    uint8_t r_s = word(in_p++) & 0xFF;
+                    uint8_t r_e = word(in_p++) & 0xFF;
                     result += " {$VOLUME_ID}=" + std::to_string(r_v) + " ($" + dsk_tools::int_to_hex(r_v) + ")";
                     result += ", {$TRACK_SHORT}=" + std::to_string(r_t);
                     result += ", {$LOGICAL_SECTOR}=" + std::to_string(r_s);
@@ -139,33 +199,27 @@ LoaderAIM::LoaderAIM(const std::string &file_name, const std::string &format_id,
                         result += ", {$SECTOR_INDEX_END_ERROR}";
                     }
                     result += "\n";
-                    // Data mark
-                    bool data_found = false;
-                    while (in_p < in_base+track_len) {
-                        if (!iterate_until(in, in_p, 0x6A)) break;
-                        uint8_t b = in.at(in_p++) & 0xFF;
-                        if (b == 0x95) {data_found = true; break;};
-                    };
+                    // Data mark, may run into the next track
+                    bool data_found = (in_p < track_end) && skip_past_words(in_bytes, in_size, in_p, agat_840_data_mark, sizeof(agat_840_data_mark));
                     if (data_found) {
                         // Data
                         result += "    $" + dsk_tools::int_to_hex(static_cast<uint32_t>(in_p*2-2)) + " {$DATA_MARK} ($6A $95)\n";
                         result += "    $" + dsk_tools::int_to_hex(static_cast<uint32_t>(in_p*2)) + " {$DATA_FIELD} (256)\n";
-                        uint16_t crc = 0;
+                        uint8_t data[256];
                         error = false;
                         for (int i=0; i<256; i++) {
-                            if (in_p >= in_base+track_len) {error = true; break;};
-                            uint8_t  d = in.at(in_p++) & 0xFF;
-                            if (crc > 0xFF) crc = (crc + 1) & 0xFF;
-                            crc += d;
+                            if (in_p >= track_end) {error = true; break;};
+                            data[i] = word(in_p++) & 0xFF;
                         }
                         if (!error) {
+                            const uint8_t crc = agat_840_checksum(data, sizeof(data));
                             result += "    $" + dsk_tools::int_to_hex(static_cast<uint32_t>(in_p*2));
-                            uint8_t r_crc = in.at(in_p++) & 0xFF;
-                            if (r_crc == (crc & 0xFF)) {
+                            uint8_t r_crc = word(in_p++) & 0xFF;
+                            if (r_crc == crc) {
                                 result += " {$SECTOR_CRC_OK} ($" + dsk_tools::int_to_hex(r_crc) + ")";
                             } else {
                                 errors = true;
-                                result += " {$SECTOR_CRC_ERROR} ({$CRC_EXPECTED}: $" + dsk_tools::int_to_hex(static_cast<uint8_t>(crc & 0xFF)) + ", {$CRC_FOUND}: $" + dsk_tools::int_to_hex(r_crc) + ")";
+                                result += " {$SECTOR_CRC_ERROR} ({$CRC_EXPECTED}: $" + dsk_tools::int_to_hex(crc) + ", {$CRC_FOUND}: $" + dsk_tools::int_to_hex(r_crc) + ")";
                             }
                         } else {
                             result += " {$SECTOR_ERROR}";
@@ -176,7 +230,7 @@ LoaderAIM::LoaderAIM(const std::string &file_name, const std::string &format_id,
                 }
             }
             for (int i=0; i<track_len; i++) {
-                uint8_t hi = in.at(i) >> 8;
+                uint8_t hi = word(i) >> 8;
                 if (hi != 0) {
                     result += "    Command[$" + dsk_tools::int_to_hex(static_cast<uint16_t>(i*2)) + "] = $" + dsk_tools::int_to_hex(hi) + "\n";
                 }
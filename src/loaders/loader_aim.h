@@ -5,20 +5,32 @@
 #pragma once
 
 
+#include <mutex>
+#include <vector>
+
 #include "loader.h"
+#include "mapped_file.h"
 
 namespace dsk_tools {
 
     class LoaderAIM:public Loader
     {
-    private:
-        bool iterate_until(const std::vector<uint16_t> &in, int &p, const uint8_t v);
     protected:
         bool msb_first;
+        MappedFile m_file;                                  // Kept open between load_track() calls
+        // Sectors follow each other without track boundaries, so the data fields are found
+        // one after another and their word positions are kept for the following calls
+        std::vector<int> m_data_pos;
+        int m_scan_pos;
+        std::mutex m_scan_mutex;
+
+        Result scan_sectors(size_t count);
     public:
         LoaderAIM(const std::string & file_name, const std::string & format_id, const std::string & type_id);
         virtual ~LoaderAIM() = default;
         Result load(BYTES & buffer, const DiskFormatParams &format = DiskFormatParams()) override;
+        Result open_lazy(size_t & buffer_size, size_t & track_size, const DiskFormatParams &format = DiskFormatParams()) override;
+        Result load_track(int track, uint8_t * buffer) override;
         std::string file_info() override;
     };
 
@@ -9,6 +9,7 @@
 #include "host_helpers.h"
 
 #include "loader_fil.h"
+#include "mapped_file.h"
 
 namespace dsk_tools {
     LoaderFIL::LoaderFIL(const std::string &file_name, const std::string &format_id, const std::string &type_id):
@@ -17,20 +18,12 @@ namespace dsk_tools {
 
     Result LoaderFIL::load(BYTES &buffer, const DiskFormatParams &format)
     {
-        UTF8_ifstream file(file_name, std::ios::binary);
-
-        if (!file.good()) {
+        MappedFile file;
+        if (!open_input(file)) {
             return Result::error(ErrorCode::LoadError, "Cannot open file");
         }
 
-        file.seekg (0, std::ios::end);
-        auto fsize = file.tellg();
-        file.seekg (0, std::ios::beg);
-
-        unsigned image_size = fsize;
-
-        buffer.resize(image_size);
-        file.read (reinterpret_cast<char*>(buffer.data()), image_size);
+        buffer.assign(file.data(), file.data() + file.size());
 
         loaded = true;
 
@@ -41,16 +34,13 @@ namespace dsk_tools {
     {
         std::string result = "";
 
-        UTF8_ifstream file(file_name, std::ios::binary);
-
-        if (!file.good()) {
+        FileReader file;
+        if (!open_input(file)) {
             result += "{$ERROR_OPENING}\n";
             return result;
         }
 
-        file.seekg (0, std::ios::end);
-        auto fsize = file.tellg();
-        file.seekg (0, std::ios::beg);
+        const uint64_t fsize = file.size();
 
         size_t pos = file_name.find_last_of("/\\");
         std::string file_short = (pos == std::string::npos) ? file_name : file_name.substr(pos + 1);
@@ -3,9 +3,8 @@
 // Part of the dsk_tools project: https://github.com/Ptr314/dsk_tools
 // Description: A loader class for .HFE files
 
-#include <cmath>
-#include <fstream>
-#include <iostream>
+#include <algorithm>
+#include <cstring>
 
 #include "host_helpers.h"
 
@@ -13,127 +12,281 @@
 #include "definitions.h"
 #include "utils.h"
 #include "loader_hxc_hfe.h"
+#include "mapped_file.h"
+#include "thread_pool.h"
+#include "track_scan.h"
 
 namespace dsk_tools {
 LoaderHXC_HFE::LoaderHXC_HFE(const std::string &file_name, const std::string &format_id, const std::string &type_id):
         Loader(file_name, format_id, type_id)
+        , m_header()
+        , m_sectors_per_track(0)
+        , m_tracks_open(false)
+        , m_scanned(false)
+        , m_raw_cylinder(-1)
     {}
 
-    Result LoaderHXC_HFE::load(BYTES &buffer, const DiskFormatParams &format)
+    Result LoaderHXC_HFE::read_header()
     {
-        UTF8_ifstream file(file_name, std::ios::binary);
-
-        if (!file.good()) {
-            return Result::error(ErrorCode::LoadError, "Cannot open file");
+        if (!m_file.is_open()) {
+            Result res = open_input(m_file);
+            if (!res) return res;
         }
+        if (m_file.size() < sizeof(HXC_HFE_HEADER))
+            return Result::error(ErrorCode::LoadIncorrectFile, "File too small");
+        return m_file.read_at(0, reinterpret_cast<uint8_t*>(&m_header), sizeof(HXC_HFE_HEADER));
+    }
 
-        file.seekg (0, std::ios::end);
-        auto fsize = file.tellg();
-        file.seekg (0, std::ios::beg);
-
-        BYTES in(fsize);
-        bool errors = false;
-
-        file.read (reinterpret_cast<char*>(in.data()), fsize);
+    bool LoaderHXC_HFE::has_signature() const
+    {
+        std::string signature(reinterpret_cast<const char*>(&m_header.HEADERSIGNATURE), sizeof(m_header.HEADERSIGNATURE));
+        return signature == "HXCPICFE";
+    }
 
-        HXC_HFE_HEADER * hdr = reinterpret_cast<HXC_HFE_HEADER*>(in.data());
+    Result LoaderHXC_HFE::read_track_list()
+    {
+        m_tracks.resize(m_header.number_of_track);
+        Result res = m_file.read_at(
+            static_cast<uint64_t>(m_header.track_list_offset) * HXC_HFE_BLOCK_SIZE,
+            reinterpret_cast<uint8_t*>(m_tracks.data()),
+            m_tracks.size() * sizeof(HXC_HFE_TRACK)
+        );
+        if (!res) {
+            m_tracks.clear();
+            return Result::error(ErrorCode::LoadIncorrectFile, "Track list is out of file bounds");
+        }
+        return Result::ok();
+    }
 
-        std::string signature(reinterpret_cast<char*>(&hdr->HEADERSIGNATURE), sizeof(hdr->HEADERSIGNATURE));
+    Result LoaderHXC_HFE::open_tracks()
+    {
+        if (m_tracks_open) return Result::ok();
 
-        if (signature != "HXCPICFE") return Result::error(ErrorCode::LoadIncorrectFile, "Invalid HFE signature");
+        Result res = read_header();
+        if (!res) return res;
 
-        int image_size, sectors_per_track, s_size;
+        if (!has_signature()) return Result::error(ErrorCode::LoadIncorrectFile, "Invalid HFE signature");
 
         if (type_id == "TYPE_AGAT_840") {
-            if (hdr->number_of_side != 2 || hdr->number_of_track != 80)
+            if (m_header.number_of_side != 2 || m_header.number_of_track != 80)
                 return Result::error(ErrorCode::LoadIncorrectFile, "Invalid HFE parameters");
-            sectors_per_track = 21;
-            s_size = 256;
-            image_size = 2*80*sectors_per_track*s_size;
+            m_sectors_per_track = 21;
         } else
             return Result::error(ErrorCode::LoadIncorrectFile, "Unsupported disk type");
 
-        buffer.resize(image_size);
+        res = read_track_list();
+        if (!res) return res;
+
+        m_tracks_open = true;
+        return Result::ok();
+    }
+
+    Result LoaderHXC_HFE::read_track(int track, TrackScratch & sc)
+    {
+        const int sides = m_header.number_of_side;
+        const int half = HXC_HFE_BLOCK_SIZE / 2;
+        const int blocks = (m_tracks[track].track_len + HXC_HFE_BLOCK_SIZE - 1) / HXC_HFE_BLOCK_SIZE;
 
+        sc.mixed.resize(blocks * HXC_HFE_BLOCK_SIZE);
+        Result res = m_file.read_at(static_cast<uint64_t>(m_tracks[track].offset) * HXC_HFE_BLOCK_SIZE, sc.mixed.data(), sc.mixed.size());
+        if (!res) return res;
 
-        int tracklist_offset = hdr->track_list_offset*HXC_HFE_BLOCK_SIZE;
+        sc.sides.resize(sides);
+        if (sides == 1) {
+            sc.sides[0].swap(sc.mixed);
+            return Result::ok();
+        }
 
-        std::vector<HXC_HFE_TRACK*> ti(hdr->number_of_track);
+        // Every block holds 256 bytes of side 0 followed by 256 bytes of side 1
+        for (int s=0; s < sides; s++ )
+            sc.sides[s].resize(blocks * half);
+        const uint8_t * block = sc.mixed.data();
+        for (int i=0; i < blocks; i++, block += HXC_HFE_BLOCK_SIZE)
+            for (int s=0; s < sides; s++ )
+                std::memcpy(sc.sides[s].data() + i * half, block + s * half, half);
+        return Result::ok();
+    }
 
-        for (int track=0; track < hdr->number_of_track; track++)
-            ti[track] = reinterpret_cast<HXC_HFE_TRACK *>(in.data() + tracklist_offset + track * sizeof(HXC_HFE_TRACK));
+    Result LoaderHXC_HFE::decode_cylinder(int track, uint8_t * out, TrackScratch & sc, TrackScan * scans)
+    {
+        Result res = read_track(track, sc);
+        if (!res) return res;
 
-        for (int track=0; track<hdr->number_of_track; track++) {
-            int in_base = ti[track]->offset*HXC_HFE_BLOCK_SIZE;
-            // TODO: remove float operations, use (a + b - 1) / b
-            int mixed_track_len = std::ceil(static_cast<double>(ti[track]->track_len) / HXC_HFE_BLOCK_SIZE) * HXC_HFE_BLOCK_SIZE;
-
-            BYTES track_mixed(in.begin() + in_base, in.begin() + in_base + mixed_track_len);
-            std::vector<BYTES> track_mfm(hdr->number_of_side);
-            if (hdr->number_of_side == 1) {
-                track_mfm[0] = track_mixed;
-            } else {
-                for (int i=0; i < mixed_track_len / HXC_HFE_BLOCK_SIZE; i++)
-                    for (int s=0; s < hdr->number_of_side; s++ ) {
-                        auto part_base = track_mixed.begin() + i*HXC_HFE_BLOCK_SIZE + s*(HXC_HFE_BLOCK_SIZE/2);
-                        track_mfm[s].insert(track_mfm[s].end(), part_base, part_base + HXC_HFE_BLOCK_SIZE / 2);
-                    }
+        bool errors = false;
+        const int side_size = m_sectors_per_track * 256;
+        sc.sectors.resize(side_size);
+        for (int s=0; s < m_header.number_of_side; s++ ) {
+            sc.track_data.resize(sc.sides[s].size() / 2);
+            decode_agat_mfm(sc.sides[s].data(), sc.track_data.data(), sc.track_data.size());
+
+            TrackScan * scan = (scans != nullptr) ? &scans[s] : nullptr;
+            if (out == nullptr) {
+                if (!decode_agat_840_track(nullptr, sc.track_data.data(), sc.track_data.size(), scan))
+                    errors = true;
+                continue;
             }
 
-            for (int s=0; s < hdr->number_of_side; s++ ) {
-                BYTES track_data;
-                decode_agat_mfm_data(track_data, track_mfm[s]);
-
-                BYTES raw_data;
-                Result res = decode_agat_840_track(raw_data, track_data);
-                if (res){
-                    std::copy(
-                        raw_data.begin(),
-                        raw_data.end(),
-                        buffer.begin() + (((track << 1) + s) * sectors_per_track) * s_size
-                    );
-                } else
-                    errors = true;
+            // A side with errors is returned empty
+            std::fill(sc.sectors.begin(), sc.sectors.end(), 0);
+            if (decode_agat_840_track(sc.sectors.data(), sc.track_data.data(), sc.track_data.size(), scan))
+                std::memcpy(out + s * side_size, sc.sectors.data(), side_size);
+            else {
+                std::memset(out + s * side_size, 0, side_size);
+                errors = true;
             }
         }
-        loaded = true;
-        if (!errors) {
-            return Result::ok();
-        } else {
+        if (errors)
             return Result::error(ErrorCode::LoadDataCorrupt, "Failed to decode track data");
+        return Result::ok();
+    }
+
+    Result LoaderHXC_HFE::open_lazy(size_t & buffer_size, size_t & track_size, const DiskFormatParams &format)
+    {
+        Result res = open_tracks();
+        if (!res) return res;
+        m_bad_sectors.clear();
+
+        track_size = cylinder_size();
+        buffer_size = cylinders() * track_size;
+        return Result::ok();
+    }
+
+    Result LoaderHXC_HFE::load_track(int track, uint8_t * buffer)
+    {
+        Result res = open_tracks();
+        if (!res) return res;
+        if (track < 0 || track >= cylinders())
+            return Result::error(ErrorCode::IncorrectRequest, "Cylinder out of range");
+
+        const int sides = m_header.number_of_side;
+        TrackScratch sc;
+        std::vector<TrackScan> scans(sides);
+        res = decode_cylinder(track, buffer + track * cylinder_size(), sc, scans.data());
+        BadSectorTable bad;
+        for (int s=0; s < sides; s++)
+            add_bad_sectors(bad, scans[s], s, track, m_sectors_per_track);
+        merge_bad_sectors(bad);
+        return res;
+    }
+
+    Result LoaderHXC_HFE::load_cylinder(int cylinder, uint8_t * out)
+    {
+        Result res = open_tracks();
+        if (!res) return res;
+        if (cylinder < 0 || cylinder >= cylinders())
+            return Result::error(ErrorCode::IncorrectRequest, "Cylinder out of range");
+        TrackScratch sc;
+        return decode_cylinder(cylinder, out, sc);
+    }
+
+    Result LoaderHXC_HFE::decode_all(uint8_t * out, std::vector<TrackScan> & scans)
+    {
+        const int sides = m_header.number_of_side;
+        scans.resize(cylinders() * sides);
+        for (TrackScan & scan : scans) scan.reset();
+
+        std::shared_ptr<ThreadPool> pool = decode_pool();
+        std::vector<TrackScratch> scratch(ThreadPool::slots(pool.get()));
+
+        // Every cylinder writes its own part of the buffer, its own scans and its own error flag,
+        // so the result does not depend on the decoding order
+        std::vector<uint8_t> track_errors(cylinders(), 0);
+
+        progress_start(m_progress.get(), ProgressStage::Load, cylinders());
+        ThreadPool::parallel_for(pool.get(), cylinders(), [&](int track, int slot) {
+            if (is_cancelled(m_progress.get())) return;
+            if (!decode_cylinder(track, (out != nullptr) ? out + track * cylinder_size() : nullptr, scratch[slot], &scans[track * sides]))
+                track_errors[track] = 1;
+            progress_step(m_progress.get());
+        });
+        if (is_cancelled(m_progress.get()))
+            return Result::error(ErrorCode::Cancelled, "Decoding cancelled");
+
+        for (uint8_t e : track_errors)
+            if (e) return Result::error(ErrorCode::LoadDataCorrupt, "Failed to decode track data");
+        return Result::ok();
+    }
+
+    Result LoaderHXC_HFE::load(BYTES &buffer, const DiskFormatParams &format)
+    {
+        Result res = open_tracks();
+        if (!res) return res;
+
+        buffer.assign(cylinders() * cylinder_size(), 0);
+        res = decode_all(buffer.data(), m_scans);
+        if (res.code == ErrorCode::Cancelled) {
+            m_scans.clear();
+            return res;
         }
+        m_scanned = true;
+
+        const int sides = m_header.number_of_side;
+        m_bad_sectors.clear();
+        for (int track=0; track < cylinders(); track++)
+            for (int s=0; s < sides; s++)
+                add_bad_sectors(m_bad_sectors, m_scans[track * sides + s], s, track, m_sectors_per_track);
+
+        loaded = true;
+        return res;
+    }
+
+    Result LoaderHXC_HFE::verify(VerifyReport & report)
+    {
+        Result res = open_tracks();
+        if (!res) return res;
+
+        std::vector<TrackScan> scans;
+        res = decode_all(nullptr, scans);
+        if (res.code == ErrorCode::Cancelled) return res;
+
+        const int sides = m_header.number_of_side;
+        report.reset(sides, cylinders(), m_sectors_per_track);
+        for (int track=0; track < cylinders(); track++)
+            for (int s=0; s < sides; s++)
+                verify_sectors(report, scans[track * sides + s], s, track);
+        return Result::ok();
+    }
+
+    Result LoaderHXC_HFE::read_raw_track(int track, BYTES & out)
+    {
+        Result res = open_tracks();
+        if (!res) return res;
+
+        const int sides = m_header.number_of_side;
+        const int cylinder = track / sides;
+        if (track < 0 || cylinder >= cylinders())
+            return Result::error(ErrorCode::IncorrectRequest, "Track out of range");
+
+        if (cylinder != m_raw_cylinder) {
+            m_raw_cylinder = -1;
+            res = read_track(cylinder, m_raw);
+            if (!res) return res;
+            m_raw_cylinder = cylinder;
+        }
+        out = m_raw.sides[track % sides];
+        return Result::ok();
     }
 
     std::string LoaderHXC_HFE::file_info()
     {
         std::string result = "";
 
-        UTF8_ifstream file(file_name, std::ios::binary);
-
-        if (!file.good()) {
+        if (!m_file.is_open() && !open_input(m_file)) {
             result += "{$ERROR_OPENING}:\n";
             return result;
         }
 
-        file.seekg (0, std::ios::end);
-        auto fsize = file.tellg();
-        file.seekg (0, std::ios::beg);
-
         size_t pos = file_name.find_last_of("/\\");
         std::string file_short = (pos == std::string::npos) ? file_name : file_name.substr(pos + 1);
         result += "{$FILE_NAME}: " + file_short + "\n";
-        result += "{$SIZE}: " + std::to_string(fsize) + " {$BYTES}\n";
+        result += "{$SIZE}: " + std::to_string(m_file.size()) + " {$BYTES}\n";
 
-        BYTES in(fsize);
         bool errors = false;
 
-        file.read (reinterpret_cast<char*>(in.data()), fsize);
-
-        HXC_HFE_HEADER * hdr = reinterpret_cast<HXC_HFE_HEADER*>(in.data());
+        const HXC_HFE_HEADER * hdr = &m_header;
 
-        std::string signature(reinterpret_cast<char*>(&hdr->HEADERSIGNATURE), sizeof(hdr->HEADERSIGNATURE));
-
-        if (signature == "HXCPICFE") {
+        if (read_header() && has_signature()) {
+            std::string signature(reinterpret_cast<const char*>(&hdr->HEADERSIGNATURE), sizeof(hdr->HEADERSIGNATURE));
 
             result += "$" + dsk_tools::int_to_hex(static_cast<uint32_t>(0)) + " {$HEADER}\n";
 
@@ -151,123 +304,39 @@ LoaderHXC_HFE::LoaderHXC_HFE(const std::string &file_name, const std::string &fo
 
         result += "$" + dsk_tools::int_to_hex(tracklist_offset) + " {$TRACKLIST_OFFSET}\n";
 
-        std::vector<HXC_HFE_TRACK*> ti(hdr->number_of_track);
+        if (!read_track_list()) {
+            result += "{$ERROR_PARSING}\n";
+            return result;
+        }
 
         for (int track=0; track < hdr->number_of_track; track++) {
-            ti[track] = reinterpret_cast<HXC_HFE_TRACK *>(in.data() + tracklist_offset + track * sizeof(HXC_HFE_TRACK));
             result += "    " + std::to_string(track) + ":"
-                      + " {$TRACK_OFFSET}: $" + dsk_tools::int_to_hex(ti[track]->offset*HXC_HFE_BLOCK_SIZE, false)
-                      + ", {$TRACK_SIZE}: $" + dsk_tools::int_to_hex(ti[track]->track_len, false)
+                      + " {$TRACK_OFFSET}: $" + dsk_tools::int_to_hex(m_tracks[track].offset*HXC_HFE_BLOCK_SIZE, false)
+                      + ", {$TRACK_SIZE}: $" + dsk_tools::int_to_hex(m_tracks[track].track_len, false)
                       + "\n";
         }
         result += "\n";
 
+        if (!m_scanned) {
+            if (!open_tracks()) {
+                result += "{$ERROR_PARSING}\n";
+                return result;
+            }
+            BYTES buffer(cylinders() * cylinder_size());
+            m_scanned = decode_all(buffer.data(), m_scans).code != ErrorCode::Cancelled;
+        }
+
         for (int track=0; track<hdr->number_of_track; track++) {
-            int in_base = ti[track]->offset*HXC_HFE_BLOCK_SIZE;
-            int mixed_track_len = std::ceil(static_cast<double>(ti[track]->track_len) / HXC_HFE_BLOCK_SIZE) * HXC_HFE_BLOCK_SIZE;
-
-            // result += "$" + dsk_tools::int_to_hex(static_cast<uint32_t>(in_base)) + ": {$TRACK} " + std::to_string(track) + "\n";
-            BYTES track_mixed(in.begin() + in_base, in.begin() + in_base + mixed_track_len);
-            std::vector<BYTES> track_mfm(hdr->number_of_side);
-            if (hdr->number_of_side == 1) {
-                track_mfm[0] = track_mixed;
-            } else {
-                for (int i=0; i < mixed_track_len / HXC_HFE_BLOCK_SIZE; i++)
-                    for (int s=0; s < hdr->number_of_side; s++ ) {
-                        auto part_base = track_mixed.begin() + i*HXC_HFE_BLOCK_SIZE + s*(HXC_HFE_BLOCK_SIZE/2);
-                        track_mfm[s].insert(track_mfm[s].end(), part_base, part_base + HXC_HFE_BLOCK_SIZE / 2);
-                    }
+            int in_base = m_tracks[track].offset*HXC_HFE_BLOCK_SIZE;
+            // Both sides are read at once
+            if (!m_scans[track * hdr->number_of_side].scanned) {
+                errors = true;
+                break;
             }
 
             for (int s=0; s < hdr->number_of_side; s++ ) {
-                BYTES track_data;
-                decode_agat_mfm_data(track_data, track_mfm[s]);
-                int track_len = track_data.size();
                 result += "$" + dsk_tools::int_to_hex(static_cast<uint32_t>(in_base)) + ": {$TRACK} " + std::to_string(track) + " {$SIDE} " + std::to_string(s) + "\n";
-                int in_p = 0;
-                while (in_p < track_len) {
-                    // Looking for Index Mark
-                    bool index_found = false;
-                    while (in_p < track_len) {
-                        if (!iterate_until(track_data, in_p, 0x95)) break;
-                        if (in_p < track_len) {
-                            uint8_t b1 = track_data.at(in_p++);
-                            if (b1 == 0x6A) {index_found = true; break;};
-                        }
-                    }
-                    if (index_found) {
-                        result += "    $" + dsk_tools::int_to_hex(static_cast<uint16_t>(in_p-2)) + " {$INDEX_MARK} ($95 $6A)\n";
-                        result += "    $" + dsk_tools::int_to_hex(static_cast<uint16_t>(in_p)) + " {$SECTOR_INDEX}:";
-                        uint8_t r_v = track_data.at(in_p++);
-                        uint8_t r_t = track_data.at(in_p++);
-                        uint8_t r_s = track_data.at(in_p++);
-                        result += " {$VOLUME_ID}=" + std::to_string(r_v) + " ($" + dsk_tools::int_to_hex(r_v) + ")";
-                        result += ", {$TRACK_SHORT}=" + std::to_string(r_t);
-                        result += ", {$LOGICAL_SECTOR}=" + std::to_string(r_s);
-                        // Index end mark
-                        uint8_t ie = track_data.at(in_p++);
-                        if (ie == 0x5A) {
-                            result += ", {$INDEX_EPILOGUE_OK}";
-                        } else {
-                            errors = true;
-                            result += ", {$INDEX_EPILOGUE_ERROR}";
-                        }
-                        result += "\n";
-                        // Data mark
-                        bool data_found = false;
-                        while (in_p < track_len) {
-                            if (!iterate_until(track_data, in_p, 0x6A)) break;
-                            if (in_p < track_len) {
-                                uint8_t b1 = track_data.at(in_p++);
-                                if (b1 == 0x95) {data_found = true; break;};
-                            }
-                        }
-                        if (data_found) {
-                            // Data
-                            result += "    $" + dsk_tools::int_to_hex(static_cast<uint16_t>(in_p-2)) + " {$DATA_MARK} ($6A $95)\n";
-                            result += "    $" + dsk_tools::int_to_hex(static_cast<uint16_t>(in_p)) + " {$DATA_FIELD} (256)\n";
-
-                            bool error = false;
-                            uint16_t crc = 0;
-                            int data_p = in_p;
-                            result += "               " + dsk_tools::toHexList(track_data.data() + data_p, 16) + " ...\n";
-
-                            for (int i=0; i<256; i++) {
-                                if (in_p >= track_len) {error = true; break;};
-                                uint8_t  d = track_data.at(in_p++);
-                                if (crc > 0xFF) crc = (crc + 1) & 0xFF;
-                                crc += d;
-                            }
-                            crc &= 0xFF;
-                            if (!error) {
-                                result += "    $" + dsk_tools::int_to_hex(static_cast<uint16_t>(in_p));
-                                uint8_t r_crc = track_data.at(in_p++);
-                                if (r_crc == crc) {
-                                    result += " {$SECTOR_CRC_OK} ($" + dsk_tools::int_to_hex(r_crc) + ")";
-                                } else {
-                                    errors = true;
-                                    result += " {$SECTOR_CRC_ERROR} ({$CRC_EXPECTED}: $" + dsk_tools::int_to_hex(static_cast<uint8_t>(crc)) + ", {$CRC_FOUND}: $" + dsk_tools::int_to_hex(r_crc) + ")";
-                                }
-                                // Data end mark
-                                uint8_t de = track_data.at(in_p++);
-                                if (de == 0x5A) {
-                                    result += ", {$DATA_EPILOGUE_OK}";
-                                } else {
-                                    errors = true;
-                                    result += ", {$DATA_EPILOGUE_ERROR}";
-                                }
-
-                                result += "\n";
-
-                            } else {
-                                result += " {$SECTOR_ERROR}";
-                                errors = true;
-                            }
-                            result += "\n";
-                        }
-                    }
-                }
-
+                result += agat_840_track_report(m_scans[track * hdr->number_of_side + s], errors);
             }
         }
         if (errors) {
@@ -5,7 +5,11 @@
 #pragma once
 
 
+#include <vector>
+
 #include "loader.h"
+#include "mapped_file.h"
+#include "track_scan.h"
 
 namespace dsk_tools {
 
@@ -15,6 +19,45 @@ namespace dsk_tools {
         LoaderHXC_HFE(const std::string & file_name, const std::string & format_id, const std::string & type_id);
         Result load(BYTES & buffer, const DiskFormatParams &format = DiskFormatParams()) override;
         std::string file_info() override;
+        Result open_lazy(size_t & buffer_size, size_t & track_size, const DiskFormatParams &format = DiskFormatParams()) override;
+        Result load_track(int track, uint8_t * buffer) override;
+        Result verify(VerifyReport & report) override;
+        Result read_raw_track(int track, BYTES & out) override;     // The MFM bitstream of one side
+
+        // Random access: only the header, the track list and the blocks of one cylinder are read
+        Result open_tracks();                                   // Called by load() and load_cylinder()
+        int cylinders() const {return m_tracks.size();};
+        int cylinder_size() const {return m_header.number_of_side * m_sectors_per_track * 256;};
+        Result load_cylinder(int cylinder, uint8_t * out);     // out: cylinder_size() bytes, both sides
+
+    protected:
+        // Buffers reused from track to track
+        struct TrackScratch {
+            BYTES mixed;
+            std::vector<BYTES> sides;
+            BYTES track_data;
+            BYTES sectors;
+        };
+
+        FileReader m_file;
+        HXC_HFE_HEADER m_header;
+        std::vector<HXC_HFE_TRACK> m_tracks;
+        int m_sectors_per_track;
+        bool m_tracks_open;
+        // Fields found by the last load(), one entry per side of every cylinder
+        std::vector<TrackScan> m_scans;
+        bool m_scanned;
+        // read_raw_track() is called for both sides in turn, the cylinder is read once
+        TrackScratch m_raw;
+        int m_raw_cylinder;
+
+        Result read_header();
+        Result read_track_list();
+        bool has_signature() const;
+        Result read_track(int track, TrackScratch & sc);        // Fills sc.sides with the MFM bitstream
+        // out may be nullptr to check the fields only; scans: an entry for every side, may be nullptr
+        Result decode_cylinder(int track, uint8_t * out, TrackScratch & sc, TrackScan * scans = nullptr);
+        Result decode_all(uint8_t * out, std::vector<TrackScan> & scans);
     };
 
 }
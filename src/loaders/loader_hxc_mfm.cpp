@@ -22,24 +22,31 @@ namespace dsk_tools {
             throw std::runtime_error("LoaderHXC_MFM: Incorrect type id");
     }
 
-    void LoaderHXC_MFM::prepare_tracks_list(BYTES & in)
+    Result LoaderHXC_MFM::prepare_tracks_list(const uint8_t * in, size_t size)
     {
-        HXC_MFM_HEADER * hdr = reinterpret_cast<HXC_MFM_HEADER *>(in.data());
+        if (size < sizeof(HXC_MFM_HEADER))
+            return Result::error(ErrorCode::LoadIncorrectFile, "File too small");
+
+        const HXC_MFM_HEADER * hdr = reinterpret_cast<const HXC_MFM_HEADER *>(in);
 
         if (hdr->number_of_track != m_tracks_count)
             throw std::runtime_error("LoaderHXC_MFM: Incorrect tracks number");
 
+        if (hdr->mfmtracklistoffset + m_tracks_count * sizeof(HXC_MFM_TRACK_INFO) > size)
+            return Result::error(ErrorCode::LoadIncorrectFile, "Track list is out of file bounds");
+
         for (int track=0; track<m_tracks_count; track++) {
-            HXC_MFM_TRACK_INFO * ti = reinterpret_cast<HXC_MFM_TRACK_INFO *>(in.data() + hdr->mfmtracklistoffset + track * sizeof(HXC_MFM_TRACK_INFO));
+            const HXC_MFM_TRACK_INFO * ti = reinterpret_cast<const HXC_MFM_TRACK_INFO *>(in + hdr->mfmtracklistoffset + track * sizeof(HXC_MFM_TRACK_INFO));
             m_track_offsets[track] = ti->mfmtrackoffset;
             m_track_lengths[track] = ti->mfmtracksize;
         }
+        return Result::ok();
     }
 
-    std::string LoaderHXC_MFM::get_header_info(BYTES & in)
+    std::string LoaderHXC_MFM::get_header_info(const uint8_t * in, size_t size)
     {
         std::string result;
-        HXC_MFM_HEADER * hdr = reinterpret_cast<HXC_MFM_HEADER *>(in.data());
+        const HXC_MFM_HEADER * hdr = reinterpret_cast<const HXC_MFM_HEADER *>(in);
 
         result += "$" + dsk_tools::int_to_hex(static_cast<uint32_t>(0)) + " {$HEADER}\n";
 
@@ -50,7 +57,7 @@ namespace dsk_tools {
         result += "$" + dsk_tools::int_to_hex(hdr->mfmtracklistoffset) + " {$TRACKLIST_OFFSET}\n";
 
         for (int track=0; track<hdr->number_of_track; track++) {
-            HXC_MFM_TRACK_INFO * ti = reinterpret_cast<HXC_MFM_TRACK_INFO *>(in.data() + hdr->mfmtracklistoffset + track * sizeof(HXC_MFM_TRACK_INFO));
+            const HXC_MFM_TRACK_INFO * ti = reinterpret_cast<const HXC_MFM_TRACK_INFO *>(in + hdr->mfmtracklistoffset + track * sizeof(HXC_MFM_TRACK_INFO));
             result += "    {$SIDE_SHORT}: " + std::to_string(ti->side_number)
                       + ", {$TRACK_SHORT}=" + std::to_string(ti->track_number)
                       + ", {$TRACK_OFFSET}: $" + dsk_tools::int_to_hex(ti->mfmtrackoffset, false)
@@ -8,11 +8,86 @@
 #include "host_helpers.h"
 
 #include "loader_imd.h"
+#include "mapped_file.h"
 #include "dsk_tools/dsk_tools.h"
 #include "utils.h"
 
 namespace dsk_tools {
 
+    IMDReader::IMDReader(const uint8_t * data, size_t size):
+          m_data(data)
+        , m_size(size)
+        , m_pos(0)
+    {}
+
+    const uint8_t * IMDReader::take(size_t size)
+    {
+        if (size > m_size - m_pos) return nullptr;
+        const uint8_t * p = m_data + m_pos;
+        m_pos += size;
+        return p;
+    }
+
+    Result IMDReader::read_header(std::string & signature, std::string & comment)
+    {
+        constexpr unsigned signature_length = 29;
+        const uint8_t * header = take(signature_length);
+        if (header == nullptr || std::memcmp(header, "IMD", 3) != 0)
+            return Result::error(ErrorCode::LoadIncorrectFile, "Incorrect file format");
+        signature.assign(reinterpret_cast<const char*>(header), signature_length);
+
+        const uint8_t * start = m_data + m_pos;
+        const void * end = std::memchr(start, 0x1A, m_size - m_pos);
+        if (end == nullptr)
+            return Result::error(ErrorCode::LoadDataCorrupt, "File seems to be corrupt");
+        const size_t length = static_cast<const uint8_t*>(end) - start;
+        comment.assign(reinterpret_cast<const char*>(start), length);
+        m_pos += length + 1;
+        return Result::ok();
+    }
+
+    Result IMDReader::next_track(IMD_TRACK & track, bool & found)
+    {
+        found = false;
+        const uint8_t * header = take(sizeof(IMD_TRACK_HEADER));
+        if (header == nullptr) return Result::ok();                 // A few bytes of garbage at the end are ignored too
+        std::memcpy(&track.header, header, sizeof(IMD_TRACK_HEADER));
+
+        const unsigned sectors = track.header.sectors;
+        track.head = track.header.head & 0x3F;
+        track.sector_size = 1u << (track.header.sector_size + 7);
+
+        const Result eof = Result::error(ErrorCode::LoadDataCorrupt, "File seems to be corrupt");
+        track.sector_map = take(sectors);
+        if (track.sector_map == nullptr) return eof;
+        track.cylinder_map = nullptr;
+        if ((track.header.head & 0x80) != 0) {
+            track.cylinder_map = take(sectors);
+            if (track.cylinder_map == nullptr) return eof;
+        }
+        track.head_map = nullptr;
+        if ((track.header.head & 0x40) != 0) {
+            track.head_map = take(sectors);
+            if (track.head_map == nullptr) return eof;
+        }
+
+        for (unsigned sector=0; sector<sectors; sector++) {
+            const uint8_t * marker = take(1);
+            if (marker == nullptr) return eof;
+            if (*marker > 0x08)
+                return Result::error(ErrorCode::LoadIncorrectFile, "File seems to be corrupt");
+            track.markers[sector] = *marker;
+            if (*marker == 0x00)
+                track.data[sector] = nullptr;
+            else {
+                track.data[sector] = take(is_compressed(*marker) ? 1 : track.sector_size);
+                if (track.data[sector] == nullptr) return eof;
+            }
+        }
+        found = true;
+        return Result::ok();
+    }
+
     LoaderIMD::LoaderIMD(const std::string &file_name, const std::string &format_id, const std::string &type_id):
         Loader(file_name, format_id, type_id)
     {}
@@ -25,106 +100,57 @@ namespace dsk_tools {
         const unsigned sector_size = format.sector_size;
         const unsigned expected_size = format.expected_size;
 
-        UTF8_ifstream file(file_name, std::ios::binary);
-
-        if (!file.good()) return Result::error(ErrorCode::LoadError, "Cannot open file");
+        MappedFile input;
+        if (!open_input(input)) return Result::error(ErrorCode::LoadError, "Cannot open file");
 
-        constexpr unsigned signature_length = 29;
-        char header[signature_length];
-        file.read(header, signature_length);
-
-        if (std::string(header, 3) != "IMD") return Result::error(ErrorCode::LoadIncorrectFile, "Incorrect file format");
-
-        std::string comment;
-        char c;
-        while (file.read(&c, 1) && c != 0x1A) {
-            comment += c;
-        }
-        if (c != 0x1A) return Result::error(ErrorCode::LoadIncorrectFile, "File seems to be corrupt");
+        IMDReader reader(input.data(), input.size());
+        std::string signature, comment;
+        Result res = reader.read_header(signature, comment);
+        if (!res) return res;
 
         buffer.resize(expected_size);
 
-        while (file.good()) {
-            // Track header
-            IMD_TRACK_HEADER track_header{};
-            file.read(reinterpret_cast<char*>(&track_header), sizeof(IMD_TRACK_HEADER));
-            if (!file.good()) break;
-            if (heads && track_header.head + 1 > heads) return Result::error(ErrorCode::LoadIncorrectFile, "Incorrect head index");
+        IMD_TRACK track;
+        bool found;
+        progress_start(m_progress.get(), ProgressStage::Load, heads * tracks);
+        while ((res = reader.next_track(track, found)) && found) {
+            if (is_cancelled(m_progress.get())) return Result::error(ErrorCode::Cancelled, "Loading cancelled");
+            const IMD_TRACK_HEADER & track_header = track.header;
+            if (heads && track.head + 1 > heads) return Result::error(ErrorCode::LoadIncorrectFile, "Incorrect head index");
             if (tracks && track_header.cylinder >= tracks) return Result::error(ErrorCode::LoadIncorrectFile, "Incorrect track index");
             if (sectors && track_header.sectors != sectors) return Result::error(ErrorCode::LoadIncorrectFile, "Incorrect sector count");
-            const int s_size = 1 << (track_header.sector_size+7);
-            if (sector_size && s_size != sector_size) return Result::error(ErrorCode::LoadIncorrectFile, "Incorrect sector size");
-
-            // Sector map
-            BYTES sector_map;
-            sector_map.resize(track_header.sectors);
-            file.read(reinterpret_cast<char*>(sector_map.data()), sector_map.size());
-            if (!file.good()) return Result::error(ErrorCode::LoadIncorrectFile, "File seems to be corrupt");
-
-            //Cylinder map
-            static bool cm_presents = (track_header.head & 0x80) != 0;
-            if (cm_presents) {
-                BYTES cylinder_map;
-                cylinder_map.resize(track_header.sectors);
-                file.read(reinterpret_cast<char*>(cylinder_map.data()), cylinder_map.size());
-                if (!file.good()) return Result::error(ErrorCode::LoadIncorrectFile, "File seems to be corrupt");
-            }
+            if (sector_size && track.sector_size != sector_size) return Result::error(ErrorCode::LoadIncorrectFile, "Incorrect sector size");
 
-            //Head map
-            static bool hm_presents = (track_header.head & 0x40) != 0;
-            if (hm_presents) {
-                BYTES head_map;
-                head_map.resize(track_header.sectors);
-                file.read(reinterpret_cast<char*>(head_map.data()), head_map.size());
-                if (!file.good()) return Result::error(ErrorCode::LoadIncorrectFile, "File seems to be corrupt");
-            }
+            unsigned track_pos;
+            if (heads == 2) track_pos = track_header.cylinder * heads + track.head;
+            else if (heads == 1) track_pos = track_header.cylinder;
+            else return Result::error(ErrorCode::LoadError, "Incorrect data");
 
             for (unsigned sector=0; sector<track_header.sectors; sector++) {
-                unsigned track_pos, sector_pos;
-                if (heads == 2) track_pos = track_header.cylinder * heads + track_header.head;
-                else if (heads == 1) track_pos = track_header.cylinder;
-                else return Result::error(ErrorCode::LoadError, "Incorrect data");
-                sector_pos = (track_pos * sectors + sector_map[sector]-1) * sector_size;
-
-                uint8_t data_marker;
-                unsigned data_len;
-
-                file.read(reinterpret_cast<char*>(&data_marker), 1);
-
-                switch (data_marker) {
-                    case 0x00:
-                        data_len = 0; break;
-                    case 0x01: case 0x03: case 0x05: case 0x07:
-                        data_len = sector_size; break;
-                    case 0x02: case 0x04: case 0x06: case 0x08:
-                        data_len = 1;  break;
-                    default:
-                        return Result::error(ErrorCode::LoadIncorrectFile, "File seems to be corrupt");
-                        break;
-                }
+                const uint8_t data_marker = track.markers[sector];
+                const size_t sector_pos = (static_cast<size_t>(track_pos) * sectors + track.sector_map[sector] - 1) * sector_size;
 
                 if (data_marker == 0x00 || data_marker >= 0x05) {
                     // TODO: recalc head & cylinder for sequential disks
-                    m_bad_sectors.insert(bad_sector_key(track_header.head & 0x3F, track_header.cylinder, sector_map[sector]));
+                    m_bad_sectors.insert(bad_sector_key(track.head, track_header.cylinder, track.sector_map[sector]));
                 }
 
-                if (sector_pos + sector_size > buffer.size())
+                if (track.sector_map[sector] == 0 || sector_pos + sector_size > buffer.size())
                     return Result::error(ErrorCode::LoadIncorrectFile, "Data exceeds buffer size");
 
-                if (data_len == 0) {
+                if (data_marker == 0x00) {
                     constexpr uint8_t data_value = 0xE5;
                     std::memset(buffer.data() + sector_pos, data_value, sector_size);
                 } else
-                if (data_len == 1) {
-                    uint8_t data_value = 0;
-                    file.read(reinterpret_cast<char*>(&data_value), 1);
-                    std::memset(buffer.data() + sector_pos, data_value, sector_size);
-                } else
-                if (data_len > 0) {
-                    file.read(reinterpret_cast<char*>(buffer.data() + sector_pos), sector_size);
+                if (IMDReader::is_compressed(data_marker)) {
+                    std::memset(buffer.data() + sector_pos, track.data[sector][0], sector_size);
+                } else {
+                    std::memcpy(buffer.data() + sector_pos, track.data[sector], sector_size);
                 }
             }
+            progress_step(m_progress.get());
         }
+        if (!res) return res;
 
         loaded = true;
 
@@ -138,171 +164,80 @@ namespace dsk_tools {
         std::string bad_tbl;
         bool has_errors = false;
 
-        UTF8_ifstream file(file_name, std::ios::binary);
-
-        if (!file.good()) {
+        MappedFile input;
+        if (!open_input(input)) {
             result += "{$ERROR_OPENING}\n";
             return result;
         }
-
-        file.seekg (0, std::ios::end);
-        auto fsize = file.tellg();
-        file.seekg (0, std::ios::beg);
+        const size_t fsize = input.size();
 
         size_t pos = file_name.find_last_of("/\\");
         std::string file_short = (pos == std::string::npos) ? file_name : file_name.substr(pos + 1);
         result += "{$FILE_NAME}: " + file_short + "\n";
         result += "{$SIZE}: " + std::to_string(fsize) + " {$BYTES}\n";
 
-        constexpr unsigned signature_length = 29;
-        char header[signature_length];
-        file.read(header, signature_length);
-
-        if (std::string(header, 3) != "IMD") {
+        IMDReader reader(input.data(), input.size());
+        std::string signature, comment;
+        Result res = reader.read_header(signature, comment);
+        if (res.code == ErrorCode::LoadIncorrectFile) {
             result += "{$ERROR}: {$INVALID_SIGNATURE}\n";
             return result;
         }
-
-        result += "{$SIGNATURE}: " + std::string(header, signature_length) + "\n";
-
-        std::string comment;
-        char c;
-        while (file.read(&c, 1) && c != 0x1A) {
-            comment += c;
-        }
-        if (c != 0x1A) {
+        result += "{$SIGNATURE}: " + signature + "\n";
+        if (!res) {
             result += "{$ERROR}: {$UNEXPECTED_EOF}\n";
             return result;
         }
         result += "{$COMMENT}: " + trim(comment) + "\n";
         result += "\n";
 
-        while (file.good()) {
-            // Track header
-            IMD_TRACK_HEADER track_header{};
-            file.read(reinterpret_cast<char*>(&track_header), sizeof(IMD_TRACK_HEADER));
-            if (!file.good()) break;
-            int sector_size = 1 << (track_header.sector_size+7);
-            track_tbl += "{$SIDE}: " + std::to_string(track_header.head & 0x3F)
-                        + ", {$TRACK}: " + std::to_string(track_header.cylinder)
-                        + ", {$CPM_SECTORS}: " + std::to_string(track_header.sectors)
-                        + ", {$CPM_SECTOR_SIZE}: " + std::to_string(sector_size)
-                        +"\n";
-            bad_tbl += "H" + std::to_string(track_header.head & 0x3F) + "T" + pad_number(track_header.cylinder, 2, '0') + ": ";
-            // Sector map
-            BYTES sector_map;
-            sector_map.resize(track_header.sectors);
-            file.read(reinterpret_cast<char*>(sector_map.data()), sector_map.size());
-            if (!file.good()) {
+        IMD_TRACK track;
+        bool found;
+        while (true) {
+            res = reader.next_track(track, found);
+            if (res.code == ErrorCode::LoadDataCorrupt) {
                 result += "{$UNEXPECTED_END_OF_FILE}\n";
                 break;
             }
-            track_tbl += "    {$SECTORS_MAP}: " + toHexList(sector_map.data(), sector_map.size()) + "\n";
-
-            //Cylinder map
-            static bool cm_presents = (track_header.head & 0x80) != 0;
-            if (cm_presents) {
-                BYTES cylinder_map;
-                cylinder_map.resize(track_header.sectors);
-                file.read(reinterpret_cast<char*>(cylinder_map.data()), cylinder_map.size());
-                if (!file.good()) {
-                    result += "{$UNEXPECTED_END_OF_FILE}\n";
-                    break;
-                }
-                track_tbl += "    {$CYLINDERS_MAP}: " + toHexList(cylinder_map.data(), cylinder_map.size()) + "\n";
-            }
+            if (!res) return result;                                // Unknown data marker
+            if (!found) break;
 
-            //Head map
-            static bool hm_presents = (track_header.head & 0x40) != 0;
-            if (hm_presents) {
-                BYTES head_map;
-                head_map.resize(track_header.sectors);
-                file.read(reinterpret_cast<char*>(head_map.data()), head_map.size());
-                if (!file.good()) {
-                    result += "{$UNEXPECTED_END_OF_FILE}\n";
-                    break;
-                }
-                track_tbl += "    {$HEAD_MAP}: " + toHexList(head_map.data(), head_map.size()) + "\n";
-            }
+            const IMD_TRACK_HEADER & track_header = track.header;
+            track_tbl += "{$SIDE}: " + std::to_string(track.head)
+                        + ", {$TRACK}: " + std::to_string(track_header.cylinder)
+                        + ", {$CPM_SECTORS}: " + std::to_string(track_header.sectors)
+                        + ", {$CPM_SECTOR_SIZE}: " + std::to_string(track.sector_size)
+                        +"\n";
+            bad_tbl += "H" + std::to_string(track.head) + "T" + pad_number(track_header.cylinder, 2, '0') + ": ";
+            track_tbl += "    {$SECTORS_MAP}: " + toHexList(track.sector_map, track_header.sectors) + "\n";
+            if (track.cylinder_map != nullptr)
+                track_tbl += "    {$CYLINDERS_MAP}: " + toHexList(track.cylinder_map, track_header.sectors) + "\n";
+            if (track.head_map != nullptr)
+                track_tbl += "    {$HEAD_MAP}: " + toHexList(track.head_map, track_header.sectors) + "\n";
 
             for (unsigned sector=0; sector<track_header.sectors; sector++) {
-                track_tbl += "    " + int_to_hex(static_cast<uint8_t>(sector+1)) + " (" + int_to_hex(sector_map[sector]) + "): ";
-
-                uint8_t data_marker = 0;
-
-                file.read(reinterpret_cast<char*>(&data_marker), 1);
-
-                int skip=-1;
-
-                switch (data_marker) {
-                    case 0x00:
-                        track_tbl += "{$SECTOR_UNAVAILABLE}";
-                        skip = 0;
-                        bad_tbl += "U";
-                        has_errors = true;
-                        break;
-                    case 0x01:
-                        track_tbl += "{$NORMAL_DATA}";
-                        skip = sector_size;
-                        bad_tbl += ".";
-                        break;
-                    case 0x02:
-                        track_tbl += "{$NORMAL_DATA}, {$DATA_COMPRESSED}";
-                        skip = 1;
-                        bad_tbl += ":";
-                        break;
-                    case 0x03:
-                        track_tbl += "{$NORMAL_DATA}, {$DATA_DELETED}";
-                        skip = sector_size;
-                        bad_tbl += ".";
-                        break;
-                    case 0x04:
-                        track_tbl += "{$NORMAL_DATA}, {$DATA_COMPRESSED}, {$DATA_DELETED}";
-                        skip = 1;
-                        bad_tbl += ":";
-                        break;
-                    case 0x05:
-                        track_tbl += "{$NORMAL_DATA_WITH_ERROR}";
-                        skip = sector_size;
-                        bad_tbl += "B";
-                        has_errors = true;
-                        break;
-                    case 0x06:
-                        track_tbl += "{$NORMAL_DATA_WITH_ERROR}, {$DATA_COMPRESSED}";
-                        skip = 1;
-                        bad_tbl += "B";
-                        has_errors = true;
-                        break;
-                    case 0x07:
-                        track_tbl += "{$NORMAL_DATA_WITH_ERROR}, {$DATA_DELETED}";
-                        skip = sector_size;
+                track_tbl += "    " + int_to_hex(static_cast<uint8_t>(sector+1)) + " (" + int_to_hex(track.sector_map[sector]) + "): ";
+
+                const uint8_t data_marker = track.markers[sector];
+                if (data_marker == 0x00) {
+                    track_tbl += "{$SECTOR_UNAVAILABLE}";
+                    bad_tbl += "U";
+                    has_errors = true;
+                } else {
+                    const bool with_error = data_marker >= 0x05;
+                    const bool compressed = IMDReader::is_compressed(data_marker);
+                    const bool deleted = ((data_marker - 1) & 0x02) != 0;
+                    track_tbl += with_error ? "{$NORMAL_DATA_WITH_ERROR}" : "{$NORMAL_DATA}";
+                    if (compressed) track_tbl += ", {$DATA_COMPRESSED}";
+                    if (deleted) track_tbl += ", {$DATA_DELETED}";
+                    if (with_error) {
                         bad_tbl += "B";
                         has_errors = true;
-                        break;
-                    case 0x08:
-                        track_tbl += "{$NORMAL_DATA_WITH_ERROR}, {$DATA_COMPRESSED}, {$DATA_DELETED}";
-                        skip = 1;
-                        bad_tbl += "B";
-                        has_errors = true;
-                        break;
-                    default:
-                        track_tbl += "{$UNKNOWN_DATA_MARKER}";
-                        skip=-1;
-                        has_errors = true;
-                        break;
+                    } else
+                        bad_tbl += compressed ? ":" : ".";
+                    if (compressed)
+                        track_tbl += " ($" + int_to_hex(track.data[sector][0]) + ")";
                 }
-                if (skip == 1) {
-                    uint8_t data_value = 0;
-                    file.read(reinterpret_cast<char*>(&data_value), 1);
-                    track_tbl += " ($" + int_to_hex(data_value) + ")";
-                } else
-                if (skip > 0) {
-                    file.seekg(skip, std::ios::cur);
-                } else
-                if (skip < 0) {
-                    return result;
-                }
-
                 track_tbl += "\n";
             }
             bad_tbl += "\n";
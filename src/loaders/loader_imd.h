@@ -16,6 +16,35 @@ namespace dsk_tools {
         uint8_t     sector_size;
     };
 
+    // A track record with everything pointing into the file data
+    struct IMD_TRACK {
+        IMD_TRACK_HEADER    header;
+        unsigned            head;                   // Without the map flags
+        unsigned            sector_size;
+        const uint8_t *     sector_map;
+        const uint8_t *     cylinder_map;           // nullptr if there is none
+        const uint8_t *     head_map;               // nullptr if there is none
+        uint8_t             markers[256];
+        const uint8_t *     data[256];              // sector_size bytes, or a single fill byte for compressed records
+    };
+
+    // Walks an IMD file in memory once, from the header to the last track
+    class IMDReader
+    {
+    public:
+        IMDReader(const uint8_t * data, size_t size);
+        Result read_header(std::string & signature, std::string & comment);
+        // found is false at the end of the file. Errors: LoadDataCorrupt if the file is cut short,
+        // LoadIncorrectFile for an unknown data marker
+        Result next_track(IMD_TRACK & track, bool & found);
+        static bool is_compressed(uint8_t marker) {return marker != 0 && (marker & 1) == 0;};
+    private:
+        const uint8_t * m_data;
+        size_t m_size;
+        size_t m_pos;
+        const uint8_t * take(size_t size);          // nullptr if there are not enough bytes left
+    };
+
     class LoaderIMD:public Loader
     {
     public:
@@ -3,260 +3,178 @@
 // Part of the dsk_tools project: https://github.com/Ptr314/dsk_tools
 // Description: A top level abstract class for different physical format loaders
 
-#include <fstream>
 #include <iostream>
 
-#include "host_helpers.h"
-
 #include "loader_mfm.h"
+#include "mapped_file.h"
+#include "thread_pool.h"
+#include "track_scan.h"
 #include "dsk_tools/dsk_tools.h"
 #include "utils.h"
 
 namespace dsk_tools {
     LoaderMFM::LoaderMFM(const std::string &file_name, const std::string &format_id, const std::string &type_id):
         Loader(file_name, format_id, type_id)
+        , m_scanned(false)
     {
         if (type_id == "TYPE_AGAT_140") {
-            track_info_func = &LoaderMFM::agat140_track_info;
+            track_report_func = &agat_140_track_report;
             load_track_func = &LoaderMFM::load_agat140_track;
         } else
             if (type_id == "TYPE_AGAT_840") {
-                track_info_func = &LoaderMFM::agat840_track_info;
+                track_report_func = &agat_840_track_report;
                 load_track_func = &LoaderMFM::load_agat840_track;
             } else
                 throw std::runtime_error("LoaderMFM: Incorrect type id");
     }
 
-    void LoaderMFM::prepare_tracks_list(BYTES & in)
+    Result LoaderMFM::prepare_tracks_list(const uint8_t * in, size_t size)
     {
         for (int track=0; track < get_tracks_count(); track ++) {
             m_track_offsets[track] = track * m_track_len;
             m_track_lengths[track] = m_track_len;
         }
+        return Result::ok();
     }
 
-    std::string LoaderMFM::agat140_track_info(BYTES & in, int track_len)
+    Result LoaderMFM::open_tracks()
     {
-        std::string result;
-        bool errors = false;
-        int in_p = 0;
-
-        while (in_p < track_len) {
-            // Looking for Index Mark
-            bool index_found = false;
-            while (in_p < track_len) {
-                if (!iterate_until(in, in_p, 0xD5)) break;
-                if (in_p < track_len) {
-                    uint8_t b1 = in.at(in_p++);
-                    uint8_t b2 = in.at(in_p++);
-                    if (b1 == 0xAA && b2 == 0x96) {index_found = true; break;};
+        if (m_file.data() != nullptr) return Result::ok();
+
+        Result res = open_input(m_file);
+        if (!res) return res;
+
+        res = prepare_tracks_list(m_file.data(), m_file.size());
+        if (res) {
+            for (int track=0; track<get_tracks_count(); track++) {
+                int in_base = get_track_offset(track);
+                int track_len = get_track_len(track);
+                if (in_base < 0 || track_len < 0 || in_base + track_len > m_file.size()) {
+                    res = Result::error(ErrorCode::LoadDataCorrupt, "Track is out of file bounds");
+                    break;
                 }
             }
-            if (index_found) {
-                result += "    $" + dsk_tools::int_to_hex(static_cast<uint32_t>(in_p - 3)) + " {$INDEX_MARK} ($D5 $AA $96)\n";
-                result += "    $" + dsk_tools::int_to_hex(static_cast<uint32_t>(in_p)) + " {$SECTOR_INDEX}:";
-                BYTES ind_coded(in.begin() + in_p, in.begin() + in_p + 8);
-                in_p += 8;
-                BYTES ind = dsk_tools::decode44(ind_coded);
-                uint8_t r_v = ind.at(0);
-                uint8_t r_t = ind.at(1);
-                uint8_t r_s = ind.at(2);
-                uint8_t r_crc = ind.at(3);
-                uint8_t expecter_crc = static_cast<uint8_t>(r_v ^ r_t ^ r_s);
-                result += " {$VOLUME_ID}=" + std::to_string(r_v) + " ($" + dsk_tools::int_to_hex(r_v) + ")";
-                result += ", {$TRACK_SHORT}=" + std::to_string(r_t);
-                result += ", {$LOGICAL_SECTOR}=" + std::to_string(r_s);
-                if (r_crc == expecter_crc) {
-                    result += ", {$INDEX_CRC_OK}";
-                } else {
-                    errors = true;
-                    result += " {$INDEX_CRC_ERROR} ({$CRC_EXPECTED}: $" + dsk_tools::int_to_hex(static_cast<uint8_t>(expecter_crc)) + ", {$CRC_FOUND}: $" + dsk_tools::int_to_hex(r_crc) + ")";
-                }
-                // Index end mark
-                BYTES ie(in.begin()+in_p, in.begin()+in_p + 3); in_p += 3;
-                if (ie.at(0) == 0xDE && ie.at(1) == 0xAA && ie.at(2) == 0xEB) {
-                    result += ", {$INDEX_EPILOGUE_OK}";
-                } else {
-                    errors = true;
-                    result += ", {$INDEX_EPILOGUE_ERROR}";
-                }
-                result += "\n";
-
-                // Data mark
-                bool data_found = false;
-                while (in_p < track_len) {
-                    if (!iterate_until(in, in_p, 0xD5)) break;
-                    if (in_p < track_len) {
-                        uint8_t b1 = in.at(in_p++);
-                        uint8_t b2 = in.at(in_p++);
-                        if (b1 == 0xAA && b2 == 0xAD) {data_found = true; break;};
-                    }
-                };
-                if (data_found) {
-                    // Data
-                    result += "    $" + dsk_tools::int_to_hex(static_cast<uint32_t>(in_p-3)) + " {$DATA_MARK} ($D5 $AA $AD)\n";
-                    result += "    $" + dsk_tools::int_to_hex(static_cast<uint32_t>(in_p)) + " {$DATA_FIELD} (342+1)";
-                    if (in_p + 343 + 3 <= in.size()) {
-                        BYTES encoded_sector(in.begin()+ in_p, in.begin()+ in_p + 343);
-                        in_p += 343;
-                        BYTES data(256);
-                        bool crc_ok = decode_gcr62(encoded_sector.data(), data.data());
-                        if (crc_ok) {
-                            result += ", {$SECTOR_CRC_OK}";
-                        } else {
-                            errors = true;
-                            result += ", {$SECTOR_CRC_ERROR}";
-                        }
-                        uint8_t e1 = in.at(in_p++);
-                        uint8_t e2 = in.at(in_p++);
-                        uint8_t e3 = in.at(in_p++);
-                        if (e1 == 0xDE && e2 == 0xAA && e3 == 0xEB) {
-                            result += ", {$DATA_EPILOGUE_OK}";
-                        } else {
-                            errors = true;
-                            result += ", {$DATA_EPILOGUE_ERROR}";
-                        }
-
-                        result += "\n    " + dsk_tools::toHexList(data.data(), 16) + " ...";
-                    } else {
-                        errors = true;
-                    }
-
-                    result += "\n\n";
-                }
-            }
-        }
-        if (errors) {
-            result += "{$ERROR_PARSING}\n";
-        } else {
-            result += "{$PARSING_FINISHED}\n";
         }
-        return result;
+        if (!res) m_file.close();
+        return res;
     }
 
-    std::string LoaderMFM::agat840_track_info(BYTES & in, int track_len)
+    void LoaderMFM::scan_tracks(const uint8_t * in, int count, uint8_t * buffer, std::vector<TrackScan> & scans)
     {
-        std::string result;
-        int in_p = 0;
-        bool errors = false;
-        while (in_p < track_len) {
-            // Looking for Index Mark
-            bool index_found = false;
-            while (in_p < track_len) {
-                if (!iterate_until(in, in_p, 0x95)) break;
-                if (in_p < track_len) {
-                    uint8_t b1 = in.at(in_p++);
-                    if (b1 == 0x6A) {index_found = true; break;};
-                }
-            }
-            if (index_found) {
-                result += "    $" + dsk_tools::int_to_hex(static_cast<uint16_t>(in_p-2)) + " {$INDEX_MARK} ($95 $6A)\n";
-                result += "    $" + dsk_tools::int_to_hex(static_cast<uint16_t>(in_p)) + " {$SECTOR_INDEX}:";
-                uint8_t r_v = in.at(in_p++);
-                uint8_t r_t = in.at(in_p++);
-                uint8_t r_s = in.at(in_p++);
-                result += " {$VOLUME_ID}=" + std::to_string(r_v) + " ($" + dsk_tools::int_to_hex(r_v) + ")";
-                result += ", {$TRACK_SHORT}=" + std::to_string(r_t);
-                result += ", {$LOGICAL_SECTOR}=" + std::to_string(r_s);
-                // Index end mark
-                uint8_t ie = in.at(in_p++);
-                if (ie == 0x5A) {
-                    result += ", {$INDEX_EPILOGUE_OK}";
-                } else {
-                    errors = true;
-                    result += ", {$INDEX_EPILOGUE_ERROR}";
-                }
-                result += "\n";
-                // Data mark
-                bool data_found = false;
-                while (in_p < track_len) {
-                    if (!iterate_until(in, in_p, 0x6A)) break;
-                    if (in_p < track_len) {
-                        uint8_t b1 = in.at(in_p++);
-                        if (b1 == 0x95) {data_found = true; break;};
-                    }
-                }
-                if (data_found) {
-                    // Data
-                    result += "    $" + dsk_tools::int_to_hex(static_cast<uint16_t>(in_p-2)) + " {$DATA_MARK} ($6A $95)\n";
-                    result += "    $" + dsk_tools::int_to_hex(static_cast<uint16_t>(in_p)) + " {$DATA_FIELD} (256)\n";
-
-                    bool error = false;
-                    uint16_t crc = 0;
-                    int data_p = in_p;
-                    result += "               " + dsk_tools::toHexList(in.data() + data_p, 16) + " ...\n";
-
-                    for (int i=0; i<256; i++) {
-                        if (in_p >= track_len) {error = true; break;};
-                        uint8_t  d = in.at(in_p++);
-                        if (crc > 0xFF) crc = (crc + 1) & 0xFF;
-                        crc += d;
-                    }
-                    crc &= 0xFF;
-                    if (!error) {
-                        result += "    $" + dsk_tools::int_to_hex(static_cast<uint16_t>(in_p));
-                        uint8_t r_crc = in.at(in_p++);
-                        if (r_crc == crc) {
-                            result += " {$SECTOR_CRC_OK} ($" + dsk_tools::int_to_hex(r_crc) + ")";
-                        } else {
-                            errors = true;
-                            result += " {$SECTOR_CRC_ERROR} ({$CRC_EXPECTED}: $" + dsk_tools::int_to_hex(static_cast<uint8_t>(crc)) + ", {$CRC_FOUND}: $" + dsk_tools::int_to_hex(r_crc) + ")";
-                        }
-                        // Data end mark
-                        uint8_t de = in.at(in_p++);
-                        if (de == 0x5A) {
-                            result += ", {$DATA_EPILOGUE_OK}";
-                        } else {
-                            errors = true;
-                            result += ", {$DATA_EPILOGUE_ERROR}";
-                        }
-
-                        result += "\n";
-
-                    } else {
-                        result += " {$SECTOR_ERROR}";
-                        errors = true;
-                    }
-                    result += "\n";
-                }
-            }
-        }
-        if (errors) {
-            result += "{$ERROR_PARSING}\n";
-        } else {
-            result += "{$PARSING_FINISHED}\n";
-        }
-        return result;
+        scans.resize(get_tracks_count());
+        for (TrackScan & scan : scans) scan.reset();
+
+        // Tracks are decoded in place, straight into disjoint parts of the image buffer
+        progress_start(m_progress.get(), ProgressStage::Load, count);
+        std::shared_ptr<ThreadPool> pool = decode_pool();
+        ThreadPool::parallel_for(pool.get(), count, [&](int track, int) {
+            if (is_cancelled(m_progress.get())) return;
+            (this->*load_track_func)(track, buffer, in + get_track_offset(track), get_track_len(track), &scans[track]);
+            progress_step(m_progress.get());
+        });
     }
 
-    Result LoaderMFM::load(BYTES &buffer, const DiskFormatParams &format)
+    void LoaderMFM::add_bad_sectors(BadSectorTable & table, int track, const TrackScan & scan)
     {
-        UTF8_ifstream file(file_name, std::ios::binary);
-        if (!file.good()) {
-            return Result::error(ErrorCode::LoadError, "Cannot open file");
-        }
+        if (type_id == "TYPE_AGAT_140")
+            dsk_tools::add_bad_sectors(table, scan, 0, track, get_sectors_count(), agat_140_raw2logic);
+        else
+            dsk_tools::add_bad_sectors(table, scan, track & 1, track >> 1, get_sectors_count());
+    }
 
-        file.seekg (0, std::ios::end);
-        auto fsize = file.tellg();
-        file.seekg (0, std::ios::beg);
+    void LoaderMFM::verify_sectors(VerifyReport & report, int track, const TrackScan & scan)
+    {
+        if (type_id == "TYPE_AGAT_140")
+            dsk_tools::verify_sectors(report, scan, 0, track, agat_140_raw2logic);
+        else
+            dsk_tools::verify_sectors(report, scan, track & 1, track >> 1);
+    }
+
+    Result LoaderMFM::load(BYTES &buffer, const DiskFormatParams &format)
+    {
+        Result res = open_tracks();
+        if (!res) return res;
 
         int image_size = get_tracks_count()*get_sectors_count()*256;
         buffer.resize(image_size);
 
-        BYTES in_all(fsize);
-        bool errors = false;
+        scan_tracks(m_file.data(), get_tracks_count(), buffer.data(), m_scans);
+        m_file.close();
+        if (is_cancelled(m_progress.get())) {
+            m_scans.clear();
+            return Result::error(ErrorCode::Cancelled, "Loading cancelled");
+        }
+        m_scanned = true;
+
+        m_bad_sectors.clear();
+        for (int track=0; track<get_tracks_count(); track++)
+            add_bad_sectors(m_bad_sectors, track, m_scans[track]);
 
-        file.read (reinterpret_cast<char*>(in_all.data()), fsize);
+        loaded = true;
+        return Result::ok();
+    }
 
-        prepare_tracks_list(in_all);
+    Result LoaderMFM::open_lazy(size_t & buffer_size, size_t & track_size, const DiskFormatParams &format)
+    {
+        Result res = open_tracks();
+        if (!res) return res;
+        m_bad_sectors.clear();
 
+        track_size = get_sectors_count()*256;
+        buffer_size = get_tracks_count()*track_size;
+        return Result::ok();
+    }
+
+    Result LoaderMFM::load_track(int track, uint8_t * buffer)
+    {
+        if (m_file.data() == nullptr || track < 0 || track >= get_tracks_count())
+            return Result::error(ErrorCode::IncorrectRequest, "Track is not available");
+
+        TrackScan scan;
+        (this->*load_track_func)(track, buffer, m_file.data() + get_track_offset(track), get_track_len(track), &scan);
+        BadSectorTable bad;
+        add_bad_sectors(bad, track, scan);
+        merge_bad_sectors(bad);
+        return Result::ok();
+    }
+
+    Result LoaderMFM::read_raw_track(int track, BYTES & out)
+    {
+        Result res = open_tracks();
+        if (!res) return res;
+        if (track < 0 || track >= get_tracks_count())
+            return Result::error(ErrorCode::IncorrectRequest, "Track out of range");
+
+        const uint8_t * in = m_file.data() + get_track_offset(track);
+        out.assign(in, in + get_track_len(track));
+        return Result::ok();
+    }
+
+    Result LoaderMFM::verify(VerifyReport & report)
+    {
+        // The file is mapped anew: load_track() may be using m_file
+        MappedFile in;
+        Result res = open_input(in);
+        if (!res) return res;
+        res = prepare_tracks_list(in.data(), in.size());
+        if (!res) return res;
         for (int track=0; track<get_tracks_count(); track++) {
             int in_base = get_track_offset(track);
             int track_len = get_track_len(track);
-            BYTES in(in_all.begin()+in_base, in_all.begin()+in_base+track_len);
-            (this->*load_track_func)(track, buffer, in, track_len);
+            if (in_base < 0 || track_len < 0 || in_base + track_len > in.size())
+                return Result::error(ErrorCode::LoadDataCorrupt, "Track is out of file bounds");
         }
-        loaded = true;
+
+        std::vector<TrackScan> scans;
+        scan_tracks(in.data(), get_tracks_count(), nullptr, scans);
+        if (is_cancelled(m_progress.get())) return Result::error(ErrorCode::Cancelled, "Verification cancelled");
+
+        if (type_id == "TYPE_AGAT_140")
+            report.reset(1, get_tracks_count(), get_sectors_count());
+        else
+            report.reset(2, get_tracks_count() / 2, get_sectors_count());
+        for (int track=0; track<get_tracks_count(); track++)
+            verify_sectors(report, track, scans[track]);
         return Result::ok();
     }
 
@@ -264,16 +182,12 @@ namespace dsk_tools {
     {
         std::string result = "";
 
-        UTF8_ifstream file(file_name, std::ios::binary);
-
-        if (!file.good()) {
+        MappedFile in_all;
+        if (!open_input(in_all)) {
             result += "{$ERROR_OPENING}\n";
             return result;
         }
-
-        file.seekg (0, std::ios::end);
-        auto fsize = file.tellg();
-        file.seekg (0, std::ios::beg);
+        size_t fsize = in_all.size();
 
         size_t pos = file_name.find_last_of("/\\");
         std::string file_short = (pos == std::string::npos) ? file_name : file_name.substr(pos + 1);
@@ -281,102 +195,51 @@ namespace dsk_tools {
         result += "{$SIZE}: " + std::to_string(fsize) + " {$BYTES}\n";
         result += "\n";
 
-        BYTES in_all(fsize);
-        file.read (reinterpret_cast<char*>(in_all.data()), fsize);
+        if (!prepare_tracks_list(in_all.data(), in_all.size())) {
+            result += "{$ERROR_PARSING}\n";
+            return result;
+        }
 
-        prepare_tracks_list(in_all);
+        result += get_header_info(in_all.data(), in_all.size());
 
-        result += get_header_info(in_all);
+        // Tracks up to the first one out of the file bounds
+        int tracks = 0;
+        while (tracks < get_tracks_count()) {
+            int in_base = get_track_offset(tracks);
+            int track_len = get_track_len(tracks);
+            if (in_base < 0 || track_len < 0 || in_base + track_len > in_all.size()) break;
+            tracks++;
+        }
 
-        for (int track=0; track<get_tracks_count(); track++) {
-            int in_base = get_track_offset(track);
-            int track_len = get_track_len(track);
-            BYTES in(in_all.begin()+in_base, in_all.begin()+in_base+track_len);
-            result += "$" + dsk_tools::int_to_hex(static_cast<uint32_t>(in_base)) + ": {$TRACK} " + std::to_string(track) + "\n";
+        if (!m_scanned) {
+            BYTES buffer(get_tracks_count()*get_sectors_count()*256);
+            scan_tracks(in_all.data(), tracks, buffer.data(), m_scans);
+        }
 
-            result += (this->*track_info_func)(in, track_len);
+        for (int track=0; track<tracks; track++) {
+            result += "$" + dsk_tools::int_to_hex(static_cast<uint32_t>(get_track_offset(track))) + ": {$TRACK} " + std::to_string(track) + "\n";
+
+            bool errors = false;
+            result += track_report_func(m_scans[track], errors);
+            result += errors ? "{$ERROR_PARSING}\n" : "{$PARSING_FINISHED}\n";
 
             result += "\n";
         }
+        if (tracks < get_tracks_count())
+            result += "{$ERROR_PARSING}\n";
 
         return result;
     }
 
 
-    void LoaderMFM::load_agat140_track(int track, BYTES & buffer, const BYTES & in, int track_len)
+    void LoaderMFM::load_agat140_track(int track, uint8_t * buffer, const uint8_t * in, int track_len, TrackScan * scan)
     {
-        int res = dsk_tools::load_agat140_track(track, buffer, in, track_len);
+        dsk_tools::load_agat140_track(track, buffer, in, track_len, scan);
     }
 
-    void LoaderMFM::load_agat840_track(int track, BYTES & buffer, const BYTES & in, int track_len)
+    void LoaderMFM::load_agat840_track(int track, uint8_t * buffer, const uint8_t * in, int track_len, TrackScan * scan)
     {
-        int in_p = 0;
-        bool errors = false;
-
-        while (in_p < track_len) {
-            // Looking for Index Mark
-            bool index_found = false;
-            while (in_p < track_len) {
-                if (!iterate_until(in, in_p, 0x95)) break;
-                if (in_p < track_len) {
-                    uint8_t b1 = in.at(in_p++);
-                    if (b1 == 0x6A) {index_found = true; break;};
-                }
-            }
-            if (index_found) {
-                uint8_t r_v = in.at(in_p++);
-                uint8_t r_t = in.at(in_p++);
-                uint8_t r_s = in.at(in_p++);
-                // Index end mark
-                uint8_t ie = in.at(in_p++);
-                if (ie != 0x5A) errors = true;
-
-                // Data mark
-                bool data_found = false;
-                while (in_p < track_len) {
-                    if (!iterate_until(in, in_p, 0x6A)) break;
-                    if (in_p < track_len) {
-                        uint8_t b1 = in.at(in_p++);
-                        if (b1 == 0x95) {data_found = true; break;};
-                    }
-                }
-                if (data_found) {
-                    // Data
-                    bool error = false;
-                    uint16_t crc = 0;
-                    int data_p = in_p;
-
-                    for (int i=0; i<256; i++) {
-                        if (in_p >= track_len) {error = true; break;};
-                        uint8_t  d = in.at(in_p++);
-                        if (crc > 0xFF) crc = (crc + 1) & 0xFF;
-                        crc += d;
-                    }
-                    crc &= 0xFF;
-                    if (!error) {
-                        uint8_t r_crc = in.at(in_p++);
-                        if (r_crc != crc) errors = true;
-
-                        if (r_s < 21) {
-                            int offset = (track  * 21 + r_s) * 256;
-                            std::copy(
-                                in.begin() + data_p,
-                                in.begin() + data_p + 256,
-                                buffer.begin() + offset
-                                // buffer.begin() + (((track << 1) + s) * 21 + r_s) * 256
-                                );
-                        }
-
-                        // Data end mark
-                        uint8_t de = in.at(in_p++);
-                        if (de != 0x5A) errors = true;
-
-                    } else {
-                        errors = true;
-                    }
-                }
-            }
-        }
+        dsk_tools::decode_agat_840_track((buffer != nullptr) ? buffer + track * 21 * 256 : nullptr, in, track_len, scan);
     }
 
 }
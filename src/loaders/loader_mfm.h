@@ -5,7 +5,11 @@
 #pragma once
 
 
+#include <vector>
+
 #include "loader.h"
+#include "mapped_file.h"
+#include "track_scan.h"
 
 namespace dsk_tools {
 
@@ -15,6 +19,10 @@ namespace dsk_tools {
         LoaderMFM(const std::string & file_name, const std::string & format_id, const std::string & type_id);
         std::string file_info() override;
         Result load(BYTES & buffer, const DiskFormatParams &format = DiskFormatParams()) override;
+        Result open_lazy(size_t & buffer_size, size_t & track_size, const DiskFormatParams &format = DiskFormatParams()) override;
+        Result load_track(int track, uint8_t * buffer) override;
+        Result verify(VerifyReport & report) override;
+        Result read_raw_track(int track, BYTES & out) override;
 
     protected:
         int m_track_offsets[200];
@@ -22,22 +30,29 @@ namespace dsk_tools {
         int m_tracks_count;
         int m_sectors_count;
         int m_track_len;
-
-        using TrackInfoFunc = std::string (LoaderMFM::*)(BYTES&, int);
-        using LoadTrackFunc = void (LoaderMFM::*)(int, BYTES&, const BYTES&, int);
-        TrackInfoFunc track_info_func = nullptr;
+        MappedFile m_file;                                  // Kept open between load_track() calls
+        // Fields found by the last load(), file_info() formats them instead of decoding the tracks again
+        std::vector<TrackScan> m_scans;
+        bool m_scanned;
+
+        using TrackReportFunc = std::string (*)(const TrackScan &, bool &);
+        using LoadTrackFunc = void (LoaderMFM::*)(int, uint8_t*, const uint8_t*, int, TrackScan*);
+        TrackReportFunc track_report_func = nullptr;
         LoadTrackFunc load_track_func = nullptr;
 
         virtual int get_tracks_count() {return m_tracks_count;};
         virtual int get_sectors_count() {return m_sectors_count;};
         virtual int get_track_offset(int track) {return m_track_offsets[track];};
         virtual int get_track_len(int track) {return m_track_lengths[track];};
-        virtual std::string get_header_info(BYTES & in) {return "";};
-        virtual void prepare_tracks_list(BYTES & in);
-        std::string agat140_track_info(BYTES & in, int track_len);
-        std::string agat840_track_info(BYTES & in, int track_len);
-        void load_agat140_track(int track, BYTES & buffer, const BYTES & in, int track_len);
-        void load_agat840_track(int track, BYTES & buffer, const BYTES & in, int track_len);
+        virtual std::string get_header_info(const uint8_t * in, size_t size) {return "";};
+        virtual Result prepare_tracks_list(const uint8_t * in, size_t size);
+        Result open_tracks();
+        // Tracks [0, count) into scans; buffer may be nullptr to check the fields only
+        void scan_tracks(const uint8_t * in, int count, uint8_t * buffer, std::vector<TrackScan> & scans);
+        void add_bad_sectors(BadSectorTable & table, int track, const TrackScan & scan);
+        void verify_sectors(VerifyReport & report, int track, const TrackScan & scan);
+        void load_agat140_track(int track, uint8_t * buffer, const uint8_t * in, int track_len, TrackScan * scan);
+        void load_agat840_track(int track, uint8_t * buffer, const uint8_t * in, int track_len, TrackScan * scan);
     };
 
 }
@@ -9,6 +9,7 @@
 #include "host_helpers.h"
 
 #include "loader_raw.h"
+#include "mapped_file.h"
 #include "dsk_tools/dsk_tools.h"
 #include "fs_dos33.h"
 #include "utils.h"
@@ -18,31 +19,56 @@ LoaderRAW::LoaderRAW(const std::string &file_name, const std::string &format_id,
         Loader(file_name, format_id, type_id)
     {}
 
-    Result LoaderRAW::load(BYTES &buffer, const DiskFormatParams &format)
+    Result LoaderRAW::image_range(size_t file_size, const DiskFormatParams &format, size_t & offset, size_t & size)
     {
-        UTF8_ifstream file(file_name, std::ios::binary);
-
-        if (!file.good()) {
-            return Result::error(ErrorCode::LoadError, "Cannot open file");
-        }
-
-        file.seekg (0, std::ios::end);
-        auto fsize = file.tellg();
-        file.seekg (0, std::ios::beg);
-
         unsigned image_size = image_size_by_type(type_id, format);
         if (image_size == 0)
             return Result::error(ErrorCode::LoadParamsMismatch, "Unknown disk type");
 
-        if (fsize<image_size)
+        if (file_size<image_size)
             return Result::error(ErrorCode::LoadSizeMismatch, "File too small");
-        else
-        if (fsize == image_size + 256)
-            // Image with a 256-byte header?
-            file.seekg (256, std::ios::beg);
 
-        buffer.resize(image_size);
-        file.read (reinterpret_cast<char*>(buffer.data()), image_size);
+        // Image with a 256-byte header?
+        offset = (file_size == image_size + 256) ? 256 : 0;
+        size = image_size;
+        return Result::ok();
+    }
+
+    Result LoaderRAW::load(BYTES &buffer, const DiskFormatParams &format)
+    {
+        MappedFile file;
+        Result res = open_input(file);
+        if (!res) return res;
+
+        size_t offset, image_size;
+        res = image_range(file.size(), format, offset, image_size);
+        if (!res) return res;
+
+        buffer.assign(file.data() + offset, file.data() + offset + image_size);
+
+        loaded = true;
+
+        return Result::ok();
+    }
+
+    Result LoaderRAW::map(MappedFile & mapping, size_t & offset, size_t & size, const DiskFormatParams &format)
+    {
+        if (format_id != "FILE_RAW_MSB")
+            return Result::error(ErrorCode::NotImplementedYet, "Only MSB raw images can be mapped");
+
+        Result res = open_input(mapping, true);
+        if (!res) return res;
+
+        if (!mapping.is_mapped()) {
+            mapping.close();
+            return Result::error(ErrorCode::NotImplementedYet, "File can't be mapped");
+        }
+
+        res = image_range(mapping.size(), format, offset, size);
+        if (!res) {
+            mapping.close();
+            return res;
+        }
 
         loaded = true;
 
@@ -53,16 +79,13 @@ LoaderRAW::LoaderRAW(const std::string &file_name, const std::string &format_id,
     {
         std::string result = "";
 
-        UTF8_ifstream file(file_name, std::ios::binary);
-
-        if (!file.good()) {
+        FileReader file;
+        if (!open_input(file)) {
             result += "{$ERROR_OPENING}\n";
             return result;
         }
 
-        file.seekg (0, std::ios::end);
-        auto fsize = file.tellg();
-        file.seekg (0, std::ios::beg);
+        const uint64_t fsize = file.size();
 
         size_t pos = file_name.find_last_of("/\\");
         std::string file_short = (pos == std::string::npos) ? file_name : file_name.substr(pos + 1);
@@ -15,6 +15,10 @@ namespace dsk_tools {
             LoaderRAW(const std::string & file_name, const std::string & format_id, const std::string & type_id);
             Result load(BYTES & buffer, const DiskFormatParams &format = DiskFormatParams()) override;
             std::string file_info() override;
+            Result map(MappedFile & mapping, size_t & offset, size_t & size, const DiskFormatParams &format = DiskFormatParams()) override;
+
+        private:
+            Result image_range(size_t file_size, const DiskFormatParams &format, size_t & offset, size_t & size);
 
     };
 
@@ -0,0 +1,295 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2025 Mikhail Revzin <p3.141592653589793238462643@gmail.com>
+// Part of the dsk_tools project: https://github.com/Ptr314/dsk_tools
+// Description: A loader class for .WOZ files (https://applesaucefdc.com/woz/)
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "bitstream.h"
+#include "dsk_tools/dsk_tools.h"
+#include "loader_woz.h"
+#include "mapped_file.h"
+#include "pattern_scan.h"
+#include "thread_pool.h"
+#include "track_scan.h"
+#include "utils.h"
+
+namespace dsk_tools {
+
+    static const int WOZ_TRACKS = 35;
+    static const int WOZ_SECTORS = 16;
+
+    LoaderWOZ::LoaderWOZ(const std::string &file_name, const std::string &format_id, const std::string &type_id):
+        Loader(file_name, format_id, type_id)
+        , m_version(0)
+        , m_info()
+        , m_trks_offset(0)
+        , m_trks_size(0)
+        , m_scanned(false)
+    {
+        if (type_id != "TYPE_AGAT_140")
+            throw std::runtime_error("LoaderWOZ: Incorrect type id");
+    }
+
+    Result LoaderWOZ::parse_chunks(const uint8_t * in, size_t size)
+    {
+        if (size < sizeof(WOZ_HEADER))
+            return Result::error(ErrorCode::LoadIncorrectFile, "File too small");
+
+        const WOZ_HEADER * hdr = reinterpret_cast<const WOZ_HEADER *>(in);
+        if (std::memcmp(hdr->signature, "WOZ1", 4) == 0) m_version = 1;
+        else if (std::memcmp(hdr->signature, "WOZ2", 4) == 0) m_version = 2;
+        else return Result::error(ErrorCode::LoadIncorrectFile, "Invalid WOZ signature");
+
+        bool info_found = false;
+        bool tmap_found = false;
+        m_trks_size = 0;
+        size_t pos = sizeof(WOZ_HEADER);
+        while (pos + sizeof(WOZ_CHUNK_HEADER) <= size) {
+            const WOZ_CHUNK_HEADER * chunk = reinterpret_cast<const WOZ_CHUNK_HEADER *>(in + pos);
+            pos += sizeof(WOZ_CHUNK_HEADER);
+            if (chunk->size > size - pos)
+                return Result::error(ErrorCode::LoadDataCorrupt, "Chunk is out of file bounds");
+
+            if (std::memcmp(chunk->id, "INFO", 4) == 0) {
+                // Version 1 files have the first fields only, the rest is zeros
+                std::memset(&m_info, 0, sizeof(m_info));
+                std::memcpy(&m_info, in + pos, std::min<size_t>(chunk->size, sizeof(m_info)));
+                info_found = true;
+            } else
+            if (std::memcmp(chunk->id, "TMAP", 4) == 0) {
+                if (chunk->size < WOZ_TMAP_SIZE)
+                    return Result::error(ErrorCode::LoadDataCorrupt, "Track map is too short");
+                std::memcpy(m_tmap, in + pos, WOZ_TMAP_SIZE);
+                tmap_found = true;
+            } else
+            if (std::memcmp(chunk->id, "TRKS", 4) == 0) {
+                m_trks_offset = pos;
+                m_trks_size = chunk->size;
+            }
+            pos += chunk->size;
+        }
+
+        if (!info_found || !tmap_found || m_trks_size == 0)
+            return Result::error(ErrorCode::LoadIncorrectFile, "Required WOZ chunks are missing");
+        if (m_info.disk_type != 1)
+            return Result::error(ErrorCode::LoadIncorrectFile, "Only 5.25\" disks are supported");
+        return Result::ok();
+    }
+
+    Result LoaderWOZ::open_file()
+    {
+        if (m_file.data() != nullptr) return Result::ok();
+
+        Result res = open_input(m_file);
+        if (!res) return res;
+
+        res = parse_chunks(m_file.data(), m_file.size());
+        if (!res) m_file.close();
+        return res;
+    }
+
+    int LoaderWOZ::track_index(int track) const
+    {
+        // Some images have a whole track recorded at a neighbouring quarter track only
+        const int quarter = track * 4;
+        if (m_tmap[quarter] != 0xFF) return m_tmap[quarter];
+        if (quarter + 1 < WOZ_TMAP_SIZE && m_tmap[quarter + 1] != 0xFF) return m_tmap[quarter + 1];
+        if (quarter > 0 && m_tmap[quarter - 1] != 0xFF) return m_tmap[quarter - 1];
+        return -1;
+    }
+
+    bool LoaderWOZ::track_bits(int index, const uint8_t * & bits, uint32_t & bit_count) const
+    {
+        const uint8_t * trks = m_file.data() + m_trks_offset;
+        if (m_version == 1) {
+            if ((index + 1) * WOZ1_TRACK_SIZE > m_trks_size) return false;
+            const WOZ1_TRK * trk = reinterpret_cast<const WOZ1_TRK *>(trks + index * WOZ1_TRACK_SIZE + WOZ1_BITS_SIZE);
+            bits = trks + index * WOZ1_TRACK_SIZE;
+            bit_count = std::min<uint32_t>(trk->bit_count, WOZ1_BITS_SIZE * 8);
+            return true;
+        }
+
+        if ((index + 1) * sizeof(WOZ2_TRK) > m_trks_size) return false;
+        const WOZ2_TRK * trk = reinterpret_cast<const WOZ2_TRK *>(trks) + index;
+        const size_t offset = static_cast<size_t>(trk->starting_block) * WOZ_BLOCK_SIZE;
+        const size_t size = static_cast<size_t>(trk->block_count) * WOZ_BLOCK_SIZE;
+        if (offset > m_file.size() || size > m_file.size() - offset) return false;
+        bits = m_file.data() + offset;
+        bit_count = static_cast<uint32_t>(std::min<size_t>(trk->bit_count, size * 8));
+        return true;
+    }
+
+    void LoaderWOZ::decode_track(int track, uint8_t * buffer, TrackScratch & sc, TrackScan * scan)
+    {
+        const uint8_t * bits = nullptr;
+        uint32_t bit_count = 0;
+        const int index = track_index(track);
+        if (index < 0 || !track_bits(index, bits, bit_count) || bit_count < 8) {
+            // Blank or unreadable: nothing is found, every sector is reported bad
+            if (buffer != nullptr) std::memset(buffer + track * WOZ_SECTORS * 256, 0, WOZ_SECTORS * 256);
+            load_agat140_track(track, buffer, nullptr, 0, scan);
+            return;
+        }
+
+        // Two revolutions, so that the sector crossing the end of the track is read in one piece
+        sc.bits.assign((2 * static_cast<size_t>(bit_count) + 7) / 8 + 8, 0);
+        copy_bits(sc.bits.data(), 0, bits, bit_count);
+        copy_bits(sc.bits.data(), bit_count, bits, bit_count);
+        sc.nibbles.clear();
+        const size_t pos = read_nibbles(sc.bits.data(), 0, bit_count, sc.nibbles);
+        const int revolution = static_cast<int>(sc.nibbles.size());
+        read_nibbles(sc.bits.data(), pos, 2 * static_cast<size_t>(bit_count), sc.nibbles);
+
+        // One revolution starting at the first address field has every sector once and whole
+        int start = find_pattern(sc.nibbles.data(), revolution, 0, agat_140_address_prologue, sizeof(agat_140_address_prologue));
+        if (start < 0) start = 0;
+        const int track_len = std::min<int>(revolution, static_cast<int>(sc.nibbles.size()) - start);
+        load_agat140_track(track, buffer, sc.nibbles.data() + start, track_len, scan);
+    }
+
+    void LoaderWOZ::scan_tracks(uint8_t * buffer, std::vector<TrackScan> & scans)
+    {
+        scans.resize(WOZ_TRACKS);
+
+        std::shared_ptr<ThreadPool> pool = decode_pool();
+        std::vector<TrackScratch> scratch(ThreadPool::slots(pool.get()));
+        progress_start(m_progress.get(), ProgressStage::Load, WOZ_TRACKS);
+        ThreadPool::parallel_for(pool.get(), WOZ_TRACKS, [&](int track, int slot) {
+            if (is_cancelled(m_progress.get())) return;
+            decode_track(track, buffer, scratch[slot], &scans[track]);
+            progress_step(m_progress.get());
+        });
+    }
+
+    Result LoaderWOZ::load(BYTES &buffer, const DiskFormatParams &format)
+    {
+        Result res = open_file();
+        if (!res) return res;
+
+        buffer.assign(WOZ_TRACKS * WOZ_SECTORS * 256, 0);
+        scan_tracks(buffer.data(), m_scans);
+        m_file.close();
+        if (is_cancelled(m_progress.get())) {
+            m_scans.clear();
+            return Result::error(ErrorCode::Cancelled, "Loading cancelled");
+        }
+        m_scanned = true;
+
+        m_bad_sectors.clear();
+        for (int track=0; track<WOZ_TRACKS; track++)
+            add_bad_sectors(m_bad_sectors, m_scans[track], 0, track, WOZ_SECTORS, agat_140_raw2logic);
+
+        loaded = true;
+        return Result::ok();
+    }
+
+    Result LoaderWOZ::open_lazy(size_t & buffer_size, size_t & track_size, const DiskFormatParams &format)
+    {
+        Result res = open_file();
+        if (!res) return res;
+        m_bad_sectors.clear();
+
+        track_size = WOZ_SECTORS * 256;
+        buffer_size = WOZ_TRACKS * track_size;
+        return Result::ok();
+    }
+
+    Result LoaderWOZ::load_track(int track, uint8_t * buffer)
+    {
+        if (m_file.data() == nullptr || track < 0 || track >= WOZ_TRACKS)
+            return Result::error(ErrorCode::IncorrectRequest, "Track is not available");
+
+        TrackScratch sc;
+        TrackScan scan;
+        decode_track(track, buffer, sc, &scan);
+        BadSectorTable bad;
+        add_bad_sectors(bad, scan, 0, track, WOZ_SECTORS, agat_140_raw2logic);
+        merge_bad_sectors(bad);
+        return Result::ok();
+    }
+
+    Result LoaderWOZ::verify(VerifyReport & report)
+    {
+        // Kept open if load_track() is in use
+        const bool was_open = m_file.data() != nullptr;
+        Result res = open_file();
+        if (!res) return res;
+
+        std::vector<TrackScan> scans;
+        scan_tracks(nullptr, scans);
+        if (!was_open) m_file.close();
+        if (is_cancelled(m_progress.get())) return Result::error(ErrorCode::Cancelled, "Verification cancelled");
+
+        report.reset(1, WOZ_TRACKS, WOZ_SECTORS);
+        for (int track=0; track<WOZ_TRACKS; track++)
+            verify_sectors(report, scans[track], 0, track, agat_140_raw2logic);
+        return Result::ok();
+    }
+
+    std::string LoaderWOZ::file_info()
+    {
+        std::string result = "";
+
+        // Kept open if load_track() is in use
+        const bool was_open = m_file.data() != nullptr;
+        if (!was_open && !open_input(m_file)) {
+            result += "{$ERROR_OPENING}\n";
+            return result;
+        }
+
+        size_t pos = file_name.find_last_of("/\\");
+        std::string file_short = (pos == std::string::npos) ? file_name : file_name.substr(pos + 1);
+        result += "{$FILE_NAME}: " + file_short + "\n";
+        result += "{$SIZE}: " + std::to_string(m_file.size()) + " {$BYTES}\n";
+
+        if (!was_open && !parse_chunks(m_file.data(), m_file.size())) {
+            m_file.close();
+            result += "\n{$NO_SIGNATURE}\n";
+            return result;
+        }
+
+        const WOZ_HEADER * hdr = reinterpret_cast<const WOZ_HEADER *>(m_file.data());
+        result += "$" + dsk_tools::int_to_hex(static_cast<uint32_t>(0)) + " {$HEADER}\n";
+        result += "    {$SIGNATURE}: " + std::string(reinterpret_cast<const char*>(hdr->signature), sizeof(hdr->signature)) + "\n";
+        result += "    {$FORMAT_REVISION}: " + std::to_string(m_info.version) + "\n";
+        result += "    {$COMMENT}: " + trim(std::string(reinterpret_cast<const char*>(m_info.creator), sizeof(m_info.creator))) + "\n";
+        result += "\n";
+
+        result += "$" + dsk_tools::int_to_hex(static_cast<uint32_t>(m_trks_offset)) + " {$TRACKLIST_OFFSET}\n";
+        for (int track=0; track<WOZ_TRACKS; track++) {
+            const uint8_t * bits;
+            uint32_t bit_count;
+            const int index = track_index(track);
+            result += "    " + std::to_string(track) + ":";
+            if (index < 0 || !track_bits(index, bits, bit_count))
+                result += " -\n";
+            else
+                result += " {$TRACK_OFFSET}: $" + dsk_tools::int_to_hex(static_cast<uint32_t>(bits - m_file.data()), false)
+                          + ", {$TRACK_SIZE}: " + std::to_string(bit_count) + " bits\n";
+        }
+        result += "\n";
+
+        if (!m_scanned) {
+            BYTES buffer(WOZ_TRACKS * WOZ_SECTORS * 256);
+            scan_tracks(buffer.data(), m_scans);
+            m_scanned = !is_cancelled(m_progress.get());
+        }
+
+        for (int track=0; track<WOZ_TRACKS; track++) {
+            result += "{$TRACK} " + std::to_string(track) + "\n";
+
+            bool errors = false;
+            result += agat_140_track_report(m_scans[track], errors);
+            result += errors ? "{$ERROR_PARSING}\n" : "{$PARSING_FINISHED}\n";
+
+            result += "\n";
+        }
+
+        if (!was_open) m_file.close();
+        return result;
+    }
+
+}
@@ -0,0 +1,52 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2025 Mikhail Revzin <p3.141592653589793238462643@gmail.com>
+// Part of the dsk_tools project: https://github.com/Ptr314/dsk_tools
+// Description: A loader class for .WOZ files (https://applesaucefdc.com/woz/)
+#pragma once
+
+
+#include <vector>
+
+#include "loader.h"
+#include "mapped_file.h"
+#include "track_scan.h"
+
+namespace dsk_tools {
+
+    class LoaderWOZ:public Loader
+    {
+    public:
+        LoaderWOZ(const std::string & file_name, const std::string & format_id, const std::string & type_id);
+        Result load(BYTES & buffer, const DiskFormatParams &format = DiskFormatParams()) override;
+        std::string file_info() override;
+        Result open_lazy(size_t & buffer_size, size_t & track_size, const DiskFormatParams &format = DiskFormatParams()) override;
+        Result load_track(int track, uint8_t * buffer) override;
+        Result verify(VerifyReport & report) override;
+
+    protected:
+        // Buffers reused from track to track
+        struct TrackScratch {
+            BYTES bits;
+            BYTES nibbles;
+        };
+
+        MappedFile m_file;                                  // Kept open between load_track() calls
+        int m_version;
+        WOZ_INFO m_info;
+        uint8_t m_tmap[WOZ_TMAP_SIZE];
+        size_t m_trks_offset;
+        size_t m_trks_size;
+        // Fields found by the last load(), file_info() formats them instead of decoding the tracks again
+        std::vector<TrackScan> m_scans;
+        bool m_scanned;
+
+        Result open_file();                                 // Maps the file and finds the chunks
+        Result parse_chunks(const uint8_t * in, size_t size);
+        int track_index(int track) const;                   // TRKS entry, -1 for a blank track
+        bool track_bits(int index, const uint8_t * & bits, uint32_t & bit_count) const;
+        // buffer may be nullptr to check the fields only
+        void decode_track(int track, uint8_t * buffer, TrackScratch & sc, TrackScan * scan);
+        void scan_tracks(uint8_t * buffer, std::vector<TrackScan> & scans);
+    };
+
+}
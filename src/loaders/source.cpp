@@ -0,0 +1,97 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2025 Mikhail Revzin <p3.141592653589793238462643@gmail.com>
+// Part of the dsk_tools project: https://github.com/Ptr314/dsk_tools
+// Description: Inputs for loaders which are not files on disk: memory, descriptors, callbacks
+
+#include <cerrno>
+#include <cstring>
+
+#ifdef _WIN32
+    #include <io.h>
+    #include <stdio.h>
+#else
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#include "source.h"
+
+namespace dsk_tools {
+
+    static Result check_range(uint64_t offset, size_t size, uint64_t total)
+    {
+        if (offset > total || size > total - offset)
+            return Result::error(ErrorCode::LoadDataCorrupt, "Read beyond the end of file");
+        return Result::ok();
+    }
+
+    MemorySource::MemorySource(const uint8_t * data, size_t size):
+          m_data(data)
+        , m_size(size)
+    {}
+
+    MemorySource::MemorySource(BYTES && data):
+          m_owned(std::move(data))
+        , m_data(m_owned.data())
+        , m_size(m_owned.size())
+    {}
+
+    Result MemorySource::read_at(uint64_t offset, uint8_t * out, size_t size)
+    {
+        Result res = check_range(offset, size, m_size);
+        if (!res) return res;
+        std::memcpy(out, m_data + offset, size);
+        return Result::ok();
+    }
+
+    FdSource::FdSource(int fd):
+          m_fd(fd)
+        , m_size(0)
+    {
+#ifdef _WIN32
+        const long long fsize = ::_filelengthi64(fd);
+        if (fsize > 0) m_size = static_cast<uint64_t>(fsize);
+#else
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) m_size = static_cast<uint64_t>(st.st_size);
+#endif
+    }
+
+    Result FdSource::read_at(uint64_t offset, uint8_t * out, size_t size)
+    {
+        Result res = check_range(offset, size, m_size);
+        if (!res) return res;
+#ifdef _WIN32
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (::_lseeki64(m_fd, static_cast<long long>(offset), SEEK_SET) < 0)
+            return Result::error(ErrorCode::LoadError, "Cannot read file");
+#endif
+        size_t done = 0;
+        while (done < size) {
+#ifdef _WIN32
+            const int n = ::_read(m_fd, out + done, static_cast<unsigned>(size - done));
+#else
+            const ssize_t n = pread(m_fd, out + done, size - done, static_cast<off_t>(offset + done));
+#endif
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0)
+                return Result::error(ErrorCode::LoadError, "Cannot read file");
+            done += static_cast<size_t>(n);
+        }
+        return Result::ok();
+    }
+
+    CallbackSource::CallbackSource(uint64_t size, Callback callback):
+          m_size(size)
+        , m_callback(std::move(callback))
+    {}
+
+    Result CallbackSource::read_at(uint64_t offset, uint8_t * out, size_t size)
+    {
+        Result res = check_range(offset, size, m_size);
+        if (!res) return res;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_callback(offset, out, size);
+    }
+
+}
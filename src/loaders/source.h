@@ -0,0 +1,69 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2025 Mikhail Revzin <p3.141592653589793238462643@gmail.com>
+// Part of the dsk_tools project: https://github.com/Ptr314/dsk_tools
+// Description: Inputs for loaders which are not files on disk: memory, descriptors, callbacks
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+
+#include "definitions.h"
+
+namespace dsk_tools {
+
+    class Source
+    {
+    public:
+        virtual ~Source() = default;
+        virtual uint64_t size() const = 0;
+        // Safe to call from several threads at once; a short read is an error
+        virtual Result read_at(uint64_t offset, uint8_t * out, size_t size) = 0;
+        // All of the data if it is in memory already, nullptr otherwise
+        virtual const uint8_t * data() const {return nullptr;};
+    };
+
+    // Either borrowed memory, which must outlive the loader, or an owned buffer
+    class MemorySource: public Source
+    {
+    public:
+        MemorySource(const uint8_t * data, size_t size);
+        explicit MemorySource(BYTES && data);
+        uint64_t size() const override {return m_size;};
+        Result read_at(uint64_t offset, uint8_t * out, size_t size) override;
+        const uint8_t * data() const override {return m_data;};
+    private:
+        BYTES m_owned;
+        const uint8_t * m_data;
+        size_t m_size;
+    };
+
+    // A seekable file descriptor; it is not closed
+    class FdSource: public Source
+    {
+    public:
+        explicit FdSource(int fd);
+        uint64_t size() const override {return m_size;};
+        Result read_at(uint64_t offset, uint8_t * out, size_t size) override;
+    private:
+        int m_fd;
+        uint64_t m_size;
+        std::mutex m_mutex;                                     // Where there is no pread
+    };
+
+    // Calls are serialized, the callback doesn't have to be thread-safe
+    class CallbackSource: public Source
+    {
+    public:
+        using Callback = std::function<Result(uint64_t offset, uint8_t * out, size_t size)>;
+        CallbackSource(uint64_t size, Callback callback);
+        uint64_t size() const override {return m_size;};
+        Result read_at(uint64_t offset, uint8_t * out, size_t size) override;
+    private:
+        uint64_t m_size;
+        Callback m_callback;
+        std::mutex m_mutex;
+    };
+
+}
@@ -0,0 +1,212 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2025 Mikhail Revzin <p3.141592653589793238462643@gmail.com>
+// Part of the dsk_tools project: https://github.com/Ptr314/dsk_tools
+// Description: Input file access: a memory-mapped view of the whole file and positioned reads
+
+#include "host_helpers.h"
+#include "mapped_file.h"
+#include "source.h"
+
+#ifdef DSK_TOOLS_HAS_MMAP
+    #include <cerrno>
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+namespace dsk_tools {
+
+    MappedFile::~MappedFile()
+    {
+        close();
+    }
+
+    bool MappedFile::supported()
+    {
+#ifdef DSK_TOOLS_HAS_MMAP
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    Result MappedFile::open(const std::string & file_name, bool copy_on_write)
+    {
+        close();
+#ifdef DSK_TOOLS_HAS_MMAP
+        int fd = ::open(file_name.c_str(), O_RDONLY);
+        if (fd < 0)
+            return Result::error(ErrorCode::LoadError, "Cannot open file");
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+            // Empty files and special files can't be mapped
+            ::close(fd);
+            return read_stream(file_name);
+        }
+
+        int prot = copy_on_write ? (PROT_READ | PROT_WRITE) : PROT_READ;
+        void * p = mmap(nullptr, static_cast<size_t>(st.st_size), prot, MAP_PRIVATE, fd, 0);
+        ::close(fd);                                            // The mapping keeps its own reference
+        if (p == MAP_FAILED)
+            return read_stream(file_name);
+
+        m_data = static_cast<uint8_t*>(p);
+        m_size = static_cast<size_t>(st.st_size);
+        m_mapped = true;
+        m_writable = copy_on_write;
+        return Result::ok();
+#else
+        (void)copy_on_write;
+        return read_stream(file_name);
+#endif
+    }
+
+    Result MappedFile::open(Source & source, bool copy_on_write)
+    {
+        close();
+        if (source.data() != nullptr && !copy_on_write) {
+            m_data = const_cast<uint8_t*>(source.data());       // m_writable is false, never written to
+            m_size = static_cast<size_t>(source.size());
+            return Result::ok();
+        }
+
+        m_fallback.resize(static_cast<size_t>(source.size()));
+        Result res = source.read_at(0, m_fallback.data(), m_fallback.size());
+        if (!res) {
+            BYTES().swap(m_fallback);
+            return res;
+        }
+
+        m_data = m_fallback.data();
+        m_size = m_fallback.size();
+        m_writable = true;
+        return Result::ok();
+    }
+
+    Result MappedFile::read_stream(const std::string & file_name)
+    {
+        UTF8_ifstream file(file_name, std::ios::binary);
+        if (!file.good())
+            return Result::error(ErrorCode::LoadError, "Cannot open file");
+
+        file.seekg (0, std::ios::end);
+        auto fsize = file.tellg();
+        file.seekg (0, std::ios::beg);
+        if (fsize < 0)
+            return Result::error(ErrorCode::LoadError, "Cannot read file");
+
+        m_fallback.resize(static_cast<size_t>(fsize));
+        file.read (reinterpret_cast<char*>(m_fallback.data()), fsize);
+
+        m_data = m_fallback.data();
+        m_size = m_fallback.size();
+        m_mapped = false;
+        m_writable = true;
+        return Result::ok();
+    }
+
+    void MappedFile::close()
+    {
+#ifdef DSK_TOOLS_HAS_MMAP
+        if (m_mapped) munmap(m_data, m_size);
+#endif
+        BYTES().swap(m_fallback);
+        m_data = nullptr;
+        m_size = 0;
+        m_mapped = false;
+        m_writable = false;
+    }
+
+    FileReader::FileReader():
+          m_fd(-1)
+        , m_size(0)
+    {}
+
+    FileReader::~FileReader()
+    {
+        close();
+    }
+
+    Result FileReader::open(const std::string & file_name)
+    {
+        close();
+#ifdef DSK_TOOLS_HAS_MMAP
+        m_fd = ::open(file_name.c_str(), O_RDONLY);
+        if (m_fd < 0)
+            return Result::error(ErrorCode::LoadError, "Cannot open file");
+        struct stat st;
+        if (fstat(m_fd, &st) != 0) {
+            close();
+            return Result::error(ErrorCode::LoadError, "Cannot read file");
+        }
+        m_size = static_cast<uint64_t>(st.st_size);
+#else
+        std::unique_ptr<UTF8_ifstream> file(new UTF8_ifstream(file_name, std::ios::binary));
+        if (!file->good())
+            return Result::error(ErrorCode::LoadError, "Cannot open file");
+        file->seekg (0, std::ios::end);
+        auto fsize = file->tellg();
+        if (fsize < 0)
+            return Result::error(ErrorCode::LoadError, "Cannot read file");
+        m_size = static_cast<uint64_t>(fsize);
+        m_stream = std::move(file);
+#endif
+        return Result::ok();
+    }
+
+    Result FileReader::open(std::shared_ptr<Source> source)
+    {
+        close();
+        if (!source)
+            return Result::error(ErrorCode::LoadError, "No source");
+        m_size = source->size();
+        m_source = std::move(source);
+        return Result::ok();
+    }
+
+    bool FileReader::is_open() const
+    {
+        return m_fd >= 0 || m_stream != nullptr || m_source != nullptr;
+    }
+
+    Result FileReader::read_at(uint64_t offset, uint8_t * out, size_t size)
+    {
+        if (offset > m_size || size > m_size - offset)
+            return Result::error(ErrorCode::LoadDataCorrupt, "Read beyond the end of file");
+        if (m_source)
+            return m_source->read_at(offset, out, size);
+#ifdef DSK_TOOLS_HAS_MMAP
+        size_t done = 0;
+        while (done < size) {
+            const ssize_t n = pread(m_fd, out + done, size - done, static_cast<off_t>(offset + done));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0)
+                return Result::error(ErrorCode::LoadError, "Cannot read file");
+            done += static_cast<size_t>(n);
+        }
+#else
+        std::lock_guard<std::mutex> lock(m_stream_mutex);
+        if (!m_stream)
+            return Result::error(ErrorCode::LoadError, "File is not open");
+        m_stream->seekg (static_cast<std::streamoff>(offset), std::ios::beg);
+        m_stream->read (reinterpret_cast<char*>(out), static_cast<std::streamsize>(size));
+        if (!m_stream->good())
+            return Result::error(ErrorCode::LoadError, "Cannot read file");
+#endif
+        return Result::ok();
+    }
+
+    void FileReader::close()
+    {
+#ifdef DSK_TOOLS_HAS_MMAP
+        if (m_fd >= 0) ::close(m_fd);
+#endif
+        m_fd = -1;
+        m_stream.reset();
+        m_source.reset();
+        m_size = 0;
+    }
+
+}
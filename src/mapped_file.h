@@ -0,0 +1,81 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2025 Mikhail Revzin <p3.141592653589793238462643@gmail.com>
+// Part of the dsk_tools project: https://github.com/Ptr314/dsk_tools
+// Description: Input file access: a memory-mapped view of the whole file and positioned reads
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "definitions.h"
+#include "host_helpers.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+    #define DSK_TOOLS_HAS_MMAP 1
+#endif
+
+namespace dsk_tools {
+
+    class Source;
+
+    class MappedFile
+    {
+    public:
+        MappedFile() = default;
+        ~MappedFile();
+        MappedFile(const MappedFile &) = delete;
+        MappedFile & operator=(const MappedFile &) = delete;
+
+        // copy_on_write: pages may be modified through mutable_data(), changes never reach the file
+        Result open(const std::string & file_name, bool copy_on_write = false);
+        // Data already in memory is used in place unless copy_on_write is set, anything else is read in
+        Result open(Source & source, bool copy_on_write = false);
+        void close();
+
+        const uint8_t * data() const {return m_data;};
+        uint8_t * mutable_data() {return m_writable ? m_data : nullptr;};
+        size_t size() const {return m_size;};
+        bool is_mapped() const {return m_mapped;};
+
+        static bool supported();                // false: open() always reads the file into memory
+
+    private:
+        uint8_t * m_data = nullptr;
+        size_t m_size = 0;
+        bool m_mapped = false;
+        bool m_writable = false;
+        BYTES m_fallback;
+
+        Result read_stream(const std::string & file_name);
+    };
+
+    // Reads parts of a file without loading all of it, i.e. single tracks
+    class FileReader
+    {
+    public:
+        FileReader();
+        ~FileReader();
+        FileReader(const FileReader &) = delete;
+        FileReader & operator=(const FileReader &) = delete;
+
+        Result open(const std::string & file_name);
+        Result open(std::shared_ptr<Source> source);
+        void close();
+        bool is_open() const;
+        uint64_t size() const {return m_size;};
+
+        // Safe to call from several threads at once; a short read is an error
+        Result read_at(uint64_t offset, uint8_t * out, size_t size);
+
+    private:
+        int m_fd;
+        uint64_t m_size;
+        std::unique_ptr<UTF8_ifstream> m_stream;                // Where pread is not available
+        std::shared_ptr<Source> m_source;
+        std::mutex m_stream_mutex;
+    };
+
+}
@@ -0,0 +1,110 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2025 Mikhail Revzin <p3.141592653589793238462643@gmail.com>
+// Part of the dsk_tools project: https://github.com/Ptr314/dsk_tools
+// Description: Search for sync marks (address and data prologues) in track data
+
+#include <cstring>
+
+#include "pattern_scan.h"
+#include "simd.h"
+
+#ifdef DSK_TOOLS_X86_SIMD
+    #include <immintrin.h>
+    #ifdef _MSC_VER
+        #include <intrin.h>
+    #endif
+#endif
+
+namespace dsk_tools {
+
+    // All positions below are in bytes; stride is 1 for plain tracks and 2 for AIM words,
+    // pattern bytes are stride bytes apart. A match may start at s < limit only.
+
+    static bool matches_at(const uint8_t * in, int s, int stride, const uint8_t * pattern, int pattern_len)
+    {
+        for (int k = 0; k < pattern_len; k++)
+            if (in[s + k*stride] != pattern[k]) return false;
+        return true;
+    }
+
+    static int find_scalar(const uint8_t * in, int s, int limit, int stride, const uint8_t * pattern, int pattern_len)
+    {
+        if (stride == 1) {
+            while (s < limit) {
+                const void * q = std::memchr(in + s, pattern[0], limit - s);
+                if (q == nullptr) return -1;
+                s = static_cast<int>(static_cast<const uint8_t*>(q) - in);
+                if (std::memcmp(in + s + 1, pattern + 1, pattern_len - 1) == 0) return s;
+                s++;
+            }
+        } else {
+            for (; s < limit; s += stride)
+                if (matches_at(in, s, stride, pattern, pattern_len)) return s;
+        }
+        return -1;
+    }
+
+#ifdef DSK_TOOLS_X86_SIMD
+    static inline int lowest_bit(uint32_t m)
+    {
+    #ifdef _MSC_VER
+        unsigned long i;
+        _BitScanForward(&i, m);
+        return static_cast<int>(i);
+    #else
+        return __builtin_ctz(m);
+    #endif
+    }
+
+    // Candidates are the positions where both of the first two pattern bytes match,
+    // the rest of a long pattern is checked one by one.
+    // Used for AIM words only: memchr is already vectorized by the C library and wins on plain tracks,
+    // a 256-bit variant was not faster than this one
+    DSK_TARGET_SSE2
+    static int find_sse2(const uint8_t * in, int s, int end, int limit, int stride, const uint8_t * pattern, int pattern_len)
+    {
+        const __m128i p0 = _mm_set1_epi8(static_cast<char>(pattern[0]));
+        const __m128i p1 = _mm_set1_epi8(static_cast<char>(pattern[pattern_len > 1 ? 1 : 0]));
+        const uint32_t lanes = (stride == 1) ? 0xFFFF : 0x5555;
+        const int next = (pattern_len > 1) ? stride : 0;
+        while (s < limit && s + next + 16 <= end) {
+            const __m128i c0 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + s)), p0);
+            const __m128i c1 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + s + next)), p1);
+            uint32_t m = static_cast<uint32_t>(_mm_movemask_epi8(_mm_and_si128(c0, c1))) & lanes;
+            while (m) {
+                const int c = s + lowest_bit(m);
+                if (c >= limit) return -1;
+                if (matches_at(in, c, stride, pattern, pattern_len)) return c;
+                m &= m - 1;
+            }
+            s += 16;
+        }
+        return find_scalar(in, s, limit, stride, pattern, pattern_len);
+    }
+#endif
+
+    static int find_strided(const uint8_t * in, int end, int s, int stride, const uint8_t * pattern, int pattern_len)
+    {
+        if (s < 0) s = 0;
+        if (pattern_len <= 0) return (s <= end) ? s : -1;
+        const int limit = end - (pattern_len - 1) * stride;
+        if (s >= limit) return -1;
+#ifdef DSK_TOOLS_X86_SIMD
+        if (stride != 1 && simd_level() != SimdLevel::Scalar)
+            return find_sse2(in, s, end, limit, stride, pattern, pattern_len);
+#endif
+        return find_scalar(in, s, limit, stride, pattern, pattern_len);
+    }
+
+    int find_pattern(const uint8_t * in, int len, int from, const uint8_t * pattern, int pattern_len)
+    {
+        return find_strided(in, len, from, 1, pattern, pattern_len);
+    }
+
+    int find_pattern_words(const uint8_t * in, int words, int from, const uint8_t * pattern, int pattern_len)
+    {
+        const int pos = find_strided(in, words * 2, from * 2, 2, pattern, pattern_len);
+        return (pos < 0) ? -1 : pos / 2;
+    }
+
+}
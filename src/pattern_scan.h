@@ -0,0 +1,46 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2025 Mikhail Revzin <p3.141592653589793238462643@gmail.com>
+// Part of the dsk_tools project: https://github.com/Ptr314/dsk_tools
+// Description: Search for sync marks (address and data prologues) in track data
+#pragma once
+
+#include <cstdint>
+
+namespace dsk_tools {
+
+    static const uint8_t agat_140_address_prologue[3] = {0xD5, 0xAA, 0x96};
+    static const uint8_t agat_140_data_prologue[3]    = {0xD5, 0xAA, 0xAD};
+    static const uint8_t agat_140_epilogue[3]         = {0xDE, 0xAA, 0xEB};
+    static const uint8_t agat_840_address_mark[2]     = {0x95, 0x6A};
+    static const uint8_t agat_840_data_mark[2]        = {0x6A, 0x95};
+
+    // Position of the first pattern occurrence in in[from, len), or -1
+    int find_pattern(const uint8_t * in, int len, int from, const uint8_t * pattern, int pattern_len);
+
+    // Same over 16-bit little-endian words (AIM): only low bytes are compared, positions are in words
+    int find_pattern_words(const uint8_t * in, int words, int from, const uint8_t * pattern, int pattern_len);
+
+    // Moves p right after the pattern; false and p = len if there is none
+    inline bool skip_past(const uint8_t * in, int len, int & p, const uint8_t * pattern, int pattern_len)
+    {
+        const int pos = find_pattern(in, len, p, pattern, pattern_len);
+        if (pos < 0) {
+            p = len;
+            return false;
+        }
+        p = pos + pattern_len;
+        return true;
+    }
+
+    inline bool skip_past_words(const uint8_t * in, int words, int & p, const uint8_t * pattern, int pattern_len)
+    {
+        const int pos = find_pattern_words(in, words, p, pattern, pattern_len);
+        if (pos < 0) {
+            p = words;
+            return false;
+        }
+        p = pos + pattern_len;
+        return true;
+    }
+
+}
@@ -0,0 +1,39 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2025 Mikhail Revzin <p3.141592653589793238462643@gmail.com>
+// Part of the dsk_tools project: https://github.com/Ptr314/dsk_tools
+// Description: Per-track progress and cooperative cancellation of long operations
+
+#include "progress.h"
+
+namespace dsk_tools {
+
+    Progress::Progress(Callback callback):
+          m_callback(std::move(callback))
+        , m_cancelled(false)
+        , m_stage(ProgressStage::Other)
+        , m_done(0)
+        , m_total(0)
+    {}
+
+    void Progress::start(ProgressStage stage, int total)
+    {
+        m_stage = stage;
+        m_total = total;
+        m_done = 0;
+        if (m_callback) {
+            std::lock_guard<std::mutex> lock(m_callback_mutex);
+            m_callback(stage, 0, total);
+        }
+    }
+
+    void Progress::step()
+    {
+        ++m_done;
+        if (m_callback) {
+            // Read under the lock, so that the callback never sees done going back
+            std::lock_guard<std::mutex> lock(m_callback_mutex);
+            m_callback(m_stage, m_done, m_total);
+        }
+    }
+
+}
@@ -0,0 +1,50 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2025 Mikhail Revzin <p3.141592653589793238462643@gmail.com>
+// Part of the dsk_tools project: https://github.com/Ptr314/dsk_tools
+// Description: Per-track progress and cooperative cancellation of long operations
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+
+namespace dsk_tools {
+
+    enum class ProgressStage {Load, Write, Other};
+
+    // Shared by the caller and the loader or writer doing the work. Track loops call step()
+    // after every track and stop as soon as cancelled() is set
+    class Progress
+    {
+    public:
+        // Called from the thread which has finished the track; never called concurrently
+        using Callback = std::function<void(ProgressStage stage, int done, int total)>;
+
+        explicit Progress(Callback callback = nullptr);
+        Progress(const Progress &) = delete;
+        Progress & operator=(const Progress &) = delete;
+
+        void cancel() {m_cancelled = true;};
+        bool cancelled() const {return m_cancelled;};
+
+        void start(ProgressStage stage, int total);             // Starts counting from zero
+        void step();                                            // One more track is done
+        ProgressStage stage() const {return m_stage;};
+        int done() const {return m_done;};
+        int total() const {return m_total;};
+
+    private:
+        Callback m_callback;
+        std::mutex m_callback_mutex;
+        std::atomic<bool> m_cancelled;
+        std::atomic<ProgressStage> m_stage;
+        std::atomic<int> m_done;
+        std::atomic<int> m_total;
+    };
+
+    // The same for the track loops, where there may be no progress at all
+    inline bool is_cancelled(const Progress * progress) {return progress != nullptr && progress->cancelled();}
+    inline void progress_start(Progress * progress, ProgressStage stage, int total) {if (progress != nullptr) progress->start(stage, total);}
+    inline void progress_step(Progress * progress) {if (progress != nullptr) progress->step();}
+
+}
@@ -0,0 +1,142 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2025 Mikhail Revzin <p3.141592653589793238462643@gmail.com>
+// Part of the dsk_tools project: https://github.com/Ptr314/dsk_tools
+// Description: Time a real drive takes to read a sequence of sectors from encoded tracks
+
+#include <cmath>
+#include <cstdlib>
+
+#include "read_timing.h"
+#include "agat_mfm.h"
+#include "gcr62.h"
+#include "sector_layout.h"
+#include "track_scan.h"
+#include "dsk_tools/dsk_tools.h"
+
+namespace dsk_tools {
+
+    DriveTiming default_drive_timing(const std::string & type_id)
+    {
+        // The stepper of a 140K drive is moved by the DOS itself, phase by phase, settling included
+        if (type_id == "TYPE_AGAT_140") return DriveTiming(0.020, 0, 0, 0.006);
+        // A Shugart drive: 6 ms steps, 15 ms to settle
+        if (type_id == "TYPE_AGAT_840") return DriveTiming(0.006, 0.015, 0.0002, 0.004);
+        return DriveTiming(0.006, 0.015, 0.0002, 0);
+    }
+
+    RotationSimulator::RotationSimulator(unsigned bitrate, unsigned rpm, const DriveTiming & drive):
+          m_bitrate(bitrate)
+        , m_rpm(rpm)
+        , m_drive(drive)
+    {}
+
+    Result RotationSimulator::add_side(unsigned head, unsigned track, const BYTES & stream, const std::string & type_id)
+    {
+        if (stream.empty()) return Result::error(ErrorCode::IncorrectRequest, "Empty track");
+
+        // Fields are found in bytes, MFM cells are decoded to them first
+        TrackScan scan;
+        BYTES decoded;
+        int data_size;                                      // From the data mark to the end of the field
+        if (type_id == "TYPE_AGAT_140") {
+            load_agat140_track(track, nullptr, stream.data(), stream.size(), &scan);
+            data_size = 3 + GCR62_ENCODED_SIZE + 3;
+        } else
+        if (type_id == "TYPE_AGAT_840") {
+            decoded.resize(stream.size() / 2);
+            decode_agat_mfm(stream.data(), decoded.data(), decoded.size());
+            decode_agat_840_track(nullptr, decoded.data(), decoded.size(), &scan);
+            data_size = 2 + 256 + 2;
+        } else
+            return Result::error(ErrorCode::WriteUnsupported, "Timing is not supported for this disk type");
+
+        const double length = decoded.empty() ? stream.size() : decoded.size();
+        const double byte_time = (m_bitrate != 0) ? 8.0 / (m_bitrate * 1000.0) : 0;
+        SideFields & side = m_sides[side_key(head, track)];
+        side = SideFields();
+        side.revolution = (m_rpm != 0) ? 60.0 / m_rpm : length * byte_time;
+        if (side.revolution <= 0) return Result::error(ErrorCode::IncorrectRequest, "Neither rpm nor bitrate is known");
+
+        for (const SectorScan & field : scan.sectors) {
+            if (!field.index_complete || field.data_pos < 0 || !field.data_complete) continue;
+            if (side.start.count(field.sector) != 0) continue;         // The first copy is found first
+            const double start = field.index_pos / length * side.revolution;
+            const int field_bytes = field.data_pos + data_size - field.index_pos;
+            const double duration = (byte_time != 0) ? field_bytes * byte_time : field_bytes / length * side.revolution;
+            side.start[field.sector] = start;
+            side.end[field.sector] = start + duration;
+        }
+        return Result::ok();
+    }
+
+    Result RotationSimulator::simulate(const std::vector<SectorRead> & reads, ReadTimes & times) const
+    {
+        times = ReadTimes();
+        times.requests.reserve(reads.size());
+
+        double now = 0;
+        unsigned head = 0;
+        unsigned track = 0;
+        for (size_t i = 0; i < reads.size(); i++) {
+            const SectorRead & read = reads[i];
+            const auto it = m_sides.find(side_key(read.head, read.track));
+            if (it == m_sides.end())
+                return Result::error(ErrorCode::NotFound, "Track " + std::to_string(read.track) + " is not added");
+            const SideFields & side = it->second;
+            const auto start = side.start.find(read.sector);
+            if (start == side.start.end())
+                return Result::error(ErrorCode::NotFound, "Sector " + std::to_string(read.track) + ":" + std::to_string(read.head)
+                                                            + ":" + std::to_string(read.sector) + " not found");
+
+            ReadLatency latency;
+            latency.processing = (i > 0) ? m_drive.processing : 0;
+            latency.seek = 0;
+            if (read.track != track)
+                latency.seek = std::abs(static_cast<int>(read.track) - static_cast<int>(track)) * m_drive.step + m_drive.settle;
+            else
+            if (read.head != head)
+                latency.seek = m_drive.head_switch;
+
+            // The disk keeps turning while the system is busy
+            const double ready = now + latency.processing + latency.seek;
+            const double angle = std::fmod(ready, side.revolution);
+            latency.wait = std::fmod(start->second - angle + side.revolution, side.revolution);
+            latency.transfer = side.end.at(read.sector) - start->second;
+
+            now = ready + latency.wait + latency.transfer;
+            times.requests.push_back(latency);
+            head = read.head;
+            track = read.track;
+            times.revolution = side.revolution;
+        }
+        times.total = now;
+        return Result::ok();
+    }
+
+    Result simulate_reads(diskImage * image, Writer & writer, const std::vector<SectorRead> & reads,
+                          const DriveTiming & drive, ReadTimes & times)
+    {
+        const std::string type_id = image->get_type_id();
+        const bool agat_140 = type_id == "TYPE_AGAT_140";
+        RotationSimulator simulator(image->get_bitrate(), image->get_rpm(), drive);
+
+        std::vector<SectorRead> found;
+        found.reserve(reads.size());
+        BYTES stream;
+        for (const SectorRead & read : reads) {
+            // The image keeps 140K sectors in the DOS order, their address fields have the physical numbers
+            SectorRead sector = read;
+            if (agat_140) sector.sector = agat_140_logic2raw(read.sector);
+            found.push_back(sector);
+
+            if (simulator.has_side(sector.head, sector.track)) continue;
+            stream.clear();
+            Result res = writer.encode_side(sector.head, sector.track, stream);
+            if (!res) return res;
+            res = simulator.add_side(sector.head, sector.track, stream, type_id);
+            if (!res) return res;
+        }
+        return simulator.simulate(found, times);
+    }
+
+}
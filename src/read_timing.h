@@ -0,0 +1,91 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2025 Mikhail Revzin <p3.141592653589793238462643@gmail.com>
+// Part of the dsk_tools project: https://github.com/Ptr314/dsk_tools
+// Description: Time a real drive takes to read a sequence of sectors from encoded tracks
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "definitions.h"
+
+namespace dsk_tools {
+
+    class diskImage;
+    class Writer;
+
+    // Mechanics of the drive and the time the system needs between sectors, in seconds
+    struct DriveTiming {
+        double step;                        // Per track stepped
+        double settle;                      // After the last step
+        double head_switch;
+        double processing;                  // From the end of a data field until the next address field can be caught
+
+        DriveTiming(): step(0), settle(0), head_switch(0), processing(0) {}
+        DriveTiming(double step, double settle, double head_switch, double processing)
+            : step(step), settle(settle), head_switch(head_switch), processing(processing) {}
+    };
+
+    // Estimates for the Agat drives with their DOS, by the image type id
+    DriveTiming default_drive_timing(const std::string & type_id);
+
+    // A sector as it is found on the disk, the number in its address field; or in the image, see simulate_reads()
+    struct SectorRead {
+        unsigned head;
+        unsigned track;                     // Cylinder
+        unsigned sector;
+    };
+
+    struct ReadLatency {
+        double processing;                  // Of the sector read before
+        double seek;                        // Stepping, settling or switching the head
+        double wait;                        // Until the address field comes under the head
+        double transfer;                    // The address and data fields
+
+        double total() const {return processing + seek + wait + transfer;};
+    };
+
+    struct ReadTimes {
+        std::vector<ReadLatency> requests;  // In the order of the reads
+        double total;                       // Seconds from the first request, at track 0 at the index, to the last data byte
+        double revolution;
+
+        ReadTimes(): total(0), revolution(0) {}
+    };
+
+    // The drive starts on track 0, side 0, at the index; every read waits for the one before it
+    class RotationSimulator
+    {
+    public:
+        // bitrate in kbit/s sets how long the fields take; a stream is one revolution at rpm,
+        // or as long as its bytes take at the bitrate if rpm is 0
+        RotationSimulator(unsigned bitrate, unsigned rpm, const DriveTiming & drive);
+
+        // One side of a track as Writer::encode_side() makes it, for TYPE_AGAT_140 or TYPE_AGAT_840
+        Result add_side(unsigned head, unsigned track, const BYTES & stream, const std::string & type_id);
+        bool has_side(unsigned head, unsigned track) const {return m_sides.count(side_key(head, track)) != 0;};
+        // NotFound if a sector has no complete data field, or its side was not added
+        Result simulate(const std::vector<SectorRead> & reads, ReadTimes & times) const;
+
+    private:
+        struct SideFields {
+            double revolution;
+            std::map<unsigned, double> start;       // Per sector: the address field, from the index
+            std::map<unsigned, double> end;         // The end of the data field
+        };
+
+        unsigned m_bitrate;
+        unsigned m_rpm;
+        DriveTiming m_drive;
+        std::map<unsigned, SideFields> m_sides;
+
+        static unsigned side_key(unsigned head, unsigned track) {return track * 2 + head;};
+    };
+
+    // Reads as the image's get_sector_data() sees them, see diskImage::trace_reads(), are found on the tracks
+    // the writer encodes; only the tracks read are encoded. The image's bitrate and rpm are used
+    Result simulate_reads(diskImage * image, Writer & writer, const std::vector<SectorRead> & reads,
+                          const DriveTiming & drive, ReadTimes & times);
+
+}
@@ -0,0 +1,185 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2025 Mikhail Revzin <p3.141592653589793238462643@gmail.com>
+// Part of the dsk_tools project: https://github.com/Ptr314/dsk_tools
+// Description: Order of sectors on encoded tracks, and its choice for the fastest reading on a real drive
+
+#include <stdexcept>
+
+#include "definitions.h"
+#include "sector_layout.h"
+
+namespace dsk_tools {
+
+    bool SectorLayout::is_default() const
+    {
+        if (track_skew != 0 || head_skew != 0) return false;
+        for (size_t slot = 0; slot < order.size(); slot++)
+            if (order[slot] != slot) return false;
+        return true;
+    }
+
+    bool SectorLayout::is_valid(unsigned sectors) const
+    {
+        if (order.empty()) return true;
+        if (order.size() != sectors) return false;
+        std::vector<bool> seen(sectors, false);
+        for (unsigned sector : order) {
+            if (sector >= sectors || seen[sector]) return false;
+            seen[sector] = true;
+        }
+        return true;
+    }
+
+    unsigned SectorLayout::sector_at(unsigned slot, unsigned track, unsigned head, unsigned sectors) const
+    {
+        const unsigned rotation = (track * track_skew + head * head_skew) % sectors;
+        const unsigned index = (slot + sectors - rotation) % sectors;
+        return (order.size() == sectors) ? order[index] : index;
+    }
+
+    std::string SectorLayout::to_string() const
+    {
+        std::string result;
+        for (unsigned sector : order)
+            result += (result.empty() ? "" : ",") + std::to_string(sector);
+        if (result.empty()) result = "in order";
+        return result + "; track skew " + std::to_string(track_skew) + ", head skew " + std::to_string(head_skew);
+    }
+
+    unsigned agat_140_logic2raw(unsigned logical)
+    {
+        for (unsigned sector = 0; sector < 16; sector++)
+            if (static_cast<unsigned>(agat_140_raw2logic[sector]) == logical) return sector;
+        return logical;
+    }
+
+    // RWTS misses the sector right after the one it has read. The next track is ready 26 ms after the last sector,
+    // a bit over two slots of the 200 ms revolution, so its first sector can come in the third. See default_drive_timing()
+    ReadPattern dos33_read_pattern()
+    {
+        ReadPattern pattern;
+        for (int logical = 15; logical >= 0; logical--)
+            pattern.order.push_back(agat_140_logic2raw(logical));
+        pattern.gap = 1;
+        pattern.step = 3;
+        pattern.head_switch = 0;
+        return pattern;
+    }
+
+    ReadPattern cpm_read_pattern(const std::string & filesystem_id)
+    {
+        ReadPattern pattern;
+        for (unsigned sector = 0; sector < 16; sector++) {
+            unsigned logical;
+            if (filesystem_id == "FILESYSTEM_CPM_RAW")
+                logical = sector;
+            else
+            if (filesystem_id == "FILESYSTEM_CPM_DOS")
+                logical = agat_140_cpm2dos[sector];
+            else
+            if (filesystem_id == "FILESYSTEM_CPM_PRODOS")
+                logical = agat_140_cpm2prodos[sector];
+            else
+                throw std::runtime_error("Incorrect filesystem id");
+            pattern.order.push_back(agat_140_logic2raw(logical));
+        }
+        pattern.gap = 1;
+        pattern.step = 3;
+        pattern.head_switch = 0;
+        return pattern;
+    }
+
+    ReadPattern sequential_read_pattern(unsigned sectors)
+    {
+        ReadPattern pattern;
+        for (unsigned sector = 0; sector < sectors; sector++)
+            pattern.order.push_back(sector);
+        pattern.gap = 1;
+        pattern.step = 3;
+        pattern.head_switch = 1;
+        return pattern;
+    }
+
+    size_t read_slots(const SectorLayout & layout, const ReadPattern & pattern, unsigned sectors, unsigned tracks, unsigned heads)
+    {
+        if (sectors == 0 || pattern.order.empty()) return 0;
+
+        std::vector<unsigned> slot_of(sectors, 0);
+        size_t time = 0;                                    // Slot under the head is time % sectors
+        for (unsigned track = 0; track < tracks; track++) {
+            for (unsigned head = 0; head < heads; head++) {
+                for (unsigned slot = 0; slot < sectors; slot++)
+                    slot_of[layout.sector_at(slot, track, head, sectors)] = slot;
+                for (size_t i = 0; i < pattern.order.size(); i++) {
+                    if (i > 0) time += pattern.gap;
+                    const unsigned slot = slot_of[pattern.order[i] % sectors];
+                    time += (slot + sectors - time % sectors) % sectors + 1;
+                }
+                time += (head + 1 < heads) ? pattern.head_switch : pattern.step;
+            }
+        }
+        return time;
+    }
+
+    // Every next sector of the pattern goes gap slots after the previous one, or to the first free slot after that
+    static std::vector<unsigned> interleaved_order(const ReadPattern & pattern, unsigned sectors, unsigned gap)
+    {
+        std::vector<unsigned> order(sectors, sectors);
+        std::vector<bool> placed(sectors, false);
+        unsigned slot = 0;
+        for (size_t i = 0; i < pattern.order.size(); i++) {
+            const unsigned sector = pattern.order[i] % sectors;
+            if (placed[sector]) continue;
+            if (i > 0) slot = (slot + 1 + gap) % sectors;
+            while (order[slot] != sectors) slot = (slot + 1) % sectors;
+            order[slot] = sector;
+            placed[sector] = true;
+        }
+        // Sectors the pattern doesn't read
+        unsigned next = 0;
+        for (unsigned & s : order) {
+            if (s != sectors) continue;
+            while (placed[next]) next++;
+            s = next;
+            placed[next] = true;
+        }
+        return order;
+    }
+
+    // The first sector of the next track or side comes right when the drive is ready for it
+    static void set_skews(SectorLayout & layout, const ReadPattern & pattern, unsigned sectors, unsigned heads)
+    {
+        std::vector<unsigned> slot_of(sectors, 0);
+        for (unsigned slot = 0; slot < sectors; slot++)
+            slot_of[layout.sector_at(slot, 0, 0, sectors)] = slot;
+        const unsigned first = slot_of[pattern.order.front() % sectors];
+        const unsigned last = slot_of[pattern.order.back() % sectors];
+        const unsigned to_head = (last + 1 + pattern.head_switch + sectors - first) % sectors;
+        const unsigned to_track = (last + 1 + pattern.step + sectors - first) % sectors;
+
+        layout.head_skew = (heads > 1) ? to_head : 0;
+        // The next track is read after the last side: from there, not from side 0
+        layout.track_skew = (layout.head_skew * (heads - 1) + to_track) % sectors;
+    }
+
+    SectorLayout optimize_layout(const ReadPattern & pattern, unsigned sectors, unsigned tracks, unsigned heads)
+    {
+        SectorLayout best;
+        if (sectors == 0 || pattern.order.empty() || heads == 0) return best;
+        size_t best_slots = read_slots(best, pattern, sectors, tracks, heads);
+
+        // The default order with skews, then every interleave
+        SectorLayout candidate;
+        for (unsigned gap = 0; gap <= sectors; gap++) {
+            candidate.order = (gap == 0) ? std::vector<unsigned>() : interleaved_order(pattern, sectors, gap - 1);
+            set_skews(candidate, pattern, sectors, heads);
+            const size_t slots = read_slots(candidate, pattern, sectors, tracks, heads);
+            if (slots < best_slots) {
+                best = candidate;
+                best_slots = slots;
+            }
+        }
+        return best;
+    }
+
+}
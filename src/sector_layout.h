@@ -0,0 +1,52 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2025 Mikhail Revzin <p3.141592653589793238462643@gmail.com>
+// Part of the dsk_tools project: https://github.com/Ptr314/dsk_tools
+// Description: Order of sectors on encoded tracks, and its choice for the fastest reading on a real drive
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace dsk_tools {
+
+    // Sector fields of an encoded track are equal frames, slots, in the order they pass under the head.
+    // The track is rotated by track * track_skew + head * head_skew slots, so that the first sector read
+    // on a track comes just when the drive is ready after stepping or switching the head
+    struct SectorLayout {
+        std::vector<unsigned> order;                        // Sector numbers, as in address fields, per slot; empty: 0, 1, 2...
+        unsigned track_skew;                                // From a track to the next one, the same side
+        unsigned head_skew;                                 // From side 0 to side 1 of the same track
+
+        SectorLayout(): track_skew(0), head_skew(0) {}
+        bool is_default() const;                            // Sectors in order, no skew: tracks as written before layouts
+        bool is_valid(unsigned sectors) const;              // order is empty or has every sector once
+        unsigned sector_at(unsigned slot, unsigned track, unsigned head, unsigned sectors) const;
+        std::string to_string() const;
+    };
+
+    // How the system reads a disk, times are in slots, i.e. the time one sector frame takes to pass
+    struct ReadPattern {
+        std::vector<unsigned> order;                        // Sector numbers, as in address fields, in the order they are read
+        unsigned gap;                                       // After a sector is read, the next one can be found this much later
+        unsigned step;                                      // From the last sector read on a track to being ready on the next one
+        unsigned head_switch;                               // The same for the other side of the track
+    };
+
+    // Physical sector number, as in the address field, of a 140K DOS logical sector: the inverse of agat_140_raw2logic
+    unsigned agat_140_logic2raw(unsigned logical);
+
+    // DOS 3.3 reads a track from logical sector 15 down to 0
+    ReadPattern dos33_read_pattern();
+    // CP/M reads its sectors in ascending order, through the filesystem's translation: FILESYSTEM_CPM_RAW, _DOS or _PRODOS
+    ReadPattern cpm_read_pattern(const std::string & filesystem_id);
+    // Agat 840 DOS reads the sectors of a side in order, then the other side
+    ReadPattern sequential_read_pattern(unsigned sectors);
+
+    // Slots taken to read every track of a disk, side after side, as the pattern reads them
+    size_t read_slots(const SectorLayout & layout, const ReadPattern & pattern, unsigned sectors, unsigned tracks, unsigned heads);
+
+    // The order and the skews with the least rotational wait for the pattern, never worse than the default layout
+    SectorLayout optimize_layout(const ReadPattern & pattern, unsigned sectors, unsigned tracks, unsigned heads);
+
+}
@@ -0,0 +1,70 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2025 Mikhail Revzin <p3.141592653589793238462643@gmail.com>
+// Part of the dsk_tools project: https://github.com/Ptr314/dsk_tools
+// Description: Runtime CPU feature detection for vectorized kernels
+
+#include <atomic>
+
+#include "simd.h"
+
+#if defined(DSK_TOOLS_X86_SIMD) && defined(_MSC_VER)
+    #include <intrin.h>
+    #include <immintrin.h>
+#endif
+
+namespace dsk_tools {
+
+    static SimdLevel detect_cpu()
+    {
+#if defined(DSK_TOOLS_X86_SIMD) && defined(_MSC_VER)
+        int regs[4];
+        __cpuid(regs, 0);
+        const int max_leaf = regs[0];
+        __cpuid(regs, 1);
+        const bool sse2 = (regs[3] & (1 << 26)) != 0;
+        const bool osxsave = (regs[2] & (1 << 27)) != 0;
+        bool avx2 = false;
+        if (osxsave && max_leaf >= 7) {
+            // YMM state must be enabled by the OS
+            const bool ymm = (_xgetbv(0) & 0x6) == 0x6;
+            __cpuidex(regs, 7, 0);
+            avx2 = ymm && (regs[1] & (1 << 5)) != 0;
+        }
+        if (avx2) return SimdLevel::AVX2;
+        if (sse2) return SimdLevel::SSE2;
+        return SimdLevel::Scalar;
+#elif defined(DSK_TOOLS_X86_SIMD)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) return SimdLevel::AVX2;
+        if (__builtin_cpu_supports("sse2")) return SimdLevel::SSE2;
+        return SimdLevel::Scalar;
+#else
+        return SimdLevel::Scalar;
+#endif
+    }
+
+    static std::atomic<int> & level_limit()
+    {
+        static std::atomic<int> limit(static_cast<int>(SimdLevel::AVX2));
+        return limit;
+    }
+
+    SimdLevel simd_detect()
+    {
+        static const SimdLevel detected = detect_cpu();
+        return detected;
+    }
+
+    SimdLevel simd_level()
+    {
+        const int detected = static_cast<int>(simd_detect());
+        const int limit = level_limit().load(std::memory_order_relaxed);
+        return static_cast<SimdLevel>(limit < detected ? limit : detected);
+    }
+
+    void set_simd_level(SimdLevel level)
+    {
+        level_limit().store(static_cast<int>(level), std::memory_order_relaxed);
+    }
+
+}
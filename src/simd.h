@@ -0,0 +1,27 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2025 Mikhail Revzin <p3.141592653589793238462643@gmail.com>
+// Part of the dsk_tools project: https://github.com/Ptr314/dsk_tools
+// Description: Runtime CPU feature detection for vectorized kernels
+#pragma once
+
+// Kernels are compiled per function with target attributes, so the library itself
+// does not need any -m flags and still runs on CPUs without SSE2/AVX2
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    #define DSK_TOOLS_X86_SIMD  1
+    #define DSK_TARGET_SSE2     __attribute__((target("sse2")))
+    #define DSK_TARGET_AVX2     __attribute__((target("avx2")))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    #define DSK_TOOLS_X86_SIMD  1
+    #define DSK_TARGET_SSE2
+    #define DSK_TARGET_AVX2
+#endif
+
+namespace dsk_tools {
+
+    enum class SimdLevel {Scalar = 0, SSE2, AVX2};
+
+    SimdLevel simd_detect();                    // Best level supported by the CPU and OS
+    SimdLevel simd_level();                     // Level used by the kernels now
+    void set_simd_level(SimdLevel level);       // Limits the level, i.e. to compare kernels; clamped to simd_detect()
+
+}
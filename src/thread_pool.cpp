@@ -0,0 +1,201 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2025 Mikhail Revzin <p3.141592653589793238462643@gmail.com>
+// Part of the dsk_tools project: https://github.com/Ptr314/dsk_tools
+// Description: A small work-stealing thread pool for parallel track decoding
+
+#include <deque>
+
+#include "thread_pool.h"
+
+namespace dsk_tools {
+
+    struct ThreadPool::Job
+    {
+        struct Queue {
+            std::mutex mutex;
+            std::deque<int> items;
+        };
+
+        const ItemFunc * fn;
+        std::unique_ptr<Queue[]> queues;
+        int queues_count;
+        std::atomic<int> pending;
+        std::mutex error_mutex;
+        std::exception_ptr error;
+    };
+
+    ThreadPool::ThreadPool(int threads):
+          m_generation(0)
+        , m_busy(false)
+        , m_stop(false)
+    {
+        // The calling thread works too
+        for (int i = 1; i < threads; i++)
+            m_workers.emplace_back(&ThreadPool::worker, this, i);
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        for (auto & t : m_workers) t.join();
+    }
+
+    void ThreadPool::parallel_for(ThreadPool * pool, int count, const ItemFunc & fn)
+    {
+        if (pool) {
+            pool->parallel_for(count, fn);
+        } else {
+            for (int i = 0; i < count; i++) fn(i, 0);
+        }
+    }
+
+    void ThreadPool::parallel_for(int count, const ItemFunc & fn)
+    {
+        if (count <= 0) return;
+
+        std::shared_ptr<Job> job = std::make_shared<Job>();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            // Nested or concurrent calls run serially instead of waiting for the pool
+            if (m_busy || m_workers.empty()) job.reset();
+            else m_busy = true;
+        }
+        if (!job) {
+            for (int i = 0; i < count; i++) fn(i, 0);
+            return;
+        }
+
+        // Every slot starts with a contiguous range, idle slots steal from the others' tails
+        const int n = slots();
+        job->fn = &fn;
+        job->queues.reset(new Job::Queue[n]);
+        job->queues_count = n;
+        job->pending = count;
+        for (int s = 0; s < n; s++) {
+            const int from = static_cast<int>(static_cast<int64_t>(count) * s / n);
+            const int to = static_cast<int>(static_cast<int64_t>(count) * (s + 1) / n);
+            for (int i = from; i < to; i++) job->queues[s].items.push_back(i);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_job = job;
+            m_generation++;
+        }
+        m_wake.notify_all();
+
+        run(*job, 0);
+
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_done.wait(lock, [&job]{return job->pending.load() == 0;});
+            m_job.reset();
+            m_busy = false;
+        }
+
+        if (job->error) std::rethrow_exception(job->error);
+    }
+
+    void ThreadPool::run(Job & job, int slot)
+    {
+        for (;;) {
+            int item = -1;
+            {
+                Job::Queue & own = job.queues[slot];
+                std::lock_guard<std::mutex> lock(own.mutex);
+                if (!own.items.empty()) {
+                    item = own.items.front();
+                    own.items.pop_front();
+                }
+            }
+            for (int k = 1; item < 0 && k < job.queues_count; k++) {
+                Job::Queue & other = job.queues[(slot + k) % job.queues_count];
+                std::lock_guard<std::mutex> lock(other.mutex);
+                if (!other.items.empty()) {
+                    item = other.items.back();
+                    other.items.pop_back();
+                }
+            }
+            if (item < 0) return;
+
+            try {
+                (*job.fn)(item, slot);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(job.error_mutex);
+                if (!job.error) job.error = std::current_exception();
+            }
+
+            if (--job.pending == 0) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_done.notify_all();
+            }
+        }
+    }
+
+    void ThreadPool::worker(int slot)
+    {
+        uint64_t seen = 0;
+        for (;;) {
+            std::shared_ptr<Job> job;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_wake.wait(lock, [this, seen]{return m_stop || m_generation != seen;});
+                if (m_stop) return;
+                seen = m_generation;
+                job = m_job;
+            }
+            if (job) run(*job, slot);
+        }
+    }
+
+    static std::mutex & decode_pool_mutex()
+    {
+        static std::mutex m;
+        return m;
+    }
+
+    static int & decode_threads_value()
+    {
+        static int threads = 1;
+        return threads;
+    }
+
+    static std::shared_ptr<ThreadPool> & decode_pool_instance()
+    {
+        static std::shared_ptr<ThreadPool> pool;
+        return pool;
+    }
+
+    void set_decode_threads(int threads)
+    {
+        if (threads <= 0) {
+            threads = static_cast<int>(std::thread::hardware_concurrency());
+            if (threads <= 0) threads = 1;
+        }
+        std::lock_guard<std::mutex> lock(decode_pool_mutex());
+        if (threads == decode_threads_value()) return;
+        decode_threads_value() = threads;
+        // A running decode keeps its own reference to the old pool
+        decode_pool_instance().reset();
+    }
+
+    int decode_threads()
+    {
+        std::lock_guard<std::mutex> lock(decode_pool_mutex());
+        return decode_threads_value();
+    }
+
+    std::shared_ptr<ThreadPool> decode_pool()
+    {
+        std::lock_guard<std::mutex> lock(decode_pool_mutex());
+        if (decode_threads_value() <= 1) return nullptr;
+        if (!decode_pool_instance())
+            decode_pool_instance() = std::make_shared<ThreadPool>(decode_threads_value());
+        return decode_pool_instance();
+    }
+
+}
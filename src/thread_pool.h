@@ -0,0 +1,60 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2025 Mikhail Revzin <p3.141592653589793238462643@gmail.com>
+// Part of the dsk_tools project: https://github.com/Ptr314/dsk_tools
+// Description: A small work-stealing thread pool for parallel track decoding
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dsk_tools {
+
+    class ThreadPool
+    {
+    public:
+        // fn(item, slot): slot is in [0, slots()) and is never used by two threads at once,
+        // so callers can keep per-slot scratch buffers
+        using ItemFunc = std::function<void(int, int)>;
+
+        explicit ThreadPool(int threads);
+        ~ThreadPool();
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool & operator=(const ThreadPool &) = delete;
+
+        int slots() const {return static_cast<int>(m_workers.size()) + 1;};     // Workers + the calling thread
+        void parallel_for(int count, const ItemFunc & fn);                      // Blocks until all items are done
+
+        // Same as above, but serial in the calling thread when pool is nullptr
+        static int slots(const ThreadPool * pool) {return pool ? pool->slots() : 1;};
+        static void parallel_for(ThreadPool * pool, int count, const ItemFunc & fn);
+
+    private:
+        struct Job;
+
+        std::vector<std::thread> m_workers;
+        std::mutex m_mutex;
+        std::condition_variable m_wake;
+        std::condition_variable m_done;
+        std::shared_ptr<Job> m_job;
+        uint64_t m_generation;
+        bool m_busy;
+        bool m_stop;
+
+        void worker(int slot);
+        void run(Job & job, int slot);
+    };
+
+    // Parallel decoding is opt-in: 1 (default) decodes in the calling thread,
+    // 0 uses all hardware threads
+    void set_decode_threads(int threads);
+    int decode_threads();
+    std::shared_ptr<ThreadPool> decode_pool();          // nullptr when decoding is serial
+
+}
@@ -0,0 +1,164 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2025 Mikhail Revzin <p3.141592653589793238462643@gmail.com>
+// Part of the dsk_tools project: https://github.com/Ptr314/dsk_tools
+// Description: Sector fields found by a track decoding pass, and reports formatted from them
+
+#include "track_scan.h"
+#include "utils.h"
+
+namespace dsk_tools {
+
+    std::string agat_140_track_report(const TrackScan & scan, bool & errors)
+    {
+        std::string result;
+        for (const SectorScan & s : scan.sectors) {
+            result += "    $" + int_to_hex(static_cast<uint32_t>(s.index_pos)) + " {$INDEX_MARK} ($D5 $AA $96)\n";
+            result += "    $" + int_to_hex(static_cast<uint32_t>(s.index_pos + 3)) + " {$SECTOR_INDEX}:";
+            if (!s.index_complete) {
+                errors = true;
+                result += " {$SECTOR_ERROR}\n";
+                break;
+            }
+            result += " {$VOLUME_ID}=" + std::to_string(s.volume) + " ($" + int_to_hex(s.volume) + ")";
+            result += ", {$TRACK_SHORT}=" + std::to_string(s.track);
+            result += ", {$LOGICAL_SECTOR}=" + std::to_string(s.sector);
+            if (s.index_crc_ok()) {
+                result += ", {$INDEX_CRC_OK}";
+            } else {
+                errors = true;
+                result += " {$INDEX_CRC_ERROR} ({$CRC_EXPECTED}: $" + int_to_hex(s.index_crc_expected) + ", {$CRC_FOUND}: $" + int_to_hex(s.index_crc) + ")";
+            }
+            if (s.index_epilogue_ok) {
+                result += ", {$INDEX_EPILOGUE_OK}";
+            } else {
+                errors = true;
+                result += ", {$INDEX_EPILOGUE_ERROR}";
+            }
+            result += "\n";
+
+            if (s.data_pos < 0) continue;
+            result += "    $" + int_to_hex(static_cast<uint32_t>(s.data_pos)) + " {$DATA_MARK} ($D5 $AA $AD)\n";
+            result += "    $" + int_to_hex(static_cast<uint32_t>(s.data_pos + 3)) + " {$DATA_FIELD} (342+1)";
+            if (s.data_complete) {
+                if (s.data_crc_ok) {
+                    result += ", {$SECTOR_CRC_OK}";
+                } else {
+                    errors = true;
+                    result += ", {$SECTOR_CRC_ERROR}";
+                }
+                if (s.data_epilogue_ok) {
+                    result += ", {$DATA_EPILOGUE_OK}";
+                } else {
+                    errors = true;
+                    result += ", {$DATA_EPILOGUE_ERROR}";
+                }
+                result += "\n    " + toHexList(s.preview, s.preview_size) + " ...";
+            } else {
+                errors = true;
+            }
+            result += "\n\n";
+        }
+        return result;
+    }
+
+    std::string agat_840_track_report(const TrackScan & scan, bool & errors)
+    {
+        std::string result;
+        for (const SectorScan & s : scan.sectors) {
+            result += "    $" + int_to_hex(static_cast<uint16_t>(s.index_pos)) + " {$INDEX_MARK} ($95 $6A)\n";
+            result += "    $" + int_to_hex(static_cast<uint16_t>(s.index_pos + 2)) + " {$SECTOR_INDEX}:";
+            if (!s.index_complete) {
+                errors = true;
+                result += " {$SECTOR_ERROR}\n";
+                break;
+            }
+            result += " {$VOLUME_ID}=" + std::to_string(s.volume) + " ($" + int_to_hex(s.volume) + ")";
+            result += ", {$TRACK_SHORT}=" + std::to_string(s.track);
+            result += ", {$LOGICAL_SECTOR}=" + std::to_string(s.sector);
+            if (s.index_epilogue_ok) {
+                result += ", {$INDEX_EPILOGUE_OK}";
+            } else {
+                errors = true;
+                result += ", {$INDEX_EPILOGUE_ERROR}";
+            }
+            result += "\n";
+
+            if (s.data_pos < 0) continue;
+            result += "    $" + int_to_hex(static_cast<uint16_t>(s.data_pos)) + " {$DATA_MARK} ($6A $95)\n";
+            result += "    $" + int_to_hex(static_cast<uint16_t>(s.data_pos + 2)) + " {$DATA_FIELD} (256)\n";
+            result += "               " + toHexList(s.preview, s.preview_size) + " ...\n";
+            if (s.data_complete) {
+                result += "    $" + int_to_hex(static_cast<uint16_t>(s.data_pos + 2 + 256));
+                if (s.data_crc_ok) {
+                    result += " {$SECTOR_CRC_OK} ($" + int_to_hex(s.data_crc) + ")";
+                } else {
+                    errors = true;
+                    result += " {$SECTOR_CRC_ERROR} ({$CRC_EXPECTED}: $" + int_to_hex(s.data_crc_expected) + ", {$CRC_FOUND}: $" + int_to_hex(s.data_crc) + ")";
+                }
+                if (s.data_epilogue_ok) {
+                    result += ", {$DATA_EPILOGUE_OK}";
+                } else {
+                    errors = true;
+                    result += ", {$DATA_EPILOGUE_ERROR}";
+                }
+                result += "\n";
+            } else {
+                result += " {$SECTOR_ERROR}";
+                errors = true;
+            }
+            result += "\n";
+        }
+        return result;
+    }
+
+    void add_bad_sectors(BadSectorTable & table, const TrackScan & scan, unsigned head, unsigned track, int sectors, const int * translation)
+    {
+        // The last complete data field of a sector is the one left in the image
+        uint32_t good = 0;
+        for (const SectorScan & s : scan.sectors) {
+            if (!s.data_complete || s.sector >= sectors) continue;
+            const int n = (translation != nullptr) ? translation[s.sector] : s.sector;
+            if (s.data_crc_ok)
+                good |= 1u << n;
+            else
+                good &= ~(1u << n);
+        }
+        for (int n = 0; n < sectors; n++)
+            if ((good & (1u << n)) == 0)
+                table.insert(bad_sector_key(head, track, n));
+    }
+
+    void VerifyReport::reset(int heads, int tracks, int sectors)
+    {
+        this->heads = heads;
+        this->tracks = tracks;
+        this->sectors = sectors;
+        status.assign(heads * tracks * sectors, SectorStatus::Missing);
+    }
+
+    int VerifyReport::count(SectorStatus value) const
+    {
+        int n = 0;
+        for (SectorStatus s : status)
+            if (s == value) n++;
+        return n;
+    }
+
+    void verify_sectors(VerifyReport & report, const TrackScan & scan, int head, int track, const int * translation)
+    {
+        for (const SectorScan & s : scan.sectors) {
+            if (!s.index_complete || s.sector >= report.sectors) continue;
+            SectorStatus & status = report.at(head, track, (translation != nullptr) ? translation[s.sector] : s.sector);
+            if (s.data_complete) {
+                // The last complete data field is the one that counts, as for loading
+                if (!s.index_crc_ok())
+                    status = SectorStatus::AddressError;
+                else
+                    status = s.data_crc_ok ? SectorStatus::Ok : SectorStatus::DataError;
+            } else
+            if (!s.index_crc_ok() && status == SectorStatus::Missing)
+                status = SectorStatus::AddressError;
+        }
+    }
+
+}
@@ -0,0 +1,81 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2025 Mikhail Revzin <p3.141592653589793238462643@gmail.com>
+// Part of the dsk_tools project: https://github.com/Ptr314/dsk_tools
+// Description: Sector fields found by a track decoding pass, and reports formatted from them
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "definitions.h"
+
+namespace dsk_tools {
+
+    // An address field and the data field after it; positions are in track bytes
+    struct SectorScan {
+        int     index_pos;                  // The address mark
+        int     data_pos;                   // The data mark, -1 if there is none
+        int     gap_before;                 // From the end of the previous field or the track start to the address mark
+        int     gap_index_data;             // From the end of the address field to the data mark
+        uint8_t volume;
+        uint8_t track;
+        uint8_t sector;                     // As recorded, not translated
+        uint8_t index_crc;                  // Agat 140 only
+        uint8_t index_crc_expected;
+        uint8_t data_crc;                   // Agat 840 only
+        uint8_t data_crc_expected;
+        bool    index_complete;             // false: the track ends inside the field, nothing else is set
+        bool    index_epilogue_ok;
+        bool    data_complete;              // The same for the data field
+        bool    data_crc_ok;
+        bool    data_epilogue_ok;
+        uint8_t preview_size;
+        uint8_t preview[16];                // The first decoded bytes, for reports
+
+        bool index_crc_ok() const {return index_crc == index_crc_expected;};
+    };
+
+    struct TrackScan {
+        std::vector<SectorScan> sectors;
+        bool scanned;                       // false if the track could not be read
+        bool errors;                        // As the decoder sees them
+
+        TrackScan(): scanned(false), errors(false) {};
+        void reset() {sectors.clear(); scanned = false; errors = false;};
+    };
+
+    enum class SectorStatus : uint8_t {
+        Ok = 0,
+        Missing,                            // No complete data field
+        AddressError,                       // The address field checksum is wrong
+        DataError                           // The data field checksum is wrong
+    };
+
+    // Checksums of every sector of an image, found by Loader::verify()
+    struct VerifyReport {
+        int heads;
+        int tracks;
+        int sectors;
+        std::vector<SectorStatus> status;   // In the image order: track, head, sector
+
+        VerifyReport(): heads(0), tracks(0), sectors(0) {};
+        void reset(int heads, int tracks, int sectors);
+        SectorStatus & at(int head, int track, int sector) {return status[(track * heads + head) * sectors + sector];};
+        SectorStatus at(int head, int track, int sector) const {return status[(track * heads + head) * sectors + sector];};
+        int count(SectorStatus value) const;
+        bool ok() const {return count(SectorStatus::Ok) == static_cast<int>(status.size());};
+    };
+
+    // Sector by sector descriptions for file_info(); errors is set if anything is wrong
+    std::string agat_140_track_report(const TrackScan & scan, bool & errors);
+    std::string agat_840_track_report(const TrackScan & scan, bool & errors);
+
+    // Adds the sectors which are missing or whose data, as it was put into the image, has a bad checksum.
+    // translation: recorded sector numbers to positions in the track, nullptr if they are the same
+    void add_bad_sectors(BadSectorTable & table, const TrackScan & scan, unsigned head, unsigned track, int sectors, const int * translation = nullptr);
+
+    // Sets the status of every sector of the track, as add_bad_sectors() sees them; a wrong address checksum is an error too
+    void verify_sectors(VerifyReport & report, const TrackScan & scan, int head, int track, const int * translation = nullptr);
+
+}
@@ -221,16 +221,6 @@ namespace dsk_tools
         return out;
     }
 
-    bool iterate_until(const std::vector<uint8_t> & in, int & p, const uint8_t v)
-    {
-        uint8_t d;
-        do {
-            if (p >= in.size()) return false;
-            d = in.at(p++);
-        } while (d != v);
-        return true;
-    }
-
     int agat_attr_to_type(uint8_t a)
     {
         uint8_t v = a & 0x7F;
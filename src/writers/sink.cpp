@@ -0,0 +1,227 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2025 Mikhail Revzin <p3.141592653589793238462643@gmail.com>
+// Part of the dsk_tools project: https://github.com/Ptr314/dsk_tools
+// Description: Destinations for writers' output, filled part by part as the image is encoded
+
+#include <cerrno>
+#include <cstring>
+
+#include "sink.h"
+#include "mapped_file.h"
+
+#ifdef _WIN32
+    #include <fcntl.h>
+    #include <io.h>
+    #include <sys/stat.h>
+    #include "utils.h"
+#else
+    #include <fcntl.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+namespace dsk_tools {
+
+    BufferSink::BufferSink(BYTES & buffer):
+        m_buffer(buffer)
+    {}
+
+    Result BufferSink::write(const uint8_t * data, size_t size)
+    {
+        m_buffer.insert(m_buffer.end(), data, data + size);
+        return Result::ok();
+    }
+
+    StreamSink::StreamSink(std::ostream & stream):
+        m_stream(stream)
+    {}
+
+    Result StreamSink::write(const uint8_t * data, size_t size)
+    {
+        m_stream.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(size));
+        if (!m_stream.good())
+            return Result::error(ErrorCode::WriteError, "Error writing to stream");
+        return Result::ok();
+    }
+
+    FdSink::FdSink(int fd):
+        m_fd(fd)
+    {}
+
+    Result FdSink::write(const uint8_t * data, size_t size)
+    {
+        size_t done = 0;
+        while (done < size) {
+#ifdef _WIN32
+            const int n = ::_write(m_fd, data + done, static_cast<unsigned>(size - done));
+#else
+            const ssize_t n = ::write(m_fd, data + done, size - done);
+#endif
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0)
+                return Result::error(ErrorCode::WriteError, "Error writing to file");
+            done += static_cast<size_t>(n);
+        }
+        return Result::ok();
+    }
+
+    FileSink::FileSink(const std::string & file_name):
+        m_file(new UTF8_ofstream(file_name, std::ios::binary))
+    {}
+
+    bool FileSink::is_open() const
+    {
+        return m_file->good();
+    }
+
+    Result FileSink::write(const uint8_t * data, size_t size)
+    {
+        m_file->write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(size));
+        if (!m_file->good())
+            return Result::error(ErrorCode::WriteError, "Error writing to file");
+        return Result::ok();
+    }
+
+    ReplaceFileSink::ReplaceFileSink(const std::string & file_name):
+          m_file_name(file_name)
+        , m_temp_name(file_name + ".tmp")
+        , m_file(new UTF8_ofstream(m_temp_name, std::ios::binary))
+    {}
+
+    ReplaceFileSink::~ReplaceFileSink()
+    {
+        if (!m_file) return;
+        m_file->close();
+        utf8_remove(m_temp_name);
+    }
+
+    bool ReplaceFileSink::is_open() const
+    {
+        return m_file && m_file->good();
+    }
+
+    Result ReplaceFileSink::write(const uint8_t * data, size_t size)
+    {
+        if (!m_file) return Result::error(ErrorCode::WriteError, "File is already closed");
+        m_file->write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(size));
+        if (!m_file->good())
+            return Result::error(ErrorCode::WriteError, "Error writing to file");
+        return Result::ok();
+    }
+
+    Result ReplaceFileSink::commit()
+    {
+        if (!m_file) return Result::error(ErrorCode::WriteError, "File is already closed");
+#if !defined(_WIN32) || defined(_MSC_VER)
+        m_file->flush();                                    // The MinGW stream writes through, it has no buffer
+#endif
+        const bool written = m_file->good();
+        m_file->close();
+        m_file.reset();
+        if (!written || utf8_rename(m_temp_name, m_file_name) != 0) {
+            utf8_remove(m_temp_name);
+            return Result::error(ErrorCode::WriteError, "Error writing to file");
+        }
+        return Result::ok();
+    }
+
+    MemorySink::MemorySink(uint8_t * dest, size_t capacity):
+          m_dest(dest)
+        , m_capacity(capacity)
+        , m_written(0)
+    {}
+
+    Result MemorySink::write(const uint8_t * data, size_t size)
+    {
+        if (size > m_capacity - m_written)
+            return Result::error(ErrorCode::WriteError, "Output is larger than the destination");
+        std::memcpy(m_dest + m_written, data, size);
+        m_written += size;
+        return Result::ok();
+    }
+
+    CallbackSink::CallbackSink(Callback callback):
+        m_callback(std::move(callback))
+    {}
+
+    Result CallbackSink::write(const uint8_t * data, size_t size)
+    {
+        return m_callback(data, size);
+    }
+
+    FilePatcher::FilePatcher():
+          m_fd(-1)
+        , m_size(0)
+    {}
+
+    FilePatcher::~FilePatcher()
+    {
+        close();
+    }
+
+    Result FilePatcher::open(const std::string & file_name)
+    {
+        close();
+#ifdef DSK_TOOLS_HAS_MMAP
+        m_fd = ::open(file_name.c_str(), O_RDWR);
+        if (m_fd < 0)
+            return Result::error(ErrorCode::WriteError, "Cannot open file");
+        struct stat st;
+        if (fstat(m_fd, &st) != 0) {
+            close();
+            return Result::error(ErrorCode::WriteError, "Cannot read file");
+        }
+        m_size = static_cast<uint64_t>(st.st_size);
+#else
+        m_fd = ::_wopen(utf8_to_wide(file_name).c_str(), _O_RDWR | _O_BINARY);
+        if (m_fd < 0)
+            return Result::error(ErrorCode::WriteError, "Cannot open file");
+        const long long fsize = ::_lseeki64(m_fd, 0, SEEK_END);
+        if (fsize < 0) {
+            close();
+            return Result::error(ErrorCode::WriteError, "Cannot read file");
+        }
+        m_size = static_cast<uint64_t>(fsize);
+#endif
+        return Result::ok();
+    }
+
+    Result FilePatcher::write_at(uint64_t offset, const uint8_t * data, size_t size)
+    {
+        if (m_fd < 0)
+            return Result::error(ErrorCode::WriteError, "File is not open");
+        if (offset > m_size || size > m_size - offset)
+            return Result::error(ErrorCode::WriteError, "Write beyond the end of file");
+#ifdef DSK_TOOLS_HAS_MMAP
+        size_t done = 0;
+        while (done < size) {
+            const ssize_t n = pwrite(m_fd, data + done, size - done, static_cast<off_t>(offset + done));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0)
+                return Result::error(ErrorCode::WriteError, "Error writing to file");
+            done += static_cast<size_t>(n);
+        }
+#else
+        if (::_lseeki64(m_fd, static_cast<long long>(offset), SEEK_SET) < 0)
+            return Result::error(ErrorCode::WriteError, "Error writing to file");
+        FdSink sink(m_fd);
+        Result result = sink.write(data, size);
+        if (!result) return result;
+#endif
+        return Result::ok();
+    }
+
+    void FilePatcher::close()
+    {
+        if (m_fd >= 0) {
+#ifdef DSK_TOOLS_HAS_MMAP
+            ::close(m_fd);
+#else
+            ::_close(m_fd);
+#endif
+        }
+        m_fd = -1;
+        m_size = 0;
+    }
+
+}
@@ -0,0 +1,136 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2025 Mikhail Revzin <p3.141592653589793238462643@gmail.com>
+// Part of the dsk_tools project: https://github.com/Ptr314/dsk_tools
+// Description: Destinations for writers' output, filled part by part as the image is encoded
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <string>
+
+#include "definitions.h"
+#include "host_helpers.h"
+
+namespace dsk_tools {
+
+    class Sink
+    {
+    public:
+        virtual ~Sink() = default;
+        virtual Result write(const uint8_t * data, size_t size) = 0;
+        Result write(const BYTES & data) {return write(data.data(), data.size());};
+    };
+
+    // Appends to a buffer in memory
+    class BufferSink: public Sink
+    {
+    public:
+        explicit BufferSink(BYTES & buffer);
+        Result write(const uint8_t * data, size_t size) override;
+        using Sink::write;
+    private:
+        BYTES & m_buffer;
+    };
+
+    class StreamSink: public Sink
+    {
+    public:
+        explicit StreamSink(std::ostream & stream);
+        Result write(const uint8_t * data, size_t size) override;
+        using Sink::write;
+    private:
+        std::ostream & m_stream;
+    };
+
+    // A file, a pipe or stdout; the descriptor is not closed
+    class FdSink: public Sink
+    {
+    public:
+        explicit FdSink(int fd);
+        Result write(const uint8_t * data, size_t size) override;
+        using Sink::write;
+    private:
+        int m_fd;
+    };
+
+    // Creates the file, UTF-8 names are supported everywhere
+    class FileSink: public Sink
+    {
+    public:
+        explicit FileSink(const std::string & file_name);
+        bool is_open() const;
+        Result write(const uint8_t * data, size_t size) override;
+        using Sink::write;
+    private:
+        std::unique_ptr<UTF8_ofstream> m_file;
+    };
+
+    // Writes a temporary file next to the target, commit() renames it over the target. The target may be
+    // the image being read, mapped or loaded on demand: it stays as it is until then, and if commit() is
+    // never called the temporary file is removed instead
+    class ReplaceFileSink: public Sink
+    {
+    public:
+        explicit ReplaceFileSink(const std::string & file_name);
+        ~ReplaceFileSink();
+        bool is_open() const;
+        Result write(const uint8_t * data, size_t size) override;
+        using Sink::write;
+        Result commit();
+    private:
+        std::string m_file_name;
+        std::string m_temp_name;
+        std::unique_ptr<UTF8_ofstream> m_file;
+    };
+
+    // A preallocated area, i.e. a mapped file; writing past its end is an error
+    class MemorySink: public Sink
+    {
+    public:
+        MemorySink(uint8_t * dest, size_t capacity);
+        Result write(const uint8_t * data, size_t size) override;
+        using Sink::write;
+        size_t written() const {return m_written;};
+    private:
+        uint8_t * m_dest;
+        size_t m_capacity;
+        size_t m_written;
+    };
+
+    class CallbackSink: public Sink
+    {
+    public:
+        using Callback = std::function<Result(const uint8_t * data, size_t size)>;
+        explicit CallbackSink(Callback callback);
+        Result write(const uint8_t * data, size_t size) override;
+        using Sink::write;
+    private:
+        Callback m_callback;
+    };
+
+    // Overwrites parts of an existing file in place, the rest of it is left as is
+    class FilePatcher
+    {
+    public:
+        FilePatcher();
+        ~FilePatcher();
+        FilePatcher(const FilePatcher &) = delete;
+        FilePatcher & operator=(const FilePatcher &) = delete;
+
+        Result open(const std::string & file_name);
+        void close();
+        bool is_open() const {return m_fd >= 0;};
+        uint64_t size() const {return m_size;};
+
+        // Can't extend the file; a short write is an error
+        Result write_at(uint64_t offset, const uint8_t * data, size_t size);
+
+    private:
+        int m_fd;
+        uint64_t m_size;
+    };
+
+}
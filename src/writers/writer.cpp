@@ -3,8 +3,6 @@
 // Part of the dsk_tools project: https://github.com/Ptr314/dsk_tools
 // Description: A top level abstract class for different writers
 
-#include <fstream>
-
 #include "writer.h"
 
 namespace dsk_tools {
@@ -12,6 +10,8 @@ namespace dsk_tools {
     Writer::Writer(const std::string & format_id, diskImage * image_to_save):
           format_id(format_id)
         , image(image_to_save)
+        , m_copy_tracks(false)
+        , m_tracks_copied(0)
     {}
 
     Writer::~Writer()
@@ -19,25 +19,99 @@ namespace dsk_tools {
 
     Result Writer::write(const std::string & file_name)
     {
-        std::ofstream file(file_name, std::ios::binary);
+        // The file may be the one the image is read from, see ReplaceFileSink
+        ReplaceFileSink file(file_name);
 
-        if (!file.good()) {
+        if (!file.is_open()) {
             return Result::error(ErrorCode::WriteError, "Cannot create output file");
         }
 
-        BYTES buffer;
-
-        Result res = write(buffer);
+        Result res = write(file);
         if (!res) return res;
+        return file.commit();
+    }
 
-        file.write(reinterpret_cast<char*>(buffer.data()), buffer.size());
+    Result Writer::write(BYTES & buffer)
+    {
+        buffer.clear();
+        buffer.reserve(output_size());
+        BufferSink sink(buffer);
+        return write(sink);
+    }
 
-        if (!file.good()) {
-            return Result::error(ErrorCode::WriteError, "Error writing to file");
-        }
+    Result Writer::write(uint8_t * dest, size_t capacity)
+    {
+        MemorySink sink(dest, capacity);
+        return write(sink);
+    }
 
+    Result Writer::set_layout(const SectorLayout & layout)
+    {
+        if (!layout.is_valid(image->get_sectors()))
+            return Result::error(ErrorCode::IncorrectRequest, "Sector order doesn't match the disk geometry");
+        m_layout = layout;
         return Result::ok();
+    }
+
+    Result Writer::substitute_tracks(const std::string & file_name, const BYTES & tmplt, const int numtracks)
+    {
+        return Result::error(ErrorCode::WriteUnsupported, "Track substitution not supported for this format");
+    }
+
+    Result Writer::encode_track(unsigned track, BYTES & out, uint64_t & offset)
+    {
+        return Result::error(ErrorCode::WriteUnsupported, "Tracks can't be written separately in this format");
+    }
+
+    Result Writer::encode_side(unsigned head, unsigned track, BYTES & out)
+    {
+        return Result::error(ErrorCode::WriteUnsupported, "No encoded tracks in this format");
+    }
 
+    bool Writer::track_changed(unsigned track)
+    {
+        for (unsigned head = 0; head < image->get_heads(); head++)
+            if (image->is_track_dirty(head, track)) return true;
+        return false;
+    }
+
+    Result Writer::update(const std::string & file_name)
+    {
+        // The changed tracks were decoded to be changed
+        Result res = image->lazy_result();
+        if (!res) return res;
+
+        const size_t size = output_size();
+        FilePatcher file;
+        bool in_place = size > 0 && file.open(file_name) && file.size() == size;
+
+        // Changed tracks are encoded from the sectors, nothing is copied from the file being overwritten
+        const bool copy_tracks = m_copy_tracks;
+        m_copy_tracks = false;
+        m_tracks_copied = 0;
+
+        BYTES out;
+        for (unsigned track = 0; in_place && track < image->get_tracks(); track++) {
+            if (!track_changed(track)) continue;
+            out.clear();
+            uint64_t offset = 0;
+            res = encode_track(track, out, offset);
+            // Known before anything is written, the format doesn't support it at all
+            if (res.code == ErrorCode::WriteUnsupported) in_place = false;
+            if (!res) break;
+            res = file.write_at(offset, out.data(), out.size());
+            if (!res) break;
+        }
+        file.close();
+
+        if (!in_place) {
+            // The file may be the one the image is read from: all of it is read into memory before truncating
+            image->get_buffer();
+            res = write(file_name);
+        }
+        m_copy_tracks = copy_tracks;
+        if (res) image->clear_dirty();
+        return res;
     }
 
 }
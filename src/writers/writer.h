@@ -8,6 +8,8 @@
 #include <string>
 
 #include "disk_image.h"
+#include "sector_layout.h"
+#include "sink.h"
 
 namespace dsk_tools {
 
@@ -16,15 +18,49 @@ namespace dsk_tools {
     protected:
         std::string     format_id;
         diskImage     * image;
+        bool            m_copy_tracks;
+        int             m_tracks_copied;
+        SectorLayout    m_layout;
 
     public:
         Writer(const std::string & format_id, diskImage *image_to_save);
         virtual ~Writer();
 
         virtual Result write(const std::string & file_name);
-        virtual Result write(BYTES & buffer) = 0;
+        virtual Result write(BYTES & buffer);                           // Allocated once, see output_size()
+        Result write(uint8_t * dest, size_t capacity);                  // I.e. a mapped file of output_size() bytes
+        // The header first, then every track as soon as it is encoded
+        virtual Result write(Sink & sink) = 0;
         virtual std::string get_default_ext() = 0;
+        // Size of the whole output, from the geometry only; 0 if the image can't be written in this format,
+        // or the size depends on the data
+        virtual size_t output_size() = 0;
         virtual Result substitute_tracks(BYTES & buffer, BYTES & tmplt, const int numtracks) = 0;
+        // The same for an output file written before; only the substituted bytes are written there
+        virtual Result substitute_tracks(const std::string & file_name, const BYTES & tmplt, const int numtracks);
+
+        // Where both containers allow it, tracks are copied from the source file as they are encoded there,
+        // without decoding. Tracks changed after loading are encoded from the sectors
+        void set_copy_tracks(bool copy) {m_copy_tracks = copy;};
+        int tracks_copied() const {return m_tracks_copied;};   // By the last write(), one per side of a track
+
+        // Order of sectors on the encoded tracks, see optimize_layout(). Formats without sector order ignore it,
+        // a non-default layout makes the tracks encoded rather than copied
+        Result set_layout(const SectorLayout & layout);
+        const SectorLayout & get_layout() const {return m_layout;};
+
+        // Saves an edited image over the file it was loaded from, or last updated: only the tracks changed since then
+        // are encoded and written in place. Anything else in the file, i.e. another size, gets a full write()
+        Result update(const std::string & file_name);
+
+        // One side of a track as the head sees it in this format: GCR nibbles for 140K, MFM cells for 840K.
+        // Copied or encoded as write() does it; see simulate_reads()
+        virtual Result encode_side(unsigned head, unsigned track, BYTES & out);
+
+    protected:
+        // One track of the output exactly as write() lays it out, and where it goes in the file
+        virtual Result encode_track(unsigned track, BYTES & out, uint64_t & offset);
+        virtual bool track_changed(unsigned track);
     };
 
 }
@@ -66,39 +66,101 @@ WriterHxCHFE::WriterHxCHFE(const std::string & format_id, diskImage * image_to_s
         out.insert(out.end(), HFE_BLOCK_SIZE - sizeof(track) * image->get_tracks(), 0xFF);
     }
 
-    Result WriterHxCHFE::write(BYTES &buffer)
+    // The header block, the track list block, then both sides of every track
+    size_t WriterHxCHFE::output_size()
+    {
+        if (image->get_type_id() != "TYPE_AGAT_840") return 0;
+        return 2 * HFE_BLOCK_SIZE + static_cast<size_t>(image->get_tracks()) * HFE_TRACK_LEN;
+    }
+
+    Result WriterHxCHFE::write(Sink & sink)
     {
         std::string type_id = image->get_type_id();
         if (type_id != "TYPE_AGAT_840") return Result::error(ErrorCode::WriteUnsupported, "Format not supported for HFE format");
 
-        buffer.clear();
-        buffer.reserve(buffer.size() + 512);
+        // Copied tracks don't need the sectors, the ones encoded after all are decoded on demand
+        Result res = Result::ok();
+        if (!m_copy_tracks) {
+            res = image->materialize_all();
+            if (!res) return res;
+        }
+        m_tracks_copied = 0;
+
+        BYTES header;
+        header.reserve(2 * HFE_BLOCK_SIZE);
+
+        write_hxc_hfe_header(header);
+        write_hxc_hfe_tracks_lut(header);
 
-        write_hxc_hfe_header(buffer);
-        write_hxc_hfe_tracks_lut(buffer);
+        res = sink.write(header);
+        if (!res) return res;
 
-        std::vector<BYTES> track_buffer(image->get_heads());
+        // Only one track, both sides of it, is kept in memory
+        BYTES mixed;
+        mixed.reserve(HFE_TRACK_LEN);
 
+        Progress * progress = image->get_progress();
+        progress_start(progress, ProgressStage::Write, image->get_tracks());
         for (uint8_t track = 0; track < image->get_tracks(); track++)
         {
-            for (uint8_t head = 0; head < image->get_heads(); head++)
-            {
-                track_buffer[head].clear();
-                write_agat840_track(track_buffer[head], head, track);
-            }
-            int blocks = 13056*2 / HFE_BLOCK_SIZE; // TODO: calculate
-            for (int block=0; block < blocks; block++)
+            if (is_cancelled(progress)) return Result::error(ErrorCode::Cancelled, "Writing cancelled");
+            mixed.clear();
+            uint64_t offset;
+            res = encode_track(track, mixed, offset);
+            if (!res) return res;
+            res = sink.write(mixed);
+            if (!res) return res;
+            progress_step(progress);
+        }
+        // Tracks not copied were decoded on demand, as load() would do it
+        return image->lazy_result();
+    }
+
+    // Both sides, their blocks interleaved
+    Result WriterHxCHFE::encode_track(unsigned track, BYTES & out, uint64_t & offset)
+    {
+        if (image->get_type_id() != "TYPE_AGAT_840") return Result::error(ErrorCode::WriteUnsupported, "Format not supported for HFE format");
+        offset = 2 * HFE_BLOCK_SIZE + static_cast<uint64_t>(track) * HFE_TRACK_LEN;
+
+        m_sides.resize(image->get_heads());
+        for (uint8_t head = 0; head < image->get_heads(); head++)
+        {
+            m_sides[head].clear();
+            const Result res = encode_side(head, track, m_sides[head]);
+            if (!res) return res;
+        }
+        int blocks = 13056*2 / HFE_BLOCK_SIZE; // TODO: calculate
+        for (int block=0; block < blocks; block++)
+        {
+            for (uint8_t head=0; head < 2; head ++)
             {
-                for (uint8_t head=0; head < 2; head ++)
-                {
-                    uint8_t * ptr = track_buffer[head].data() + block*256;
-                    buffer.insert(buffer.end(), ptr, ptr+256);
-                }
+                uint8_t * ptr = m_sides[head].data() + block*256;
+                out.insert(out.end(), ptr, ptr+256);
             }
         }
         return Result::ok();
     }
 
+    Result WriterHxCHFE::encode_side(unsigned head, unsigned track, BYTES & out)
+    {
+        if (image->get_type_id() != "TYPE_AGAT_840") return Result::error(ErrorCode::WriteUnsupported, "Format not supported for HFE format");
+        if (head >= image->get_heads() || track >= image->get_tracks()) return Result::error(ErrorCode::IncorrectRequest, "No such track");
+
+        if (copy_agat840_track(out, head, track))
+            m_tracks_copied++;
+        else
+            write_agat840_track(out, head, track);
+        return Result::ok();
+    }
+
+    bool WriterHxCHFE::track_changed(unsigned track)
+    {
+        // The sides are read as sequential tracks, see write_agat840_track()
+        for (unsigned head = 0; head < image->get_heads(); head++)
+            if (image->is_track_dirty(0, track * 2 + head)) return true;
+        return false;
+    }
+
     Result WriterHxCHFE::substitute_tracks(BYTES & buffer, BYTES & tmplt, const int numtracks)
     {
         return Result::error(ErrorCode::WriteUnsupported, "Track substitution not supported for HFE format");
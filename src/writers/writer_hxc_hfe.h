@@ -16,13 +16,21 @@ namespace dsk_tools {
     {
 
     protected:
+        std::vector<BYTES> m_sides;                             // Both sides of the track being encoded
+
         void write_hxc_hfe_header(BYTES & out);
         void write_hxc_hfe_tracks_lut(BYTES & out);
+        Result encode_track(unsigned track, BYTES & out, uint64_t & offset) override;
+        bool track_changed(unsigned track) override;
     public:
         WriterHxCHFE(const std::string & format_id, diskImage *image_to_save, const uint8_t volume_id);
         std::string get_default_ext() override;
-        Result write(BYTES & buffer) override;
+        Result write(Sink & sink) override;
+        using Writer::write;
+        size_t output_size() override;
+        Result encode_side(unsigned head, unsigned track, BYTES & out) override;
         Result substitute_tracks(BYTES & buffer, BYTES & tmplt, const int numtracks) override;
+        using Writer::substitute_tracks;
     };
 
 }
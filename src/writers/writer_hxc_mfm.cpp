@@ -44,72 +44,122 @@ namespace dsk_tools {
         out.insert(out.end(), ptr, ptr + sizeof(header));
     }
 
-    Result WriterHxCMFM::write(BYTES &buffer)
+    // Bytes per track in the output, 0 if the image can't be written in this format
+    size_t WriterHxCMFM::track_size()
     {
-        buffer.clear();
+        if (image->get_type_id() != "TYPE_AGAT_140") return 0;
 
-        int track_size;
+        if (format_id == "FILE_HXC_MFM") return 6400;
+        if (format_id == "FILE_MFM_NIB") return 6656;
+        if (format_id == "FILE_MFM_NIC") return AGAT_140_SECTORS * 512;
+        return 0;
+    }
 
-        std::string type_id = image->get_type_id();
+    size_t WriterHxCMFM::header_size()
+    {
+        return (format_id == "FILE_HXC_MFM") ? 0x800 : 0;
+    }
 
-        if (format_id == "FILE_HXC_MFM") {
-            if (type_id == "TYPE_AGAT_140") {
-                track_size = 6400;
-            } else
+    size_t WriterHxCMFM::output_size()
+    {
+        const size_t size = track_size();
+        if (size == 0) return 0;
+        return header_size() + image->get_tracks() * size;
+    }
+
+    Result WriterHxCMFM::encode_track(unsigned track, BYTES & out, uint64_t & offset)
+    {
+        const size_t size = track_size();
+        if (size == 0) return Result::error(ErrorCode::WriteUnsupported, "Format not supported for this disk type");
+        offset = header_size() + track * size;
+        return encode_side(0, track, out);
+    }
+
+    Result WriterHxCMFM::encode_side(unsigned head, unsigned track, BYTES & out)
+    {
+        const size_t size = track_size();
+        if (size == 0) return Result::error(ErrorCode::WriteUnsupported, "Format not supported for this disk type");
+        if (head != 0 || track >= image->get_tracks()) return Result::error(ErrorCode::IncorrectRequest, "No such track");
+
+        if (format_id == "FILE_MFM_NIC") {
+            if (copy_gcr62_track(out, track, 0))
+                m_tracks_copied++;
+            else
+                write_gcr62_nic_track(out, track);
+        } else {
+            if (copy_gcr62_track(out, track, size))
+                m_tracks_copied++;
+            else
+                write_gcr62_track(out, track, size);
+        }
+        return Result::ok();
+    }
+
+    Result WriterHxCMFM::write(Sink & sink)
+    {
+        if (track_size() == 0) {
+            if (format_id == "FILE_HXC_MFM")
                 return Result::error(ErrorCode::WriteUnsupported, "MFM format not supported for this disk type");
+            if (format_id == "FILE_MFM_NIB")
+                return Result::error(ErrorCode::WriteUnsupported, "NIB format not supported for this disk type");
+            if (format_id == "FILE_MFM_NIC")
+                return Result::error(ErrorCode::WriteUnsupported, "NIC format not supported for this disk type");
+            return Result::error(ErrorCode::WriteUnsupported, "Unknown MFM writer format");
+        }
 
-            buffer.reserve(buffer.size() + sizeof(HXC_MFM_HEADER));
+        // Copied tracks don't need the sectors, the ones encoded after all are decoded on demand
+        Result res = Result::ok();
+        if (!m_copy_tracks) {
+            res = image->materialize_all();
+            if (!res) return res;
+        }
+        m_tracks_copied = 0;
 
-            write_hxc_mfm_header(buffer);
+        if (format_id == "FILE_HXC_MFM") {
+            BYTES header;
+            header.reserve(0x800);
+
+            write_hxc_mfm_header(header);
 
             HXC_MFM_TRACK_INFO  hxc_mfm_track_info;
 
             int track_offset_mult = (image->get_heads()==2)?2:1;
 
-
-            buffer.reserve(0x800);
-
             for (uint8_t track = 0; track < image->get_tracks(); track++){
                 for (uint8_t head = 0; head < image->get_heads(); head++){
                     hxc_mfm_track_info.track_number = track;
                     hxc_mfm_track_info.side_number = head;
-                    hxc_mfm_track_info.mfmtracksize = track_size;
-                    hxc_mfm_track_info.mfmtrackoffset = 0x800 + (track*track_offset_mult + head)*track_size;
+                    hxc_mfm_track_info.mfmtracksize = track_size();
+                    hxc_mfm_track_info.mfmtrackoffset = 0x800 + (track*track_offset_mult + head)*track_size();
                     uint8_t * ptr = reinterpret_cast<uint8_t*>(&hxc_mfm_track_info);
-                    buffer.insert(buffer.end(), ptr, ptr+sizeof(HXC_MFM_TRACK_INFO));
+                    header.insert(header.end(), ptr, ptr+sizeof(HXC_MFM_TRACK_INFO));
                 }
             }
 
-            buffer.insert(buffer.end(), 0x800 - sizeof(HXC_MFM_HEADER) - sizeof(HXC_MFM_TRACK_INFO)*image->get_tracks()*image->get_heads(), 0x00);
-
-            buffer.reserve(0x800 + image->get_tracks() * track_size);
-
-            for (uint8_t track = 0; track < image->get_tracks(); track++){
-                write_gcr62_track(buffer, track, track_size);
-            }
-        } else
-        if (format_id == "FILE_MFM_NIB") {
-            if (type_id == "TYPE_AGAT_140") {
-                track_size = 6656;
-            } else
-                return Result::error(ErrorCode::WriteUnsupported, "NIB format not supported for this disk type");
-
-            for (uint8_t track = 0; track < image->get_tracks(); track++){
-                write_gcr62_track(buffer, track, track_size);
-            }
-        } else
-        if (format_id == "FILE_MFM_NIC") {
-            if (type_id != "TYPE_AGAT_140")
-                return Result::error(ErrorCode::WriteUnsupported, "NIC format not supported for this disk type");
-
-            for (uint8_t track = 0; track < image->get_tracks(); track++){
-                write_gcr62_nic_track(buffer, track);
-            }
-
-        } else
-            return Result::error(ErrorCode::WriteUnsupported, "Unknown MFM writer format");
-
-        return Result::ok();
+            header.insert(header.end(), 0x800 - sizeof(HXC_MFM_HEADER) - sizeof(HXC_MFM_TRACK_INFO)*image->get_tracks()*image->get_heads(), 0x00);
+
+            res = sink.write(header);
+            if (!res) return res;
+        }
+
+        // Only one track is kept in memory
+        BYTES track_data;
+        track_data.reserve(track_size());
+        Progress * progress = image->get_progress();
+        progress_start(progress, ProgressStage::Write, image->get_tracks());
+        for (uint8_t track = 0; track < image->get_tracks(); track++){
+            if (is_cancelled(progress)) return Result::error(ErrorCode::Cancelled, "Writing cancelled");
+            track_data.clear();
+            uint64_t offset;
+            res = encode_track(track, track_data, offset);
+            if (!res) return res;
+            res = sink.write(track_data);
+            if (!res) return res;
+            progress_step(progress);
+        }
+
+        // Tracks not copied were decoded on demand, as load() would do it
+        return image->lazy_result();
     }
 
     Result WriterHxCMFM::substitute_tracks(BYTES & buffer, std::vector<uint8_t> & tmplt, const int numtracks)
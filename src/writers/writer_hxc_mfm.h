@@ -40,11 +40,18 @@ namespace dsk_tools {
 
     protected:
         void write_hxc_mfm_header(BYTES & out)        ;
+        size_t track_size();
+        size_t header_size();
+        Result encode_track(unsigned track, BYTES & out, uint64_t & offset) override;
     public:
         WriterHxCMFM(const std::string & format_id, diskImage *image_to_save, const uint8_t volume_id);
         std::string get_default_ext() override;
-        Result write(BYTES & buffer) override;
+        Result write(Sink & sink) override;
+        using Writer::write;
+        size_t output_size() override;
+        Result encode_side(unsigned head, unsigned track, BYTES & out) override;
         Result substitute_tracks(BYTES & buffer, std::vector<uint8_t> &tmplt, const int numtracks) override;
+        using Writer::substitute_tracks;
     };
 
 }
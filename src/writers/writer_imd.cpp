@@ -0,0 +1,131 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2025-2026 Mikhail Revzin <p3.141592653589793238462643@gmail.com>
+// Part of the dsk_tools project: https://github.com/Ptr314/dsk_tools
+// Description: A writer class for .IMD files (http://dunfield.classiccmp.org/img/)
+
+#include <cstring>
+#include <ctime>
+
+#include "writer_imd.h"
+#include "loader_imd.h"
+
+namespace dsk_tools {
+
+    WriterIMD::WriterIMD(const std::string & format_id, diskImage * image_to_save):
+          Writer(format_id, image_to_save)
+        , m_size_code(0)
+    {}
+
+    std::string WriterIMD::get_default_ext()
+    {
+        return "imd";
+    }
+
+    size_t WriterIMD::output_size()
+    {
+        return 0;
+    }
+
+    Result WriterIMD::check_geometry()
+    {
+        if (image->get_heads() < 1 || image->get_heads() > 2 || image->get_tracks() > 256)
+            return Result::error(ErrorCode::WriteUnsupported, "Disk geometry not supported for IMD format");
+        if (image->get_sectors() < 1 || image->get_sectors() > 255)
+            return Result::error(ErrorCode::WriteUnsupported, "Sectors count not supported for IMD format");
+        for (m_size_code = 0; m_size_code <= 6; m_size_code++)
+            if ((128u << m_size_code) == image->get_sector_size()) return Result::ok();
+        return Result::error(ErrorCode::WriteUnsupported, "Sector size not supported for IMD format");
+    }
+
+    // 500, 300 or 250 kbps, FM or MFM
+    uint8_t WriterIMD::track_mode() const
+    {
+        const unsigned bitrate = image->get_bitrate();
+        const uint8_t rate = (bitrate >= 500) ? 0 : (bitrate >= 300) ? 1 : 2;
+        const unsigned encoding = image->get_track_encoding();
+        const bool fm = encoding == ISOIBM_FM_ENCODING || encoding == EMU_FM_ENCODING;
+        return fm ? rate : rate + 3;
+    }
+
+    void WriterIMD::write_imd_header(BYTES & out)
+    {
+        char signature[64];
+        const std::time_t now = std::time(nullptr);
+        const size_t length = std::strftime(signature, sizeof(signature), "IMD 1.18: %d/%m/%Y %H:%M:%S", std::localtime(&now));
+        out.insert(out.end(), signature, signature + length);
+        out.push_back('\r');
+        out.push_back('\n');
+        out.push_back(0x1A);                                    // No comment
+    }
+
+    void WriterIMD::write_imd_track(BYTES & out, unsigned head, unsigned cylinder, const uint8_t * sectors)
+    {
+        const unsigned count = image->get_sectors();
+        const unsigned sector_size = image->get_sector_size();
+
+        const IMD_TRACK_HEADER header = {track_mode(), static_cast<uint8_t>(cylinder), static_cast<uint8_t>(head),
+                                         static_cast<uint8_t>(count), m_size_code};
+        const uint8_t * ptr = reinterpret_cast<const uint8_t*>(&header);
+        out.insert(out.end(), ptr, ptr + sizeof(header));
+
+        std::vector<unsigned> order(count);
+        for (unsigned slot = 0; slot < count; slot++) {
+            order[slot] = m_layout.sector_at(slot, cylinder, head, count);
+            out.push_back(static_cast<uint8_t>(order[slot] + 1));
+        }
+
+        // Normal or compressed data, with an error if the sector was bad in the source
+        for (unsigned slot = 0; slot < count; slot++) {
+            const uint8_t * data = sectors + order[slot] * sector_size;
+            const bool bad = image->is_bad_raw_sector(head, cylinder, order[slot]);
+            if (std::memcmp(data, data + 1, sector_size - 1) != 0) {
+                out.push_back(bad ? 0x05 : 0x01);
+                out.insert(out.end(), data, data + sector_size);
+            } else {
+                out.push_back(bad ? 0x06 : 0x02);
+                out.push_back(data[0]);
+            }
+        }
+    }
+
+    Result WriterIMD::write(Sink & sink)
+    {
+        Result res = check_geometry();
+        if (!res) return res;
+
+        const uint8_t * data;
+        size_t size;
+        res = image->get_data(data, size);
+        if (!res) return res;
+        const size_t track_size = static_cast<size_t>(image->get_sectors()) * image->get_sector_size();
+        if (size < track_size * image->get_tracks() * image->get_heads())
+            return Result::error(ErrorCode::WriteIncorrectSource, "Source file size mismatch");
+
+        BYTES out;
+        write_imd_header(out);
+        res = sink.write(out);
+        if (!res) return res;
+
+        // Only one track is kept in memory, the sides follow each other as LoaderIMD reads them
+        out.reserve(sizeof(IMD_TRACK_HEADER) + image->get_sectors() * (2 + image->get_sector_size()));
+        Progress * progress = image->get_progress();
+        progress_start(progress, ProgressStage::Write, image->get_tracks());
+        for (unsigned cylinder = 0; cylinder < image->get_tracks(); cylinder++) {
+            if (is_cancelled(progress)) return Result::error(ErrorCode::Cancelled, "Writing cancelled");
+            for (unsigned head = 0; head < image->get_heads(); head++) {
+                out.clear();
+                write_imd_track(out, head, cylinder, data + (cylinder * image->get_heads() + head) * track_size);
+                res = sink.write(out);
+                if (!res) return res;
+            }
+            progress_step(progress);
+        }
+        return Result::ok();
+    }
+
+    Result WriterIMD::substitute_tracks(BYTES & buffer, BYTES & tmplt, const int numtracks)
+    {
+        return Result::error(ErrorCode::WriteUnsupported, "Track substitution not supported for IMD format");
+    }
+
+}
@@ -0,0 +1,32 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2025-2026 Mikhail Revzin <p3.141592653589793238462643@gmail.com>
+// Part of the dsk_tools project: https://github.com/Ptr314/dsk_tools
+// Description: A writer class for .IMD files (http://dunfield.classiccmp.org/img/)
+#pragma once
+
+
+#include "writer.h"
+
+namespace dsk_tools {
+
+    class WriterIMD:public Writer
+    {
+    protected:
+        uint8_t m_size_code;                                    // Sector size is 128 << m_size_code
+
+        Result check_geometry();
+        uint8_t track_mode() const;
+        void write_imd_header(BYTES & out);
+        // Sectors are numbered from 1 in the order of the layout, as LoaderIMD places them
+        void write_imd_track(BYTES & out, unsigned head, unsigned cylinder, const uint8_t * sectors);
+    public:
+        WriterIMD(const std::string & format_id, diskImage *image_to_save);
+        std::string get_default_ext() override;
+        Result write(Sink & sink) override;
+        using Writer::write;
+        size_t output_size() override;                         // 0: it depends on the data
+        Result substitute_tracks(BYTES & buffer, BYTES & tmplt, const int numtracks) override;
+        using Writer::substitute_tracks;
+    };
+
+}
@@ -3,9 +3,11 @@
 // Part of the dsk_tools project: https://github.com/Ptr314/dsk_tools
 // Description: A top level abstract writer class for some psysical formats
 
+#include <algorithm>
 #include <cstring>
 
 #include "dsk_tools/dsk_tools.h"
+#include "pattern_scan.h"
 #include "writer_mfm.h"
 
 namespace dsk_tools {
@@ -15,91 +17,181 @@ WriterMFM::WriterMFM(const std::string & format_id, diskImage * image_to_save, c
         , m_volume_id(volume_id)
     {}
 
-    void WriterMFM::write_gcr62_track(BYTES & out, uint8_t track, int track_length)
+    static uint8_t * append_template(BYTES & out, const BYTES & tmplt)
+    {
+        const size_t base = out.size();
+        out.insert(out.end(), tmplt.begin(), tmplt.end());
+        return out.data() + base;
+    }
+
+    // A run of fill bytes between fields
+    struct TrackGap {
+        size_t pos;
+        size_t len;
+        size_t cut;
+    };
+
+    using FieldSpans = std::vector<std::pair<size_t, size_t>>;
+
+    // Makes a track exactly length bytes long: fill bytes are added to the longest gap, or removed from the longest
+    // gaps evenly, leaving at least min_gap in every one. fields: [begin, end) in track order, they are never touched
+    static bool resize_gaps(BYTES & track, size_t length, uint8_t fill, size_t min_gap, const FieldSpans & fields)
+    {
+        if (track.size() == length) return true;
+
+        std::vector<TrackGap> gaps;
+        size_t field = 0;
+        size_t i = 0;
+        while (i < track.size()) {
+            if (field < fields.size() && i >= fields[field].first) {
+                i = std::max(i, fields[field].second);
+                field++;
+                continue;
+            }
+            if (track[i] != fill) {
+                i++;
+                continue;
+            }
+            const size_t limit = (field < fields.size()) ? std::min(track.size(), fields[field].first) : track.size();
+            size_t end = i;
+            while (end < limit && track[end] == fill) end++;
+            gaps.push_back({i, end - i, 0});
+            i = end;
+        }
+        if (gaps.empty()) return false;
+
+        if (length > track.size()) {
+            const auto longest = std::max_element(gaps.begin(), gaps.end(), [](const TrackGap & a, const TrackGap & b) {return a.len < b.len;});
+            track.insert(track.begin() + longest->pos, length - track.size(), fill);
+            return true;
+        }
+
+        // The highest level the gaps are cut down to which frees enough bytes
+        const size_t need = track.size() - length;
+        auto freed = [&gaps](size_t level) {
+            size_t sum = 0;
+            for (const TrackGap & g : gaps)
+                if (g.len > level) sum += g.len - level;
+            return sum;
+        };
+        if (freed(min_gap) < need) return false;
+        size_t lo = min_gap;
+        size_t hi = std::max_element(gaps.begin(), gaps.end(), [](const TrackGap & a, const TrackGap & b) {return a.len < b.len;})->len;
+        while (lo < hi) {
+            const size_t mid = (lo + hi + 1) / 2;
+            if (freed(mid) >= need) lo = mid; else hi = mid - 1;
+        }
+        // Fewer than the gaps longer than the level, one byte is given back to each of the first ones
+        size_t extra = freed(lo) - need;
+        for (TrackGap & g : gaps) {
+            if (g.len <= lo) continue;
+            g.cut = g.len - lo;
+            if (extra > 0) {
+                g.cut--;
+                extra--;
+            }
+        }
+
+        size_t w = 0;
+        size_t r = 0;
+        for (const TrackGap & g : gaps) {
+            const size_t keep_end = g.pos + g.len - g.cut;
+            std::memmove(track.data() + w, track.data() + r, keep_end - r);
+            w += keep_end - r;
+            r = g.pos + g.len;
+        }
+        std::memmove(track.data() + w, track.data() + r, track.size() - r);
+        track.resize(length);
+        return true;
+    }
+
+    // Volume, track, sector and their checksum, 4-and-4 encoded
+    static void write_gcr62_address(uint8_t * out, uint8_t volume, uint8_t track, uint8_t sector)
     {
-        BYTES bytes;
-        uint8_t encoded_sector[344];                                            // 343+1
+        const uint8_t field[4] = {volume, track, sector, static_cast<uint8_t>(volume ^ track ^ sector)};
+        for (int i = 0; i < 4; i++) {
+            out[i*2]   = (field[i] >> 1) | 0xAA;
+            out[i*2+1] =  field[i]       | 0xAA;
+        }
+    }
+
+    void WriterMFM::encode_gcr62_sectors(uint8_t track, uint8_t * const encoded[])
+    {
+        const uint8_t * data[AGAT_140_SECTORS];
+        int head = 0;
+        for (int sector = 0; sector < AGAT_140_SECTORS; sector++)
+            data[sector] = image->get_sector_data(head, track, agat_140_raw2logic[sector]);
+        encode_gcr62_track(data, encoded, AGAT_140_SECTORS);
+    }
+
+    void WriterMFM::make_gcr62_template(int track_length)
+    {
+        TrackTemplate & t = m_gcr62_template;
+        BYTES & out = t.bytes;
+        out.clear();
+        t.address.clear();
+        t.data.clear();
 
         // GAP 0
         out.insert(out.end(), AGAT_140_GAP0, 0xFF);                             // +48
 
-        int head = 0;
-        // Agat counts sectors from 0
-        for (uint8_t sector = 0; sector < image->get_sectors(); sector++) {
+        for (int sector = 0; sector < AGAT_140_SECTORS; sector++) {
             // Prologue
-            bytes = {0xD5, 0xAA, 0x96};
-            out.insert(out.end(), bytes.data(), bytes.data() + bytes.size());   // +3
+            out.insert(out.end(), agat_140_address_prologue, agat_140_address_prologue + 3);   // +3
             // Address
-            uint8_t volume = m_volume_id;
-            // uint8_t sector_t = sector_raw2logic(sector);
-            uint8_t sector_t = agat_140_raw2logic[sector];
-            BYTES address_field = {volume, track, sector, static_cast<uint8_t>(volume ^ track ^ sector)};
-            bytes = code44(address_field);
-            out.insert(out.end(), bytes.data(), bytes.data() + bytes.size());   // +8
+            t.address.push_back(out.size());
+            out.insert(out.end(), 8, 0);                                        // +8
             // Epilogue
-            bytes = {0xDE, 0xAA, 0xEB};
-            out.insert(out.end(), bytes.data(), bytes.data() + bytes.size());   // +3
+            out.insert(out.end(), agat_140_epilogue, agat_140_epilogue + 3);   // +3
             // GAP 1
             out.insert(out.end(), AGAT_140_GAP1, 0xFF);                         // +6
             // Data field
             // Prologue
-            bytes = {0xD5, 0xAA, 0xAD};
-            out.insert(out.end(), bytes.data(), bytes.data() + bytes.size());   // +3
+            out.insert(out.end(), agat_140_data_prologue, agat_140_data_prologue + 3);         // +3
             // Data + CRC
-            uint8_t * data = image->get_sector_data(head, track, sector_t);
-            encode_gcr62(data, encoded_sector);
-            out.insert(out.end(), &encoded_sector[0], &encoded_sector[343]);      // +343
+            t.data.push_back(out.size());
+            out.insert(out.end(), GCR62_ENCODED_SIZE, 0);                       // +343
             // Epilogue
-            bytes = {0xDE, 0xAA, 0xEB};
-            out.insert(out.end(), bytes.data(), bytes.data() + bytes.size());   // +3
+            out.insert(out.end(), agat_140_epilogue, agat_140_epilogue + 3);   // +3
             // GAP 2
             out.insert(out.end(), AGAT_140_GAP2, 0xFF);                         // +27
         }
         // GAP 3
         out.insert(out.end(), AGAT_140_GAP3, 0xFF);                             // Padding until track_length
-
     }
 
-    void WriterMFM::write_gcr62_nic_track(BYTES &out, uint8_t track)
+    void WriterMFM::make_gcr62_nic_template()
     {
-        BYTES bytes;
-        uint8_t encoded_sector[344];                                            // 343+1
+        static const uint8_t sync[] = {0x03,0xfc,0xff,0x3f,0xcf,0xf3,0xfc,0xff,0x3f,0xcf,0xf3,0xfc};
 
-        int head = 0;
-        // Agat counts sectors from 0
-        for (uint8_t sector = 0; sector < image->get_sectors(); sector++) {
+        TrackTemplate & t = m_gcr62_nic_template;
+        BYTES & out = t.bytes;
+        out.clear();
+        t.address.clear();
+        t.data.clear();
+
+        for (int sector = 0; sector < AGAT_140_SECTORS; sector++) {
             // GAP
             out.insert(out.end(), 22, 0xFF);
             // ?
-            bytes = {0x03,0xfc,0xff,0x3f,0xcf,0xf3,0xfc,0xff,0x3f,0xcf,0xf3,0xfc};
-            out.insert(out.end(), bytes.data(), bytes.data() + bytes.size());
+            out.insert(out.end(), sync, sync + sizeof(sync));
             // Prologue
-            bytes = {0xD5, 0xAA, 0x96};
-            out.insert(out.end(), bytes.data(), bytes.data() + bytes.size());
+            out.insert(out.end(), agat_140_address_prologue, agat_140_address_prologue + 3);
             // Address
-            uint8_t volume = m_volume_id;
-            // uint8_t sector_t = sector_raw2logic(sector);
-            uint8_t sector_t = agat_140_raw2logic[sector];
-            BYTES address_field = {volume, track, sector, static_cast<uint8_t>(volume ^ track ^ sector)};
-            bytes = code44(address_field);
-            out.insert(out.end(), bytes.data(), bytes.data() + bytes.size());
+            t.address.push_back(out.size());
+            out.insert(out.end(), 8, 0);
             // Epilogue
-            bytes = {0xDE, 0xAA, 0xEB};
-            out.insert(out.end(), bytes.data(), bytes.data() + bytes.size());
+            out.insert(out.end(), agat_140_epilogue, agat_140_epilogue + 3);
             // GAP
             out.insert(out.end(), 5, 0xFF);
             // Data field
             // Prologue
-            bytes = {0xD5, 0xAA, 0xAD};
-            out.insert(out.end(), bytes.data(), bytes.data() + bytes.size());
-
+            out.insert(out.end(), agat_140_data_prologue, agat_140_data_prologue + 3);
             // Data + CRC
-            uint8_t * data = image->get_sector_data(head, track, sector_t);
-            encode_gcr62(data, encoded_sector);
-            out.insert(out.end(), &encoded_sector[0], &encoded_sector[343]);
+            t.data.push_back(out.size());
+            out.insert(out.end(), GCR62_ENCODED_SIZE, 0);
             // Epilogue
-            bytes = {0xDE, 0xAA, 0xEB};
-            out.insert(out.end(), bytes.data(), bytes.data() + bytes.size());
+            out.insert(out.end(), agat_140_epilogue, agat_140_epilogue + 3);
             //GAP
             out.insert(out.end(), 14, 0xFF);
             // Sector padding
@@ -107,8 +199,48 @@ WriterMFM::WriterMFM(const std::string & format_id, diskImage * image_to_save, c
         }
     }
 
-    void WriterMFM::write_agat840_track(BYTES &out, uint8_t head, uint8_t track)
+    void WriterMFM::write_gcr62_track(BYTES & out, uint8_t track, int track_length)
+    {
+        if (m_gcr62_template.bytes.size() != static_cast<size_t>(track_length))
+            make_gcr62_template(track_length);
+        const TrackTemplate & t = m_gcr62_template;
+        uint8_t * p = append_template(out, t.bytes);
+
+        // Agat counts sectors from 0
+        uint8_t * encoded[AGAT_140_SECTORS];
+        for (int slot = 0; slot < AGAT_140_SECTORS; slot++) {
+            const unsigned sector = m_layout.sector_at(slot, track, 0, AGAT_140_SECTORS);
+            write_gcr62_address(p + t.address[slot], m_volume_id, track, sector);
+            encoded[sector] = p + t.data[slot];
+        }
+        encode_gcr62_sectors(track, encoded);
+    }
+
+    void WriterMFM::write_gcr62_nic_track(BYTES &out, uint8_t track)
     {
+        if (m_gcr62_nic_template.bytes.empty())
+            make_gcr62_nic_template();
+        const TrackTemplate & t = m_gcr62_nic_template;
+        uint8_t * p = append_template(out, t.bytes);
+
+        uint8_t * encoded[AGAT_140_SECTORS];
+        for (int slot = 0; slot < AGAT_140_SECTORS; slot++) {
+            const unsigned sector = m_layout.sector_at(slot, track, 0, AGAT_140_SECTORS);
+            write_gcr62_address(p + t.address[slot], m_volume_id, track, sector);
+            encoded[sector] = p + t.data[slot];
+        }
+        encode_gcr62_sectors(track, encoded);
+    }
+
+    void WriterMFM::make_agat840_template()
+    {
+        TrackTemplate & t = m_agat840_template;
+        BYTES & out = t.bytes;
+        out.clear();
+        t.address.clear();
+        t.data.clear();
+
+        const BYTES empty_sector(256, 0);
         uint8_t last_byte = 0;
         // GAP 0
         encode_agat_mfm_array(out, 0xAA, 144, last_byte);
@@ -121,11 +253,9 @@ WriterMFM::WriterMFM(const std::string & format_id, diskImage * image_to_save, c
             // Index start
             encode_agat_mfm_array(out, 0x95, 1, last_byte);             // 4-5
             encode_agat_mfm_array(out, 0x6A, 1, last_byte);             // 6-7
-            // VTS
-            encode_agat_mfm_array(out, m_volume_id, 1, last_byte); //Volume    // 8-9
-            encode_agat_mfm_array(out, track*2 + head, 1, last_byte);   // A-B
-            encode_agat_mfm_array(out, sector, 1, last_byte);
-            // Index end
+            // VTS and index end, rewritten for every track
+            t.address.push_back(out.size());
+            encode_agat_mfm_array(out, 0, 3, last_byte);                // 8-D
             encode_agat_mfm_array(out, 0x5A, 1, last_byte);
             // GAP
             encode_agat_mfm_array(out, 0xAA, 3, last_byte);
@@ -137,11 +267,9 @@ WriterMFM::WriterMFM(const std::string & format_id, diskImage * image_to_save, c
             // Data mark
             encode_agat_mfm_array(out, 0x6A, 1, last_byte);
             encode_agat_mfm_array(out, 0x95, 1, last_byte);
-            // Data + crc
-            uint8_t * data = image->get_sector_data(0, track*2 + head, sector);
-            uint8_t crc = encode_agat_mfm_data(out, data, 256, last_byte);
-            encode_agat_mfm_array(out, crc, 1, last_byte);
-            // Data end
+            // Data + crc + data end, rewritten for every track
+            t.data.push_back(out.size());
+            encode_agat_mfm_array(out, 0, 256 + 1, last_byte);
             encode_agat_mfm_array(out, 0x5A, 1, last_byte);
             // GAP
             encode_agat_mfm_array(out, 0xAA, 29, last_byte);
@@ -150,6 +278,142 @@ WriterMFM::WriterMFM(const std::string & format_id, diskImage * image_to_save, c
         encode_agat_mfm_array(out, 0xAA, 20, last_byte);
         // Fill until standard hfe track length
         encode_agat_mfm_array(out, 0xAA, (HFE_TRACK_LEN/2 - (144 + 302*image->get_sectors() + 20)*2)/2, last_byte);
+    }
+
+    void WriterMFM::write_agat840_track(BYTES &out, uint8_t head, uint8_t track)
+    {
+        if (m_agat840_template.bytes.empty())
+            make_agat840_template();
+        const TrackTemplate & t = m_agat840_template;
+        uint8_t * p = append_template(out, t.bytes);
+
+        // Encoding of a byte depends on the previous one, so the constant byte after a field is rewritten too
+        const unsigned sectors = image->get_sectors();
+        for (unsigned slot = 0; slot < sectors; slot++) {
+            const uint8_t sector = m_layout.sector_at(slot, track, head, sectors);
+            const uint8_t address[4] = {m_volume_id, static_cast<uint8_t>(track*2 + head), sector, 0x5A};
+            uint8_t last_byte = 0x6A;
+            encode_agat_mfm(address, p + t.address[slot], 4, last_byte);
+
+            const uint8_t * data = image->get_sector_data(0, track*2 + head, sector);
+            const uint8_t tail[2] = {agat_840_checksum(data, 256), 0x5A};
+            last_byte = 0x95;
+            encode_agat_mfm(data, p + t.data[slot], 256, last_byte);
+            encode_agat_mfm(tail, p + t.data[slot] + 256*2, 2, last_byte);
+        }
+    }
 
+    bool WriterMFM::copy_gcr62_fields(BYTES &out, const TrackTemplate & t)
+    {
+        const std::vector<SectorScan> & fields = m_raw_scan.sectors;
+        if (fields.size() != t.address.size()) return false;
+        for (const SectorScan & f : fields)
+            if (!f.data_complete) return false;
+
+        // Fields go in the order they are found on the track, marks are copied with them
+        uint8_t * p = append_template(out, t.bytes);
+        for (size_t sector = 0; sector < fields.size(); sector++) {
+            std::memcpy(p + t.address[sector] - 3, m_raw_track.data() + fields[sector].index_pos, 3 + 8 + 3);
+            std::memcpy(p + t.data[sector] - 3, m_raw_track.data() + fields[sector].data_pos, 3 + GCR62_ENCODED_SIZE + 3);
+        }
+        return true;
+    }
+
+    bool WriterMFM::copy_gcr62_track(BYTES &out, uint8_t track, int track_length)
+    {
+        if (!m_copy_tracks || !m_layout.is_default() || image->get_type_id() != "TYPE_AGAT_140") return false;
+        if (image->is_track_dirty(0, track)) return false;
+        const std::string source = image->get_format_id();
+        const bool source_nic = source == "FILE_MFM_NIC";
+        if (!source_nic && source != "FILE_MFM_NIB" && source != "FILE_HXC_MFM") return false;
+        if (!image->read_raw_track(track, m_raw_track)) return false;
+
+        dsk_tools::load_agat140_track(track, nullptr, m_raw_track.data(), m_raw_track.size(), &m_raw_scan);
+
+        if (track_length == 0) {
+            if (source_nic && m_raw_track.size() == AGAT_140_SECTORS * 512) {
+                out.insert(out.end(), m_raw_track.begin(), m_raw_track.end());
+                return true;
+            }
+            if (m_gcr62_nic_template.bytes.empty())
+                make_gcr62_nic_template();
+            return copy_gcr62_fields(out, m_gcr62_nic_template);
+        }
+
+        if (!source_nic) {
+            // Between nibble streams only the gaps change, anything else is kept, even if it is not a field
+            FieldSpans fields;
+            for (const SectorScan & f : m_raw_scan.sectors) {
+                const size_t end = f.data_complete ? f.data_pos + 3 + GCR62_ENCODED_SIZE + 3
+                                 : f.index_complete ? f.index_pos + 3 + 8 + 3
+                                 : m_raw_track.size();
+                fields.emplace_back(f.index_pos, end);
+            }
+            if (resize_gaps(m_raw_track, track_length, 0xFF, AGAT_140_MIN_GAP, fields)) {
+                out.insert(out.end(), m_raw_track.begin(), m_raw_track.end());
+                return true;
+            }
+        }
+
+        if (m_gcr62_template.bytes.size() != static_cast<size_t>(track_length))
+            make_gcr62_template(track_length);
+        return copy_gcr62_fields(out, m_gcr62_template);
+    }
+
+    // The desync before a mark is not a valid MFM byte, it is written as it is on the disk
+    static void restore_agat840_desync(uint8_t * cells, const BYTES & bytes, int mark)
+    {
+        if (mark < 2 || bytes[mark - 1] != 0xFF) return;
+        cells[(mark - 2)*2]     = 0x22;
+        cells[(mark - 2)*2 + 1] = 0x09;
+        uint8_t last_byte = 0xA4;
+        encode_agat_mfm(bytes.data() + mark - 1, cells + (mark - 1)*2, 1, last_byte);
+    }
+
+    bool WriterMFM::copy_agat840_track(BYTES &out, uint8_t head, uint8_t track)
+    {
+        if (!m_copy_tracks || !m_layout.is_default() || image->get_type_id() != "TYPE_AGAT_840") return false;
+        if (image->is_track_dirty(0, track * 2 + head)) return false;          // Sides as sequential tracks
+        const std::string source = image->get_format_id();
+        const bool source_cells = source == "FILE_HXC_HFE";
+        if (!source_cells && source != "FILE_MFM_NIB") return false;
+        if (!image->read_raw_track(track*2 + head, m_raw_track)) return false;
+
+        const size_t side_length = HFE_TRACK_LEN / 2;
+        if (source_cells && m_raw_track.size() == side_length) {
+            out.insert(out.end(), m_raw_track.begin(), m_raw_track.end());
+            return true;
+        }
+
+        // A bitstream can't be cut between cells, gaps are fitted on the decoded bytes
+        if (source_cells) {
+            m_raw_bytes.resize(m_raw_track.size() / 2);
+            decode_agat_mfm(m_raw_track.data(), m_raw_bytes.data(), m_raw_bytes.size());
+        } else
+            m_raw_bytes.swap(m_raw_track);
+
+        decode_agat_840_track(nullptr, m_raw_bytes.data(), m_raw_bytes.size(), &m_raw_scan);
+        FieldSpans fields;
+        for (const SectorScan & f : m_raw_scan.sectors) {
+            const size_t end = f.data_complete ? f.data_pos + 2 + 256 + 2
+                             : f.index_complete ? f.index_pos + 2 + 4
+                             : m_raw_bytes.size();
+            fields.emplace_back((f.index_pos >= 2) ? f.index_pos - 2 : 0, end);
+        }
+        if (!resize_gaps(m_raw_bytes, side_length / 2, 0xAA, AGAT_840_MIN_GAP, fields)) return false;
+
+        const size_t base = out.size();
+        out.resize(base + side_length);
+        uint8_t * p = out.data() + base;
+        uint8_t last_byte = 0;
+        encode_agat_mfm(m_raw_bytes.data(), p, m_raw_bytes.size(), last_byte);
+
+        // Positions have moved with the gaps
+        decode_agat_840_track(nullptr, m_raw_bytes.data(), m_raw_bytes.size(), &m_raw_scan);
+        for (const SectorScan & f : m_raw_scan.sectors) {
+            restore_agat840_desync(p, m_raw_bytes, f.index_pos);
+            if (f.data_pos >= 0) restore_agat840_desync(p, m_raw_bytes, f.data_pos);
+        }
+        return true;
     }
 }
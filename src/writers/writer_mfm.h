@@ -5,23 +5,55 @@
 #pragma once
 
 
+#include <vector>
+
 #include "writer.h"
+#include "gcr62.h"
+#include "track_scan.h"
 
 namespace dsk_tools {
 
+    #define AGAT_140_SECTORS 16
     #define AGAT_140_GAP0    48
     #define AGAT_140_GAP1    6
     #define AGAT_140_GAP2    27
     #define AGAT_140_GAP3    (track_length - (AGAT_140_GAP0 + 16 * (3 + 8 + 3 + AGAT_140_GAP1 + 3 + 343 + 3 + AGAT_140_GAP2)))
+    #define AGAT_140_MIN_GAP 5              // Sync bytes left in a gap when a copied track is shortened
+    #define AGAT_840_MIN_GAP 3
 
     class WriterMFM:public Writer
     {
     protected:
-        uint8_t m_volume_id;
+        // Gaps, marks and sync bytes are the same on every track: a track is a copy of the template
+        // with address fields and sector data written over it
+        struct TrackTemplate {
+            BYTES bytes;
+            std::vector<int> address;                   // Per sector, offsets in bytes
+            std::vector<int> data;
+        };
 
+        uint8_t m_volume_id;
+        TrackTemplate m_gcr62_template;
+        TrackTemplate m_gcr62_nic_template;
+        TrackTemplate m_agat840_template;
+        // Copied tracks, reused from track to track
+        BYTES m_raw_track;
+        BYTES m_raw_bytes;
+        TrackScan m_raw_scan;
+
+        void make_gcr62_template(int track_length);
+        void make_gcr62_nic_template();
+        void make_agat840_template();
+        void encode_gcr62_sectors(uint8_t track, uint8_t * const encoded[]);
         void write_gcr62_track(BYTES &out, uint8_t track, int track_length);
         void write_gcr62_nic_track(BYTES &out, uint8_t track);
         void write_agat840_track(BYTES &out, uint8_t head, uint8_t track);
+        // Tracks copied from the source container with set_copy_tracks(). Gaps are made longer or shorter
+        // to fit the track length, fields stay byte for byte as they are, the volume id too.
+        // false if the source track can't be copied, it is encoded from the sectors then
+        bool copy_gcr62_track(BYTES &out, uint8_t track, int track_length);     // track_length 0: NIC sector blocks
+        bool copy_gcr62_fields(BYTES &out, const TrackTemplate & t);            // Into the sector frames of a template
+        bool copy_agat840_track(BYTES &out, uint8_t head, uint8_t track);       // The MFM bitstream of a side
     public:
         WriterMFM(const std::string & format_id, diskImage *image_to_save, const uint8_t volume_id);
 
@@ -3,6 +3,8 @@
 // Part of the dsk_tools project: https://github.com/Ptr314/dsk_tools
 // Description: A writer class for .DSK files
 
+#include <algorithm>
+
 #include "writer_raw.h"
 
 namespace dsk_tools {
@@ -17,25 +19,70 @@ namespace dsk_tools {
     }
 
 
-    Result WriterRAW::write(BYTES &buffer)
+    size_t WriterRAW::output_size()
+    {
+        return image->get_size();
+    }
+
+    // Straight from the mapped file or the buffer of the image
+    Result WriterRAW::write(Sink & sink)
     {
-        buffer = *image->get_buffer();
+        const uint8_t * data;
+        size_t size;
+        Result res = image->get_data(data, size);
+        if (!res) return res;
+        return sink.write(data, size);
+    }
+
+    // Both sides of a track, the image data is the output as it is
+    size_t WriterRAW::track_size() const
+    {
+        return static_cast<size_t>(image->get_sectors()) * image->get_sector_size() * image->get_heads();
+    }
+
+    Result WriterRAW::encode_track(unsigned track, BYTES & out, uint64_t & offset)
+    {
+        const uint8_t * data;
+        size_t size;
+        Result res = image->get_data(data, size);
+        if (!res) return res;
+
+        offset = static_cast<uint64_t>(track) * track_size();
+        if (track_size() == 0 || offset + track_size() > size)
+            return Result::error(ErrorCode::WriteUnsupported, "Image has no tracks");
+        out.insert(out.end(), data + offset, data + offset + track_size());
         return Result::ok();
     }
 
+    bool WriterRAW::track_changed(unsigned track)
+    {
+        return image->is_range_dirty(static_cast<size_t>(track) * track_size(), track_size());
+    }
+
+    // The first track of the template replaces the one of the image
     Result WriterRAW::substitute_tracks(BYTES & buffer, BYTES &tmplt, const int numtracks)
     {
         if (buffer.size() != tmplt.size())
             return Result::error(ErrorCode::WriteIncorrectTemplate, "Template file size mismatch");
         if (buffer.size() != image->get_size())
             return Result::error(ErrorCode::WriteIncorrectSource, "Source file size mismatch");
-        int block_size = image->get_sectors() * image->get_sector_size() * image->get_heads();
+        const size_t block_size = track_size();
 
-        BYTES out;
-        out.insert(out.end(), tmplt.begin(), tmplt.begin() + block_size);
-        out.insert(out.end(), buffer.begin() + block_size, buffer.end());
-
-        buffer = out;
+        std::copy(tmplt.begin(), tmplt.begin() + block_size, buffer.begin());
         return Result::ok();
     }
+
+    Result WriterRAW::substitute_tracks(const std::string & file_name, const BYTES & tmplt, const int numtracks)
+    {
+        FilePatcher file;
+        Result res = file.open(file_name);
+        if (!res) return res;
+        if (file.size() != tmplt.size())
+            return Result::error(ErrorCode::WriteIncorrectTemplate, "Template file size mismatch");
+        if (file.size() != image->get_size())
+            return Result::error(ErrorCode::WriteIncorrectSource, "Source file size mismatch");
+        const size_t block_size = track_size();
+
+        return file.write_at(0, tmplt.data(), block_size);
+    }
 }
@@ -14,8 +14,16 @@ namespace dsk_tools {
     public:
         WriterRAW(const std::string & format_id, diskImage *image_to_save);
         std::string get_default_ext() override;
-        Result write(BYTES & buffer) override;
+        Result write(Sink & sink) override;
+        using Writer::write;
+        size_t output_size() override;
         Result substitute_tracks(BYTES & buffer, BYTES & tmplt, const int numtracks) override;
+        Result substitute_tracks(const std::string & file_name, const BYTES & tmplt, const int numtracks) override;
+
+    protected:
+        size_t track_size() const;
+        Result encode_track(unsigned track, BYTES & out, uint64_t & offset) override;
+        bool track_changed(unsigned track) override;
     };
 
 }
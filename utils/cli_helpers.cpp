@@ -7,11 +7,14 @@
 #include <windows.h>
 #endif
 
+#include <algorithm>
 #include <stdexcept>
 #include <climits>
+#include <iomanip>
 
 #include "host_helpers.h"
 #include "cli_helpers.h"
+#include "fs_host.h"
 
 namespace dsk_tools {
 
@@ -32,7 +35,7 @@ namespace dsk_tools {
         #endif
     }
 
-    Result write_output_file(const std::string & output_file, const std::string & format_id, const uint8_t volume_id, diskImage * image, const bool verbose)
+    Result write_output_file(const std::string & output_file, const std::string & format_id, const uint8_t volume_id, diskImage * image, const bool verbose, const bool copy_tracks, const bool in_place, const SectorLayout * layout)
     {
         if (verbose) std::cout << "Writing to output: " << output_file << std::endl;
 
@@ -44,16 +47,49 @@ namespace dsk_tools {
 
         const auto writer = create_writer(out_format_id, volume_id, image);
         if (!writer) { return Result::error(ErrorCode::WriteError); }
+        writer->set_copy_tracks(copy_tracks);
+        if (layout != nullptr) {
+            res = writer->set_layout(*layout);
+            if (!res) return res;
+            if (verbose) std::cout << "Sectors layout: " << layout->to_string() << std::endl;
+        }
 
-        BYTES buffer;
-        const Result write_res = writer->write(buffer);
-        if (!write_res) return write_res;
-        UTF8_ofstream file(output_file, std::ios::binary);
-        if (file.good()) {
-            file.write(reinterpret_cast<char*>(buffer.data()), buffer.size());
-            if (file.good()) return Result::ok();
+        // The file stays as it is if this fails, except for the tracks written already
+        if (in_place) {
+            if (verbose) std::cout << "Updating changed tracks only" << std::endl;
+            return writer->update(output_file);
         }
-        return Result::error(ErrorCode::WriteError);
+
+        // Tracks go to the file as soon as they are encoded. The output may be the input, still read from:
+        // it is replaced only when everything is written
+        ReplaceFileSink file(output_file);
+        if (!file.is_open()) return Result::error(ErrorCode::WriteError);
+        Result write_res = writer->write(file);
+        if (write_res) write_res = file.commit();
+        if (write_res && verbose && copy_tracks)
+            std::cout << "Tracks copied without decoding: " << writer->tracks_copied() << " of " << image->get_tracks() * image->get_heads() << std::endl;
+        return write_res;
+    }
+
+    Result make_layout(const std::string & pattern_name, diskImage * image, const std::string & filesystem_id, SectorLayout & layout)
+    {
+        const bool agat_140 = image->get_type_id() == "TYPE_AGAT_140";
+        ReadPattern pattern;
+        if (pattern_name == "dos33" && agat_140)
+            pattern = dos33_read_pattern();
+        else
+        if (pattern_name == "cpm" && agat_140) {
+            // The disk may be converted for CP/M from another system: then its sectors are read untranslated
+            const bool translated = filesystem_id == "FILESYSTEM_CPM_DOS" || filesystem_id == "FILESYSTEM_CPM_PRODOS";
+            pattern = cpm_read_pattern(translated ? filesystem_id : "FILESYSTEM_CPM_RAW");
+        } else
+        if (pattern_name == "seq")
+            pattern = sequential_read_pattern(image->get_sectors());
+        else
+            return Result::error(ErrorCode::IncorrectRequest, "Incorrect interleave for this disk type");
+
+        layout = optimize_layout(pattern, image->get_sectors(), image->get_tracks(), image->get_heads());
+        return Result::ok();
     }
 
     unsigned int parse_number(const std::string& str) {
@@ -78,4 +114,141 @@ namespace dsk_tools {
 
         return static_cast<unsigned int>(value);
     }
+
+    std::vector<std::string> list_input_files(const std::string & input)
+    {
+        std::vector<std::string> result;
+        if (!is_directory(input)) {
+            result.push_back(input);
+            return result;
+        }
+
+        fsHost host(nullptr);
+        bool updir;
+        host.cd(input, updir);
+        std::vector<UniversalFile> files;
+        host.dir(files, false);
+        for (const auto & f : files)
+            if (!f.is_dir) result.push_back(std::string(f.metadata.begin(), f.metadata.end()));
+        std::sort(result.begin(), result.end());
+        return result;
+    }
+
+    static const char * sector_status_name(SectorStatus status)
+    {
+        switch (status) {
+            case SectorStatus::Ok:              return "ok";
+            case SectorStatus::Missing:         return "missing";
+            case SectorStatus::AddressError:    return "address checksum error";
+            case SectorStatus::DataError:       return "data checksum error";
+        }
+        return "";
+    }
+
+    Result verify_file(const std::string & file_name, const bool verbose, bool & intact)
+    {
+        VerifyReport report;
+        Result res = verify_image(file_name, report);
+        if (!res) return res;
+
+        const int total = static_cast<int>(report.status.size());
+        const int bad = total - report.count(SectorStatus::Ok);
+        intact = bad == 0;
+        if (intact)
+            std::cout << file_name << ": OK (" << total << " sectors)" << std::endl;
+        else
+            std::cout << file_name << ": " << bad << " of " << total << " sectors bad" << std::endl;
+
+        for (int track = 0; track < report.tracks; track++)
+            for (int head = 0; head < report.heads; head++) {
+                if (verbose) {
+                    // . - ok, M - missing, A - address checksum, D - data checksum
+                    static const char marks[] = {'.', 'M', 'A', 'D'};
+                    std::string line;
+                    for (int sector = 0; sector < report.sectors; sector++)
+                        line += marks[static_cast<int>(report.at(head, track, sector))];
+                    std::cout << "    " << track;
+                    if (report.heads > 1) std::cout << ":" << head;
+                    std::cout << "\t" << line << std::endl;
+                    continue;
+                }
+                for (int sector = 0; sector < report.sectors; sector++) {
+                    const SectorStatus status = report.at(head, track, sector);
+                    if (status == SectorStatus::Ok) continue;
+                    std::cout << "    track " << track;
+                    if (report.heads > 1) std::cout << ", side " << head;
+                    std::cout << ", sector " << sector << ": " << sector_status_name(status) << std::endl;
+                }
+            }
+        return Result::ok();
+    }
+
+    // find_file() is not there in every filesystem, the directory is looked through then
+    static Result find_by_name(fileSystem * filesystem, const std::string & file_name, UniversalFile & found)
+    {
+        if (filesystem->find_file(to_upper(file_name), found)) return Result::ok();
+
+        Files files;
+        const Result res = filesystem->dir(files, false);
+        if (!res) return res;
+        for (const auto & f : files) {
+            std::string name = f.name;
+            name.erase(name.find_last_not_of(' ') + 1);
+            if (to_upper(name) == to_upper(file_name)) {
+                found = f;
+                return Result::ok();
+            }
+        }
+        return Result::error(ErrorCode::NotFound, "No such file");
+    }
+
+    Result print_read_time(fileSystem * filesystem, diskImage * image, const std::string & format_id, const uint8_t volume_id,
+                           const std::string & file_name, const SectorLayout * layout, const bool verbose)
+    {
+        UniversalFile f;
+        Result res = find_by_name(filesystem, file_name, f);
+        if (!res) return res;
+
+        // The sectors in the order the filesystem reads them
+        std::vector<SectorRead> reads;
+        BYTES data;
+        image->trace_reads(&reads);
+        res = filesystem->get_file(f, "", data);
+        image->trace_reads(nullptr);
+        if (!res) return res;
+
+        std::string tracks_format = format_id;
+        if (tracks_format != "FILE_MFM_NIB" && tracks_format != "FILE_MFM_NIC" && tracks_format != "FILE_HXC_MFM" && tracks_format != "FILE_HXC_HFE")
+            tracks_format = (image->get_type_id() == "TYPE_AGAT_840") ? "FILE_HXC_HFE" : "FILE_MFM_NIB";
+        const auto writer = create_writer(tracks_format, volume_id, image);
+        if (!writer) return Result::error(ErrorCode::WriteUnsupported, "No track format for this disk type");
+        // The tracks of the input as they are, unless they are ordered anew
+        writer->set_copy_tracks(true);
+        if (layout != nullptr) {
+            res = writer->set_layout(*layout);
+            if (!res) return res;
+        }
+
+        ReadTimes times;
+        res = simulate_reads(image, *writer, reads, default_drive_timing(image->get_type_id()), times);
+        if (!res) return res;
+
+        std::cout << std::fixed << std::setprecision(1);
+        std::cout << file_name << ": " << reads.size() << " sectors, " << times.total * 1000 << " ms";
+        if (times.revolution > 0) std::cout << " (" << times.total / times.revolution << " revolutions)";
+        std::cout << std::endl;
+        if (verbose) {
+            for (size_t i = 0; i < reads.size(); i++) {
+                const ReadLatency & r = times.requests[i];
+                std::cout << "    " << reads[i].track;
+                if (image->get_heads() > 1) std::cout << ":" << reads[i].head;
+                std::cout << ":" << reads[i].sector
+                          << "\tseek " << (r.processing + r.seek) * 1000
+                          << "\twait " << r.wait * 1000
+                          << "\tread " << r.transfer * 1000 << " ms" << std::endl;
+            }
+        }
+        std::cout.unsetf(std::ios::floatfield);
+        return Result::ok();
+    }
 }
@@ -8,8 +8,21 @@
 #include "dsk_tools/dsk_tools.h"
 
 namespace dsk_tools {
-    enum class CLICommand {none, ls, add, del, extract};
+    enum class CLICommand {none, ls, add, del, extract, verify, timing};
     void setupConsole();
-    Result write_output_file(const std::string & output_file, const std::string & format_id, const uint8_t volume_id, diskImage * image, const bool verbose);
+    // copy_tracks: the image is as loaded, encoded tracks may be copied as they are
+    // in_place: the output is the file the image was loaded from, only the changed tracks are written there
+    // layout: order of sectors on the written tracks, if not the default one
+    Result write_output_file(const std::string & output_file, const std::string & format_id, const uint8_t volume_id, diskImage * image, const bool verbose, const bool copy_tracks = false, const bool in_place = false, const SectorLayout * layout = nullptr);
+    // The layout read fastest by a system: dos33, cpm (through the sectors translation of filesystem_id) or seq
+    Result make_layout(const std::string & pattern_name, diskImage * image, const std::string & filesystem_id, SectorLayout & layout);
     unsigned int parse_number(const std::string& str);
+    // The file itself, or the files of a directory sorted by name
+    std::vector<std::string> list_input_files(const std::string & input);
+    // Prints the sectors with checksum errors; intact is false if there are any
+    Result verify_file(const std::string & file_name, const bool verbose, bool & intact);
+    // Prints how long a real drive takes to load the file, every sector with verbose. The tracks are as they would be
+    // written in the input format, or in NIB / HFE if it has no tracks, with the layout if it is given
+    Result print_read_time(fileSystem * filesystem, diskImage * image, const std::string & format_id, const uint8_t volume_id,
+                           const std::string & file_name, const SectorLayout * layout, const bool verbose);
 }
@@ -27,12 +27,15 @@ int main(int argc, char** argv)
     std::vector<std::string> add_values;
     std::vector<std::string> delete_values;
     std::vector<std::string> extract_values;
+    std::vector<std::string> timing_values;
     bool output_expected = true;
     bool verbose = false;
     bool is_bin = false;
     std::string input_file;
     std::string output_file;
     uint8_t volume_id = 254;
+    bool volume_given = false;
+    std::string interleave;
     std::string format_id;
     std::string type_id;
     std::string filesystem_id;
@@ -50,11 +53,16 @@ int main(int argc, char** argv)
             ("input", "Input file", cxxopts::value<std::string>())
             ("o,output", "Output file", cxxopts::value<std::string>())
             ("l,ls", "List files", cxxopts::value<bool>()->default_value("false"))
+            ("t,timing", "Estimate the time a real drive takes to load the file", cxxopts::value<std::vector<std::string>>())
+            ("verify", "Verify sector checksums of the input image, or of every image in the input directory", cxxopts::value<bool>()->default_value("false"))
             ("a,add", "File to add", cxxopts::value<std::vector<std::string>>())
             ("e,extract", "File to extract from the disk", cxxopts::value<std::vector<std::string>>())
             ("b,binary", "Save extracted files as binary, not FIL (For Apple DOS)", cxxopts::value<bool>()->default_value("false"))
             ("d,delete", "File to delete", cxxopts::value<std::vector<std::string>>())
             ("m,volume", "Volume id - decimal (i.e. 254) or hex (i.e. $FE)", cxxopts::value<std::string>())
+            ("i,interleave", "Order sectors of the output for the fastest reading by: \n"
+                                        "dos33 (Apple DOS), cpm (CP/M), seq (sequential, i.e. Agat 840 DOS)",
+                                        cxxopts::value<std::string>())
             ("f,input_format", "Input file format DDD:FFF \n"
                                         "DDD: a140 (Apple/Agat 140k), \n"
                                         "     a840 (Agat 840k). \n"
@@ -87,6 +95,11 @@ int main(int argc, char** argv)
             output_expected = false;
         }
 
+        if (res["verify"].as<bool>()) {
+            command = CLICommand::verify;
+            output_expected = false;
+        }
+
         if (res.count("add")) {
             add_values = res["add"].as<std::vector<std::string>>();
             if (!add_values.empty()) {
@@ -109,12 +122,26 @@ int main(int argc, char** argv)
             }
         }
 
+        if (res.count("timing")) {
+            timing_values = res["timing"].as<std::vector<std::string>>();
+            if (!timing_values.empty()) {
+                command = CLICommand::timing;
+                output_expected = false;
+            }
+        }
+
         if (res.count("volume")) {
             const std::string vid_str = res["volume"].as<std::string>();
             volume_id = parse_number(vid_str) & 0xFF;
+            volume_given = true;
             if (verbose) std::cout << "Volume id: " << std::to_string(volume_id) << " ($" << int_to_hex(volume_id) << ")" <<std::endl;
         }
 
+        if (res.count("interleave")) {
+            interleave = res["interleave"].as<std::string>();
+            std::transform(interleave.begin(), interleave.end(), interleave.begin(), ::tolower);
+        }
+
         if (res.count("input_format")) {
             const std::string format_str = res["input_format"].as<std::string>();
             size_t pos = format_str.find(':');
@@ -140,6 +167,27 @@ int main(int argc, char** argv)
         return bail("Bad options: %s", e.what());
     }
 
+    // Verifying checksums ----------------------------------------------------
+
+    // Nothing is loaded, the sectors are checked straight from the track data
+    if (command == CLICommand::verify) {
+        const std::vector<std::string> files = list_input_files(input_file);
+        const bool single = files.size() == 1 && files.front() == input_file;
+        int damaged = 0;
+        for (const auto & file : files) {
+            bool intact = false;
+            const Result res = verify_file(file, verbose, intact);
+            if (!res) {
+                if (single) return bail("Can't verify image : %s : %s", decode_error(res).c_str(), res.message.c_str());
+                // Other files in a directory are not images with checksums
+                if (verbose) std::cout << file << ": skipped : " << res.message << std::endl;
+                continue;
+            }
+            if (!intact) damaged++;
+        }
+        return (damaged == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
     if (command == CLICommand::none) {
         if (verbose) std::cout << "No any command given, just converting" << std::endl;
         // return bail("No any command given");
@@ -181,18 +229,31 @@ int main(int argc, char** argv)
             return bail("Input file error : %s : %s", decode_error(res).c_str(), res.message.c_str());
         }
     }
-    auto image = prepare_image(input_file, format_id, type_id);
+    auto image = prepare_image(input_file, format_id, type_id, DiskDefs());
     if (!image) return bail("Can't open image");
 
+    // Read-only commands touch a few tracks only, the rest is never decoded.
+    // A plain conversion copies encoded tracks where it can and decodes only the others
+    const bool copy_tracks = command == CLICommand::none && !volume_given;
+    // Saving over the input writes back only the tracks changed by the commands, the others are not even decoded
+    const bool in_place = output_expected && !volume_given && interleave.empty() && output_file == input_file;
+    image->set_lazy(command == CLICommand::ls || command == CLICommand::extract || command == CLICommand::timing || copy_tracks || in_place);
+
     auto load_res = image->load();
     if (!load_res) return bail("Can't load image : %s : %s", decode_error(load_res).c_str(), load_res.message.c_str());
 
-    auto filesystem = prepare_filesystem(image.get(), filesystem_id);
+    auto filesystem = prepare_filesystem(image.get(), filesystem_id, DiskDefs());
     if (!filesystem) return bail("Can't prepare filesystem");
 
     auto open_res = filesystem->open();
     if (!open_res) return bail("Can't open filesystem : %s : %s", decode_error(open_res).c_str(), open_res.message.c_str());
 
+    SectorLayout layout;
+    if (!interleave.empty()) {
+        const Result layout_res = make_layout(interleave, image.get(), filesystem_id, layout);
+        if (!layout_res) return bail("Can't order sectors : %s : %s", decode_error(layout_res).c_str(), layout_res.message.c_str());
+    }
+
     // Performing commands ----------------------------------------------------
 
     // LS
@@ -290,10 +351,20 @@ int main(int argc, char** argv)
         }
     }
 
+    if (command == CLICommand::timing) {
+        if (verbose) std::cout << "Command: timing" << std::endl;
+        for (const auto & file_to_time : timing_values) {
+            const auto time_res = print_read_time(filesystem.get(), image.get(), format_id, volume_id, file_to_time,
+                                                  interleave.empty() ? nullptr : &layout, verbose);
+            if (!time_res) {return bail("Can't time file '%s': %s : %s", file_to_time.c_str(), decode_error(time_res).c_str(), time_res.message.c_str());}
+        }
+    }
+
     // Writing results ----------------------------------------------------
 
     if (output_expected) {
-        Result write_res = write_output_file(output_file, format_id, volume_id, image.get(), verbose);
+        Result write_res = write_output_file(output_file, format_id, volume_id, image.get(), verbose, copy_tracks, in_place,
+                                             interleave.empty() ? nullptr : &layout);
         if (!write_res) return bail("Can't write output file : %s : %s", decode_error(write_res).c_str(), write_res.message.c_str());
     }
 